@@ -34,6 +34,7 @@ disclaimer.
 #include <linux/kernel.h>
 #include <linux/platform_device.h>
 #include <linux/netdevice.h>
+#include <linux/rtnetlink.h>
 #include <linux/etherdevice.h>
 #include <linux/pci.h>
 #include <linux/workqueue.h>
@@ -41,15 +42,54 @@ disclaimer.
 #include <linux/if_vlan.h>
 #ifdef MVPPND_DEBUG_DATA_PATH
 #include <linux/if_ether.h>
+#endif
 #include <linux/ip.h>
 #include <linux/ipv6.h>
-#endif
-#include <linux/kthread.h>
+#include <net/ip.h>
+#include <net/dsfield.h>
+#include <linux/hrtimer.h>
+#include <linux/delay.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/jhash.h>
+#include <linux/rcupdate.h>
+#include <net/busy_poll.h>
 #if LINUX_VERSION_CODE <= KERNEL_VERSION(5,16,0)
 #include <asm-generic/bitops/find.h>
 #else
 #include <linux/find.h>
 #endif
+/* Zero-copy RX relies on page pool recycling of skbs (5.15 and above) */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5,15,0)) && IS_ENABLED(CONFIG_PAGE_POOL)
+#define MVPPND_RX_PAGE_POOL
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,6,0)
+#include <net/page_pool/helpers.h>
+#else
+#include <net/page_pool.h>
+#endif
+/* Native XDP runs on the page pool buffers */
+#define MVPPND_XDP
+#include <linux/bpf.h>
+#include <linux/bpf_trace.h>
+#include <net/xdp.h>
+#endif
+/* AF_XDP zero-copy, UMEM frames are posted to the RX rings */
+#if defined(MVPPND_XDP) && IS_ENABLED(CONFIG_XDP_SOCKETS)
+#define MVPPND_XSK
+#include <net/xdp_sock_drv.h>
+#endif
+/* Adaptive RX interrupt moderation */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5,3,0)) && IS_ENABLED(CONFIG_DIMLIB)
+#define MVPPND_RX_DIM
+#include <linux/dim.h>
+#endif
+/* TSO, segments are built by the driver into the TX ring */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
+#define MVPPND_TSO
+#include <net/tso.h>
+#include <net/ip6_checksum.h>
+#include <linux/tcp.h>
+#endif
 #include "ethDriver.h"
 
 /* #define DBG_DELAY */
@@ -77,6 +117,7 @@ disclaimer.
 #define PCI_DEVICE_ID_AC5X    0x981f
 #define PCI_DEVICE_ID_ALDRIN2 0xcc0f
 #define NUM_OF_TX_QUEUES NUM_OF_RX_QUEUES
+#define NUM_OF_TX_PRIOS 8 /* skb->priority values mapped to TX queues */
 #define NUM_OF_ATU_WINDOWS 8
 #define NUM_OF_MG_WINDOWS 6
 #define ATU_OFFS 0x1200 /* iATU offset in bar0 */
@@ -99,6 +140,7 @@ disclaimer.
 #define REG_ADDR_MG_HA			0x023C
 #define REG_ADDR_MG_CONTROL		0x0254
 #define REG_ADDR_SDMA_CONF		0x2800
+#define REG_ADDR_TX_CAUSE_0		0x2810
 #define REG_ADDR_TX_MASK_0		0x2818
 #define REG_ADDR_PG_CFG_QUEUE		0x28B0
 #define REG_ADDR_PORT2_MASK_0		0x015C
@@ -128,15 +170,39 @@ enum {
 /* TX descriptor status/command field bits */
 enum {
 	TX_CMD_BIT_OWN_SDMA	= (1 << 31),
+	TX_CMD_BIT_EN_INTR	= (1 << 23),
 	TX_CMD_BIT_FIRST	= (1 << 21),
 	TX_CMD_BIT_LAST		= (1 << 20),
 	TX_CMD_BIT_CRC		= (1 << 12),
 };
 
+/*
+ * Traffic class bits of the FROM_CPU eDSA tag, byte and mask in the tag.
+ * TC[0] is bit 17 of word 0, TC[1] and TC[2] are bits 14 and 27 of word 1.
+ */
+enum {
+	TX_DSA_TC0_BYTE	= 1,
+	TX_DSA_TC0_MASK	= (1 << 1),
+	TX_DSA_TC1_BYTE	= 6,
+	TX_DSA_TC1_MASK	= (1 << 6),
+	TX_DSA_TC2_BYTE	= 4,
+	TX_DSA_TC2_MASK	= (1 << 3),
+};
+
+/*
+ * 802.1Q tag of the FROM_CPU eDSA tag. Bit 29 of word 0 sends the frame
+ * tagged, bits 15:13 and 11:0 of word 0 are the UP and VID, as in the TCI.
+ */
+enum {
+	TX_DSA_TAGGED_BYTE	= 0,
+	TX_DSA_TAGGED_MASK	= (1 << 5),
+	TX_DSA_TCI_BYTE		= 2,
+	TX_DSA_TCI_MASK		= (VLAN_PRIO_MASK | VLAN_VID_MASK),
+};
+
 /* RX descriptor status/command field bits */
 enum {
 	RX_CMD_BIT_OWN_SDMA	= (1 << 31),
-	RX_CMD_BIT_CSUM		= (1 << 30),
 	RX_CMD_BIT_LAST		= (1 << 26),
 	RX_CMD_BIT_FIRST	= (1 << 27),
 	RX_CMD_BIT_RES_ERR	= (1 << 28),
@@ -161,6 +227,8 @@ enum {
 
 #define RX_DESC_GET_BYTE_CNT(bc) \
 	((bc >> 16) & 0x3FFF)
+/* Byte count word bit - L4 checksum of the frame was found good */
+#define RX_DESC_BC_BIT_CSUM (1 << 30)
 #define RX_DESC_SET_BUFF_SIZE(bc, val) \
 	bc = __builtin_bswap32(bc); \
 	U32_SET_FIELD(bc, 0, 14, val); \
@@ -171,40 +239,85 @@ enum {
 #define MAX_NETDEVS (2 << 10)
 #define DEF_ATU_WIN_AC5X 3
 
-/* How long to wait for SDMA to take ownership of a descriptor */
-static const unsigned long TX_WAIT_FOR_CPU_OWENERSHIP_USEC = 100000;
+/* How long the TX ring tail may not move before the queue is recovered */
+static const s64 TX_STALL_USEC = 250;
+/* Recoveries a frame may take before it is dropped */
+static const u8 TX_STALL_RETRIES = 3;
+/* How long SDMA may take to stop a TX queue */
+static const int TX_QUEUE_DISABLE_USEC = 20;
+/* Netdev watchdog, a TX queue stopped longer than it is recovered */
+static const int TX_WATCHDOG_MSEC = 1000;
 /* How many SKBs we allow to have in our TX ring */
 static const unsigned long TX_QUEUE_SIZE = 10000;
 static const u16 DEFAULT_NAPI_POLL_WEIGHT = NAPI_POLL_WEIGHT * 4;
 static const u8 MAX_EMPTY_NAPI_POLL = 20;
-static const int RX_THREAD_UDELAY = 5000;
+/* Frames sent from AF_XDP sockets in one TX work round */
+static const int XSK_TX_BUDGET = 64;
+/* Safety poll for missed RX interrupts */
+static const u32 RX_SAFETY_POLL_USEC = 1000;
+/* Static RX interrupt moderation, used when adaptive moderation is off */
+static const u32 DEFAULT_RX_COAL_USECS = 0;
+static const u32 DEFAULT_RX_COAL_FRAMES = 1;
 static const u16 DEFAULT_ATU_WIN = 4;
 /* MG windows - one for coherent and max 2 for streaming, indexes below */
 static const u8 DEFAULT_MG_WIN = 0xE;
 static const u8 MG_WIN_COHERENT_IDX = 0;
 static const u8 MG_WIN_STREAMING1_IDX = 1;
 static const u8 MG_WIN_STREAMING2_IDX = 2;
+/* Each streaming window covers half of the 32bit DMA space */
+static const u32 MG_WIN_STREAMING_SIZE = 0x80000000;
 static const u8 DEFAULT_TX_DSA[] = {0x50, 0x02, 0x10, 0x00, 0x88, 0x08, 0x40,
 				    0x00, 0xa0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
 				    0x0}; /* Forward */
-/* TX ring size for MAC, DSA, head and all frags */
-static const u16 TX_RING_SIZE = roundup_pow_of_two(MAX_FRAGS + 3);
+/* Descriptors a TX frame may take - MAC, DSA, head, all frags and CRC */
+static const u16 TX_MAX_FRAME_DESCS = MAX_FRAGS + 4;
+/* TX ring size, room for several frames in flight */
+static const u16 TX_RING_SIZE = roundup_pow_of_two(MAX_FRAGS + 4) * 16;
+/* Descriptors a TX frame takes at least - MAC, DSA and data */
+static const u16 TX_MIN_FRAME_DESCS = 3;
+/* Hence frames in flight at most, each with its TX copy slot */
+#define TX_COPY_SLOTS (TX_RING_SIZE / TX_MIN_FRAME_DESCS)
+/* Descriptors a TSO frame may take, bigger ones are segmented by the stack */
+static const u16 TX_TSO_MAX_DESCS = roundup_pow_of_two(MAX_FRAGS + 4) * 4;
+/* Room for the headers of a TSO segment, or a runt one padded, >= ETH_ZLEN */
+static const u32 TX_TSO_HDR_SZ = 256;
 static const u16 DEFAULT_RX_RING_SIZE = roundup_pow_of_two(128);
 static const u32 DEFAULT_PKT_SZ = 2048; /* Multiplications of 8 */
+/* Frames above it are received over several descriptors */
+static const u32 RX_MAX_BUFF_SZ = 2048;
 static const u32 DEFAULT_TX_QUEUE = 4;
+/* Nibble per priority - SDMA TX queue serving it, 0xF leaves it to XPS */
+static const u32 DEFAULT_TX_PRIO_QUEUES = 0xFFFFFFFF;
 static const u32 DEFAULT_RX_QUEUES = 0xFF; /* default to max for better testing coverage */
+/* Nibble per RX queue - NAPI context serving it, default one per queue */
+static const u32 DEFAULT_RX_QUEUES_NAPI = 0x76543210;
+static const u32 DEFAULT_RX_QUEUES_WEIGHT = 0x88888888; /* 4 bits for each q */
 static const u8 CRC_SIZE = 4;
+/* Smaller TX frames are copied rather than DMA mapped, >= ETH_ZLEN */
+static const u32 TX_COPYBREAK = 256;
+/* Frames a flow queues for a full TX ring before its TX queue is stopped */
+static const u32 TX_FLOW_BACKLOG = 64;
+/* Bytes a flow backlog is credited with on each DRR round */
+static const u32 TX_DRR_QUANTUM = ETH_FRAME_LEN;
+/* Room in front of a page pool RX buffer, needed by build_skb and XDP */
+#ifdef MVPPND_XDP
+#define RX_PP_HEADROOM (XDP_PACKET_HEADROOM + NET_IP_ALIGN)
+#else
+#define RX_PP_HEADROOM (NET_SKB_PAD + NET_IP_ALIGN)
+#endif
 
 static const u8 DEFAULT_MAC[] = {0x00, 0x50, 0x43, 0x0, 0x0, 0x0};
 /* Default mask is each flow is port, ex. flow 1 is port #1 */
 static const u8 DEFAULT_RX_DSA_MASK[] = {0x00, 0xF8, 0x00, 0x00, 0x00, 0x00,
 					 0x0c, 0x00, 0x00, 0x30, 0x00, 0x00,
 					 0x00, 0x00, 0x00, 0x00};
+/* RX flow demux, the port bits of DEFAULT_RX_DSA_MASK index a direct table */
+#define RX_DEMUX_PORTS 512
+#define RX_DEMUX_HASH_BITS 10
+#define RX_DEMUX_MAX_MASKS 8 /* Distinct non-default masks */
 
 static unsigned int last_poll_pkts, max_poll_pkts = 0;
 static unsigned int last_budget_pkts, max_budget_pkts = 0;
-static unsigned long no_skbs, tx_tout;
-static unsigned long tx_busy_size, tx_busy_mem;
 
 /* Defines slot for each statistics attribute in stats array */
 enum mvppnd_stats {
@@ -224,7 +337,32 @@ enum mvppnd_stats {
 	STATS_RX_TREE1_INTERRUPTS,
 	STATS_NAPI_POLL_CALLS,
 	STATS_NAPI_BURN_BUDGET,
-	STATS_LAST = STATS_NAPI_BURN_BUDGET,
+	STATS_RX_GRO_PACKETS,
+	STATS_RX_GRO_MERGED,
+	STATS_NAPI_GRO_FLUSHES,
+	STATS_NAPI_BUSY_POLL_HELD,
+	STATS_RX_Q0_CSUM_BAD,
+	STATS_RX_Q1_CSUM_BAD,
+	STATS_RX_Q2_CSUM_BAD,
+	STATS_RX_Q3_CSUM_BAD,
+	STATS_RX_Q4_CSUM_BAD,
+	STATS_RX_Q5_CSUM_BAD,
+	STATS_RX_Q6_CSUM_BAD,
+	STATS_RX_Q7_CSUM_BAD,
+	STATS_RX_COAL_DEFERRALS,
+	STATS_RX_SAFETY_POLLS,
+	STATS_RX_XDP_DROP,
+	STATS_RX_XDP_TX,
+	STATS_RX_XDP_REDIRECT,
+	STATS_RX_XDP_ABORTED,
+	STATS_XSK_RX_NO_BUFF,
+	STATS_XSK_TX_PACKETS,
+	STATS_TX_INTERRUPTS,
+	STATS_TX_DOORBELLS,
+	STATS_TX_STALL_RECOVERIES,
+	STATS_RX_NO_BUFFS,
+	STATS_TX_RING_BUSY,
+	STATS_LAST = STATS_TX_RING_BUSY,
 };
 
 /* Description of each of the above statistics */
@@ -245,6 +383,31 @@ static const char *mvppnd_stats_descs[] = {
 	"RX_TREE1_INTERRUPTS      ",
 	"NAPI_POLL_CALLS          ",
 	"NAPI_BURN_BUDGET         ",
+	"RX_GRO_PACKETS           ",
+	"RX_GRO_MERGED            ",
+	"NAPI_GRO_FLUSHES         ",
+	"NAPI_BUSY_POLL_HELD      ",
+	"RX_Q0_CSUM_BAD           ",
+	"RX_Q1_CSUM_BAD           ",
+	"RX_Q2_CSUM_BAD           ",
+	"RX_Q3_CSUM_BAD           ",
+	"RX_Q4_CSUM_BAD           ",
+	"RX_Q5_CSUM_BAD           ",
+	"RX_Q6_CSUM_BAD           ",
+	"RX_Q7_CSUM_BAD           ",
+	"RX_COAL_DEFERRALS        ",
+	"RX_SAFETY_POLLS          ",
+	"RX_XDP_DROP              ",
+	"RX_XDP_TX                ",
+	"RX_XDP_REDIRECT          ",
+	"RX_XDP_ABORTED           ",
+	"XSK_RX_NO_BUFF           ",
+	"XSK_TX_PACKETS           ",
+	"TX_INTERRUPTS            ",
+	"TX_DOORBELLS             ",
+	"TX_STALL_RECOVERIES      ",
+	"RX_NO_BUFFS              ",
+	"TX_RING_BUSY             ",
 };
 
 struct mvppnd_hw_desc {
@@ -280,6 +443,67 @@ struct mvppnd_128bit_var {
 	u64 high, low;
 };
 
+struct mvppnd_demux_entry {
+	struct hlist_node node;
+	struct mvppnd_switch_flow *flow;
+	struct mvppnd_128bit_var val;
+	u8 mask_idx;
+};
+
+/*
+ * RX flow lookup index, immutable once published. Rebuilt when a flow goes up
+ * or down or its rx_dsa_val/rx_dsa_mask is changed, readers are under RCU.
+ */
+struct mvppnd_rx_demux {
+	struct rcu_head rcu;
+	/* Flows with the default mask, by port number */
+	struct mvppnd_switch_flow *ports[RX_DEMUX_PORTS];
+	/* Flows with any other mask, hashed by mask index and value */
+	struct mvppnd_128bit_var masks[RX_DEMUX_MAX_MASKS];
+	u8 num_masks;
+	struct hlist_head hash[1 << RX_DEMUX_HASH_BITS];
+	u32 num_entries;
+	struct mvppnd_demux_entry entries[];
+};
+
+/*
+ * Frames of a flow waiting for room in a TX ring. Rings are shared by all the
+ * flows, backlogs are served by DRR so a busy flow can't starve the others.
+ * Under the ring lock.
+ */
+struct mvppnd_tx_backlog {
+	struct mvppnd_switch_flow *flow;
+	struct sk_buff_head skbs;
+	struct list_head node; /* On the ring's list while it has frames */
+	unsigned int deficit;
+	bool stopped; /* The flow's TX queue was stopped by this backlog */
+	unsigned long backlogged;
+	unsigned long dropped;
+};
+
+/* Driver statistics, counted on the local CPU and summed up on read */
+struct mvppnd_stats {
+	u64 stats[STATS_LAST + 1];
+	struct u64_stats_sync syncp;
+};
+
+/* Netdev statistics of a flow, see mvppnd_get_stats64 */
+enum {
+	FLOW_STATS_RX_PACKETS,
+	FLOW_STATS_RX_BYTES,
+	FLOW_STATS_TX_PACKETS,
+	FLOW_STATS_TX_BYTES,
+	FLOW_STATS_RX_DROPPED,
+	FLOW_STATS_TX_DROPPED,
+	FLOW_STATS_RX_LENGTH_ERRORS,
+	FLOW_STATS_LAST = FLOW_STATS_RX_LENGTH_ERRORS,
+};
+
+struct mvppnd_flow_stats {
+	u64 stats[FLOW_STATS_LAST + 1];
+	struct u64_stats_sync syncp;
+};
+
 /* netdev for each switch flow (ex each port has netdev) */
 struct mvppnd_switch_flow {
 	struct net_device *ndev;
@@ -295,8 +519,16 @@ struct mvppnd_switch_flow {
 	u8 rx_dsa_val[DSA_SIZE]; /* Along with mask will identify flow in RX */
 	u8 rx_dsa_mask[DSA_SIZE];
 
+	struct bpf_prog *xdp_prog; /* Run on frames of this flow */
+
+	struct mvppnd_flow_stats __percpu *stats;
+
+	/* By netdev TX queue, as the rings */
+	struct mvppnd_tx_backlog tx_backlog[NUM_OF_TX_QUEUES];
+
 	struct kobj_attribute attr_mac;
 	struct kobj_attribute attr_tx_dsa;
+	struct kobj_attribute attr_tx_backlog;
 	struct kobj_attribute attr_rx_dsa_val;
 	struct kobj_attribute attr_rx_dsa_mask;
 };
@@ -309,7 +541,11 @@ struct mvppnd_switch_dev {
 
 	u32 flows_cnt;
 
-	unsigned long stats[STATS_LAST + 1];
+	struct mvppnd_rx_demux __rcu *rx_demux;
+	struct mutex demux_lock; /* Serialize RX demux rebuilds */
+
+	struct mvppnd_stats __percpu *stats;
+	u64 stats_base[STATS_LAST + 1]; /* Where driver_statistics was cleared */
 };
 
 struct mvppnd_pci_dev {
@@ -323,8 +559,82 @@ struct device_private_data {
 	u32 mg_reg_base; /* mg 0 register base */
 };
 
+/* Frame posted to the TX ring, kept by its first descriptor */
+struct mvppnd_tx_frame {
+	u16 ndescs;
+	u8 recoveries; /* Times the queue was restarted at this frame */
+	u32 bytes;
+	struct sk_buff *skb; /* Zero-copy frame, held until SDMA is done */
+	bool head_mapped; /* Mappings are in the ring buffs[] of the frame */
+	u8 frags_mapped;
+	struct net_device *bql_dev; /* Frame was accounted to its TX queue */
+	struct xsk_buff_pool *xsk_pool; /* Completed to the socket's ring */
+	u32 xsk_dropped; /* Descriptors of the socket completed behind it */
+};
+
 struct mvppnd_queue {
 	struct mvppnd_ring ring;
+	int queue; /* Index in rx_queues */
+	struct page_pool *page_pool; /* RX zero-copy mode only */
+	struct mvppnd_napi *rx_napi; /* NAPI context serving this queue */
+#ifdef MVPPND_XDP
+	struct xdp_rxq_info xdp_rxq;
+#endif
+	/* AF_XDP zero-copy mode, buffers come from the socket's UMEM */
+	struct xsk_buff_pool *xsk_pool;
+	struct xdp_buff **xsk_buffs;
+	u32 xsk_frame_sz;
+	bool xsk_no_buff; /* Fill ring ran dry in the current poll */
+};
+
+/*
+ * SDMA TX queue, serves the same netdev TX queue index of all the flows.
+ * Each has its own lock so CPUs posting to different queues do not contend.
+ */
+struct mvppnd_txq {
+	struct mvppnd_ring ring;
+	int queue; /* SDMA TX queue number */
+	u16 idx; /* netdev TX queue of the flows */
+	spinlock_t lock; /* Serialize ring access of all flows */
+	bool ready; /* Ring is set up, under lock */
+	/* Ring head is ring.descs_ptr, tail is the oldest frame */
+	size_t clean_ptr;
+	struct mvppnd_tx_frame *frames;
+	u32 frames_inflight;
+	bool stopped; /* Flows are stopped until the ring has room */
+	bool doorbell; /* Frames were posted since the queue was enabled */
+	ktime_t progress; /* Ring tail last moved, or the ring got busy */
+	struct list_head backlogs; /* Flow backlogs with frames, DRR order */
+	struct mvppnd_dma_buf dsa; /* Per frame, for a tag edited on transmit */
+	struct mvppnd_dma_buf buffs; /* TX_COPY_SLOTS copies of max_pkt_sz */
+	struct mvppnd_dma_buf tso_hdrs; /* TX_COPY_SLOTS of TX_TSO_HDR_SZ */
+	size_t copy_ptr; /* Slot of the next frame, taken in ring order */
+} ____cacheline_aligned_in_smp;
+
+/*
+ * NAPI context serving one or more RX queues. With threaded NAPI enabled
+ * on the main netdev each context runs in its own kthread which can be
+ * pinned to a different core.
+ */
+struct mvppnd_napi {
+	struct napi_struct napi;
+	struct mvppnd_dev *ppdev;
+	u32 queues_mask; /* RX queues served by this context */
+	size_t drr_queue; /* Queue to resume the DRR round from */
+	unsigned int gro_pkts; /* Fed to GRO in the current poll */
+	/*
+	 * Interrupt moderation, on interrupt the poll is deferred up to
+	 * coal_usecs unless coal_frames are already pending
+	 */
+	struct hrtimer coal_timer;
+	u32 coal_usecs, coal_frames;
+	u16 events; /* NAPI completions, for DIM */
+	u64 rx_packets, rx_bytes;
+	bool xdp_redirect; /* xdp_do_flush() is due at the end of the poll */
+	bool tx_doorbell; /* Frames sent back from RX wait for mvppnd_tx_flush */
+#ifdef MVPPND_RX_DIM
+	struct dim dim;
+#endif
 };
 
 struct mvppnd_dev {
@@ -345,26 +655,46 @@ struct mvppnd_dev {
 	/* For all coherent memory allocations (rings, data pointers etc) */
 	struct mvppnd_dma_block coherent;
 
-	int tx_queue_num; /* TX queue to post to */
-	struct mvppnd_queue tx_queue;
+	u32 tx_queues_mask; /* SDMA TX queues to post to, set by sysfs */
+	struct mvppnd_txq txqs[NUM_OF_TX_QUEUES]; /* By netdev TX queue */
+	int num_txqs; /* Set on open from tx_queues_mask */
+	struct mvppnd_dma_buf tx_dsa; /* TX DSA template of each flow */
+	struct mvppnd_dma_buf tx_crc; /* CRC room of zero-copy TX frames */
+	u8 tx_prio_queue[NUM_OF_TX_PRIOS]; /* SDMA TX queue, 0xF for none */
+	s8 tx_prio_txq[NUM_OF_TX_PRIOS]; /* netdev TX queue, -1 for XPS */
 	int tx_queue_size;
-	atomic_t tx_skb_in_transit;
-	struct workqueue_struct *tx_wq;
-	struct mvppnd_dma_buf dsa;
-	struct mvppnd_dma_buf mac;
-	struct mvppnd_dma_buf tx_buffs;
+	struct mvppnd_napi *tx_napi; /* Serves TX completion interrupts */
 
 	u32 rx_queues_mask; /* Used to set and clear RX interrupt mask */
 	struct mutex rx_lock;
 	size_t rx_rings_size[NUM_OF_RX_QUEUES];
 	struct mvppnd_queue *rx_queues[NUM_OF_RX_QUEUES];
-	size_t rx_queue_ptr; /* to resume RX work when budget is overrun */
-	struct napi_struct napi;
+	u8 rx_queue_napi[NUM_OF_RX_QUEUES]; /* NAPI context of each queue */
+	u8 rx_queues_weight[NUM_OF_RX_QUEUES]; /* DRR weight of RX queues */
+	int rx_queues_deficit[NUM_OF_RX_QUEUES]; /* DRR deficit counters */
+	unsigned long rx_queues_starved[NUM_OF_RX_QUEUES];
+	unsigned long rx_queues_carried[NUM_OF_RX_QUEUES];
+	struct mvppnd_napi rx_napi[NUM_OF_RX_QUEUES];
+	spinlock_t intr_lock; /* Serialize interrupt mask updates */
 	int napi_budget;
 
-	struct task_struct *rx_thread;
+	struct hrtimer rx_poll_timer; /* Catches missed RX interrupts */
+	bool rx_coal_adaptive; /* set by ethtool -C */
+	u32 rx_coal_usecs, rx_coal_frames;
 
 	size_t max_pkt_sz; /* Maximum size of frame, set by sysfs */
+	size_t rx_buff_sz; /* Size of RX buffers, set on open */
+	bool rx_zero_copy; /* RX buffers from page pool, set by sysfs */
+	bool tx_zero_copy; /* Streaming MG windows are set, frags are mapped */
+	atomic_t xdp_progs; /* Flows with an XDP program attached */
+#ifdef MVPPND_XSK
+	/* AF_XDP sockets by RX queue and the flow netdev they are bound to */
+	struct xsk_buff_pool *xsk_pools[NUM_OF_RX_QUEUES];
+	struct mvppnd_switch_flow *xsk_flows[NUM_OF_RX_QUEUES];
+	size_t xsk_tx_tail[NUM_OF_RX_QUEUES]; /* Latest frame of the socket */
+	struct work_struct xsk_tx_work;
+#endif
+	unsigned int rx_page_order; /* page pool allocation order */
 
 	struct mvppnd_ops *ops; /* hook callback functions set */
 
@@ -377,10 +707,15 @@ struct mvppnd_dev {
 	struct kobj_attribute attr_rx_ring_size;
 	struct kobj_attribute attr_napi_budget;
 	struct kobj_attribute attr_max_pkt_sz;
+	struct kobj_attribute attr_rx_zero_copy;
 	struct kobj_attribute attr_rx_queues;
+	struct kobj_attribute attr_rx_queues_napi;
+	struct kobj_attribute attr_rx_queues_weight;
 	struct kobj_attribute attr_if_create;
 	struct kobj_attribute attr_if_delete;
 	struct kobj_attribute attr_tx_queue;
+	struct kobj_attribute attr_tx_queues;
+	struct kobj_attribute attr_tx_prio_queues;
 	struct kobj_attribute attr_atu_win;
 	struct kobj_attribute attr_mg_win;
 	struct kobj_attribute attr_mg;
@@ -390,15 +725,17 @@ struct mvppnd_dev {
 	struct kobj_attribute attr_driver_statistics;
 };
 
-struct mvppnd_skb_work {
-	struct work_struct work;
-	struct mvppnd_dev *ppdev;
-	struct sk_buff *skb;
-};
-
 int mvppnd_create_netdev(struct mvppnd_dev *ppdev, const char *name, int port);
 static void mvppnd_destroy_netdev(struct mvppnd_dev *ppdev, int flow_id);
 netdev_tx_t mvppnd_start_xmit(struct sk_buff *skb, struct net_device *dev);
+static void mvppnd_xmit_skb(struct sk_buff *skb, u16 txq_idx, bool more);
+static bool mvppnd_transmit_skb(struct mvppnd_dev *ppdev,
+				struct mvppnd_txq *txq,
+				struct mvppnd_switch_flow *flow,
+				struct sk_buff *skb, bool more);
+static void mvppnd_tx_purge_backlog(struct mvppnd_tx_backlog *bl);
+static void mvppnd_tx_complete(struct mvppnd_dev *ppdev);
+static void mvppnd_tx_flush(struct mvppnd_dev *ppdev);
 
 /* Did we successfully registered as platform driver? zero means yes */
 #ifdef SUPPORT_PLATFORM_DEVICE
@@ -432,15 +769,87 @@ static void netif_receive_skb_list(struct list_head *head)
 }
 #endif
 
+/* BQL aware doorbell batching was introduced in kernel 4.20 */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,20,0)
+static inline bool __netdev_tx_sent_queue(struct netdev_queue *dev_queue,
+					  unsigned int bytes, bool xmit_more)
+{
+	netdev_tx_sent_queue(dev_queue, bytes);
+
+	return true;
+}
+#endif
+
+static inline bool mvppnd_xmit_more(struct sk_buff *skb)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,2,0)
+	return netdev_xmit_more();
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3,18,0)
+	return skb->xmit_more;
+#else
+	return false;
+#endif
+}
+
 /*********** Driver statistics functions ***************/
+/* The ISR counts as well, on 32 bit an update must not be cut in half */
+static inline unsigned long mvppnd_stats_begin(struct u64_stats_sync *syncp)
+{
+	unsigned long flags = 0;
+
+#if BITS_PER_LONG == 32
+	local_irq_save(flags);
+#endif
+	u64_stats_update_begin(syncp);
+
+	return flags;
+}
+
+static inline void mvppnd_stats_end(struct u64_stats_sync *syncp,
+				    unsigned long flags)
+{
+	u64_stats_update_end(syncp);
+#if BITS_PER_LONG == 32
+	local_irq_restore(flags);
+#endif
+}
+
 static inline void mvppnd_inc_stat(struct mvppnd_dev *ppdev, u8 stat_idx,
 				   unsigned long inc_by)
 {
-	ppdev->sdev.stats[stat_idx] += inc_by;
+	struct mvppnd_stats *stats = get_cpu_ptr(ppdev->sdev.stats);
+	unsigned long flags;
+
+	flags = mvppnd_stats_begin(&stats->syncp);
+	stats->stats[stat_idx] += inc_by;
+	mvppnd_stats_end(&stats->syncp, flags);
+
+	put_cpu_ptr(ppdev->sdev.stats);
+}
+
+static u64 mvppnd_sum_stat(struct mvppnd_dev *ppdev, u8 stat_idx)
+{
+	const struct mvppnd_stats *stats;
+	unsigned int start;
+	u64 sum = 0, val;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		stats = per_cpu_ptr(ppdev->sdev.stats, cpu);
+		do {
+			start = u64_stats_fetch_begin(&stats->syncp);
+			val = stats->stats[stat_idx];
+		} while (u64_stats_fetch_retry(&stats->syncp, start));
+		sum += val;
+	}
+
+	return sum;
 }
+
+/* Counters are per CPU, they are shown relative to where they were cleared */
 static inline void mvppnd_clear_stat(struct mvppnd_dev *ppdev, u8 stat_idx)
 {
-	ppdev->sdev.stats[stat_idx] = 0;
+	ppdev->sdev.stats_base[stat_idx] = mvppnd_sum_stat(ppdev, stat_idx);
 }
 
 static inline const char *mvppnd_get_stat_desc(u8 stat_idx)
@@ -448,24 +857,81 @@ static inline const char *mvppnd_get_stat_desc(u8 stat_idx)
 	return mvppnd_stats_descs[stat_idx];
 }
 
-static inline unsigned long mvppnd_get_stat(struct mvppnd_dev *ppdev,
-					    u8 stat_idx,
-					    unsigned long last_jiffies)
+static inline u64 mvppnd_get_stat(struct mvppnd_dev *ppdev, u8 stat_idx,
+				  unsigned long last_jiffies)
 {
-	static unsigned long last_rx_packets = 0;
+	static u64 last_rx_packets, rx_packets_rate;
 	unsigned long diff;
+	u64 rx_packets;
+	u64 val = 0;
+	int i;
 
 	/* Some stats needs special care */
 	if (stat_idx == STATS_RX_PACKETS_RATE) {
 		diff = jiffies - last_jiffies;
+		rx_packets = mvppnd_sum_stat(ppdev, STATS_RX_PACKETS);
 		if (diff / HZ)
-			ppdev->sdev.stats[STATS_RX_PACKETS_RATE] =
-				(ppdev->sdev.stats[STATS_RX_PACKETS] -
-				last_rx_packets) / (diff / HZ);
-		last_rx_packets = ppdev->sdev.stats[STATS_RX_PACKETS];
+			rx_packets_rate = div_u64(rx_packets - last_rx_packets,
+						  diff / HZ);
+		last_rx_packets = rx_packets;
+
+		return rx_packets_rate;
+	}
+
+	/* Each TX queue counts its own, under its lock */
+	if (stat_idx == STATS_TX_IN_TRANSIT) {
+		for (i = 0; i < ppdev->num_txqs; i++)
+			val += READ_ONCE(ppdev->txqs[i].frames_inflight);
+
+		return val;
 	}
 
-	return ppdev->sdev.stats[stat_idx];
+	return mvppnd_sum_stat(ppdev, stat_idx) -
+	       ppdev->sdev.stats_base[stat_idx];
+}
+
+static inline void mvppnd_inc_flow_stat(struct net_device *ndev, u8 stat_idx,
+					u64 inc_by)
+{
+	struct mvppnd_switch_flow *flow = netdev_priv(ndev);
+	struct mvppnd_flow_stats *stats = get_cpu_ptr(flow->stats);
+	unsigned long flags;
+
+	flags = mvppnd_stats_begin(&stats->syncp);
+	stats->stats[stat_idx] += inc_by;
+	mvppnd_stats_end(&stats->syncp, flags);
+
+	put_cpu_ptr(flow->stats);
+}
+
+/* Packets and their bytes, as one update */
+static inline void mvppnd_count_flow(struct net_device *ndev, u8 pkts_idx,
+				     u8 bytes_idx, u64 pkts, u64 bytes)
+{
+	struct mvppnd_switch_flow *flow = netdev_priv(ndev);
+	struct mvppnd_flow_stats *stats = get_cpu_ptr(flow->stats);
+	unsigned long flags;
+
+	flags = mvppnd_stats_begin(&stats->syncp);
+	stats->stats[pkts_idx] += pkts;
+	stats->stats[bytes_idx] += bytes;
+	mvppnd_stats_end(&stats->syncp, flags);
+
+	put_cpu_ptr(flow->stats);
+}
+
+static inline void mvppnd_count_flow_rx(struct net_device *ndev, u64 pkts,
+					u64 bytes)
+{
+	mvppnd_count_flow(ndev, FLOW_STATS_RX_PACKETS, FLOW_STATS_RX_BYTES,
+			  pkts, bytes);
+}
+
+static inline void mvppnd_count_flow_tx(struct net_device *ndev, u64 pkts,
+					u64 bytes)
+{
+	mvppnd_count_flow(ndev, FLOW_STATS_TX_PACKETS, FLOW_STATS_TX_BYTES,
+			  pkts, bytes);
 }
 
 /*********** registers related functions ***************/
@@ -612,34 +1078,86 @@ static void mvppnd_update_interrupt_mask(struct mvppnd_dev *ppdev, u32 reg,
 	}
 }
 
-/* Disable completion interrupts from our queues */
-static inline void mvppnd_dis_rx_queues_intr(struct mvppnd_dev *ppdev, u8 tree)
+/*
+ * Disable completion interrupts from the given queues.
+ * Each NAPI context masks only its own queues, so the read-modify-write of
+ * the mask register must be serialized between CPUs
+ */
+static inline void mvppnd_dis_rx_queues_intr(struct mvppnd_dev *ppdev, u8 tree,
+					     u32 queues_mask)
 {
+	unsigned long flags;
+
+	spin_lock_irqsave(&ppdev->intr_lock, flags);
 	mvppnd_update_interrupt_mask(ppdev, REG_ADDR_RX_MASK[tree],
 				     /* disable completion events */
-				     ppdev->rx_queues_mask << 2 |
+				     queues_mask << 2 |
 				     /* disable resource error events
 				        (HW reached to CPU owned descriptor) */
-				     ppdev->rx_queues_mask << 11,
+				     queues_mask << 11,
 				     false);
+	spin_unlock_irqrestore(&ppdev->intr_lock, flags);
 }
 
-/* Enable completion interrupts from our queues */
-static inline void mvppnd_en_rx_queues_intr(struct mvppnd_dev *ppdev, u8 tree)
+/* Enable completion interrupts from the given queues */
+static inline void mvppnd_en_rx_queues_intr(struct mvppnd_dev *ppdev, u8 tree,
+					    u32 queues_mask)
 {
+	unsigned long flags;
+
 	/* TODO: We should disable resource error events here, the same as
 		 what we are doing in mvppnd_dis_rx_queues_intr */
+	spin_lock_irqsave(&ppdev->intr_lock, flags);
 	mvppnd_update_interrupt_mask(ppdev, REG_ADDR_RX_MASK[tree],
-				     ppdev->rx_queues_mask << 2, true);
+				     queues_mask << 2, true);
+	spin_unlock_irqrestore(&ppdev->intr_lock, flags);
 }
 
 static inline void mvppnd_disable_tx_interrupts(struct mvppnd_dev *ppdev)
 {
+	u32 bits = 0;
+	int i;
+
 	/* Disable Tx Buffer Queue, Tx Error Queue and Tx End Queue */
+	for (i = 0; i < ppdev->num_txqs; i++)
+		bits |= (1 << (ppdev->txqs[i].queue + 1)) |
+			(1 << (ppdev->txqs[i].queue + 9)) |
+			(1 << (ppdev->txqs[i].queue + 17));
+
+	mvppnd_update_interrupt_mask(ppdev, REG_ADDR_TX_MASK_0, bits, false);
+}
+
+/* Tx Buffer Queue and Tx End Queue events, completion is handled in NAPI */
+static inline u32 mvppnd_tx_queue_intr_bits(struct mvppnd_dev *ppdev)
+{
+	u32 bits = 0;
+	int i;
+
+	for (i = 0; i < ppdev->num_txqs; i++)
+		bits |= (1 << (ppdev->txqs[i].queue + 1)) |
+			(1 << (ppdev->txqs[i].queue + 17));
+
+	return bits;
+}
+
+static inline void mvppnd_dis_tx_queue_intr(struct mvppnd_dev *ppdev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ppdev->intr_lock, flags);
+	mvppnd_update_interrupt_mask(ppdev, REG_ADDR_TX_MASK_0,
+				     mvppnd_tx_queue_intr_bits(ppdev), false);
+	spin_unlock_irqrestore(&ppdev->intr_lock, flags);
+}
+
+static inline void mvppnd_en_tx_queue_intr(struct mvppnd_dev *ppdev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ppdev->intr_lock, flags);
 	mvppnd_update_interrupt_mask(ppdev, REG_ADDR_TX_MASK_0,
-				     (1 << (ppdev->tx_queue_num + 1)) |
-				     (1 << (ppdev->tx_queue_num + 9)) |
-				     (1 << (ppdev->tx_queue_num + 17)), false);
+				     mvppnd_tx_queue_intr_bits(ppdev), true);
+	spin_unlock_irqrestore(&ppdev->intr_lock, flags);
 }
 
 #if 0
@@ -769,6 +1287,41 @@ static void mvppnd_setup_mg_window(struct mvppnd_dev *ppdev, u8 mg_win,
 			 REG_ADDR_MG_CONTROL_OFFSET_FORMULA, control);
 }
 
+/* SDMA reaches host memory through the oATU, see mvppnd_setup_mg_window */
+static bool mvppnd_uses_oatu(struct mvppnd_dev *ppdev)
+{
+	return ppdev->pdev.pdev &&
+	       (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2) &&
+	       (ppdev->pdev.atu_win != -1);
+}
+
+/*
+ * Last DMA address the streaming windows reach. MG windows put SDMA accesses
+ * at PCI addresses with bit 31 set, so behind the oATU only 2G of host memory
+ * can be covered, see mvppnd_setup_streaming_mg_windows. Otherwise it is the
+ * 32bit space descriptors can address.
+ */
+static u64 mvppnd_streaming_dma_limit(struct mvppnd_dev *ppdev)
+{
+	return mvppnd_uses_oatu(ppdev) ? DMA_BIT_MASK(31) : DMA_BIT_MASK(32);
+}
+
+/*
+ * Streaming DMA is usable only when the DMA API is bound to the windows. Not
+ * the case on AC5/X, where DDR starts at 0x2_0000_0000.
+ */
+static bool mvppnd_streaming_dma_ok(struct mvppnd_dev *ppdev)
+{
+	return dma_get_mask(ppdev->dev) <= mvppnd_streaming_dma_limit(ppdev);
+}
+
+/* Streaming buffer is reachable through the streaming MG windows */
+static inline bool mvppnd_dma_in_win(struct mvppnd_dev *ppdev,
+				     dma_addr_t dma, size_t len)
+{
+	return dma + len - 1 <= mvppnd_streaming_dma_limit(ppdev);
+}
+
 /*********** some debug function ***********************/
 #ifdef MVPPND_DEBUG_DATA_PATH
 static void print_skb_hdr(struct mvppnd_dev *ppdev, const char *dir,
@@ -910,6 +1463,50 @@ static size_t mvppnd_num_of_rx_queues(struct mvppnd_dev *ppdev)
 	return num_of_rx_queues;
 }
 
+/* 4 bits for each queue, the NAPI context which serves it */
+static void mvppnd_setup_rx_queues_napi(struct mvppnd_dev *ppdev, u32 map)
+{
+	int i;
+
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++, map >>= 4)
+		ppdev->rx_queue_napi[i] = (map & 0xF) % NUM_OF_RX_QUEUES;
+}
+
+/* 4 bits for each queue, zero weight is taken as one */
+static void mvppnd_setup_rx_queues_weights(struct mvppnd_dev *ppdev,
+					   u32 weights)
+{
+	int i;
+
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++, weights >>= 4)
+		ppdev->rx_queues_weight[i] = max_t(u32, weights & 0xF, 1);
+}
+
+/* netdev TX queue of each priority, by its SDMA queue if that is in use */
+static void mvppnd_map_tx_prios(struct mvppnd_dev *ppdev)
+{
+	int i, j;
+
+	for (i = 0; i < NUM_OF_TX_PRIOS; i++) {
+		for (j = 0; j < ppdev->num_txqs; j++)
+			if (ppdev->txqs[j].queue == ppdev->tx_prio_queue[i])
+				break;
+		WRITE_ONCE(ppdev->tx_prio_txq[i],
+			   (j < ppdev->num_txqs) ? j : -1);
+	}
+}
+
+/* 4 bits for each priority, the SDMA TX queue which serves it */
+static void mvppnd_setup_tx_prio_queues(struct mvppnd_dev *ppdev, u32 map)
+{
+	int i;
+
+	for (i = 0; i < NUM_OF_TX_PRIOS; i++, map >>= 4)
+		ppdev->tx_prio_queue[i] = map & 0xF;
+
+	mvppnd_map_tx_prios(ppdev);
+}
+
 static inline int cyclic_idx(int c, size_t s)
 {
 	if (c < 0)
@@ -923,6 +1520,16 @@ static inline void cyclic_inc(size_t *c, size_t s)
 	*c = (*c + 1) & (s - 1); /* use bitwise AND as it is faster than modulo (division) */
 }
 
+/* Next queue after queue in queues_mask, wraps around */
+static inline size_t mvppnd_next_queue(u32 queues_mask, size_t queue)
+{
+	do {
+		cyclic_inc(&queue, NUM_OF_RX_QUEUES);
+	} while (!(queues_mask & BIT(queue)));
+
+	return queue;
+}
+
 static int mvppnd_queue_enabled(struct mvppnd_dev *ppdev, u32 cmd_reg_addr,
 				int queue)
 {
@@ -947,14 +1554,31 @@ static u32 mvppnd_read_tx_first_desc(struct mvppnd_dev *ppdev, u8 queue)
 			       REG_ADDR_TX_FIRST_DESC_OFFSET_FORMULA);
 }
 
-static void mvppnd_write_tx_first_desc(struct mvppnd_dev *ppdev, u32 val)
+static void mvppnd_write_tx_first_desc(struct mvppnd_dev *ppdev, u8 queue,
+				       u32 val)
 {
-	mvppnd_disable_queue(ppdev, REG_ADDR_TX_QUEUE_CMD, ppdev->tx_queue_num);
+	mvppnd_disable_queue(ppdev, REG_ADDR_TX_QUEUE_CMD, queue);
 
-	mvppnd_write_reg(ppdev, REG_ADDR_TX_FIRST_DESC + ppdev->tx_queue_num *
+	mvppnd_write_reg(ppdev, REG_ADDR_TX_FIRST_DESC + queue *
 			 REG_ADDR_TX_FIRST_DESC_OFFSET_FORMULA, val);
 }
 
+/*
+ * SDMA completes the descriptor it is on before it drops the enable bit, wait
+ * for it a bounded time. Returns false if the queue is still enabled.
+ */
+static bool mvppnd_disable_tx_queue_sync(struct mvppnd_dev *ppdev, u8 queue)
+{
+	int i;
+
+	mvppnd_disable_queue(ppdev, REG_ADDR_TX_QUEUE_CMD, queue);
+	for (i = 0; (i < TX_QUEUE_DISABLE_USEC) &&
+	     mvppnd_queue_enabled(ppdev, REG_ADDR_TX_QUEUE_CMD, queue); i++)
+		udelay(1);
+
+	return !mvppnd_queue_enabled(ppdev, REG_ADDR_TX_QUEUE_CMD, queue);
+}
+
 static u32 mvppnd_read_rx_first_desc(struct mvppnd_dev *ppdev, u8 queue)
 {
 	return mvppnd_read_reg(ppdev, REG_ADDR_RX_FIRST_DESC + queue *
@@ -1008,26 +1632,36 @@ static int mvppnd_alloc_device_coherent(struct mvppnd_dev *ppdev)
 	size = rx_rings_total_size * sizeof(struct mvppnd_hw_desc);
 	ppdev->coherent.buf.size += max(size, PAGE_SIZE);
 
-	/* One TX queue */
-	size = TX_RING_SIZE * sizeof(struct mvppnd_hw_desc);
-	ppdev->coherent.buf.size += max(size, PAGE_SIZE);
+	/* TX queues, each with the below for its own ring */
+	for (i = 0; i < ppdev->num_txqs; i++) {
+		size = TX_RING_SIZE * sizeof(struct mvppnd_hw_desc);
+		ppdev->coherent.buf.size += max(size, PAGE_SIZE);
 
-	/* Space for TX buffers (+1 for head) */
-	size = TX_RING_SIZE * ppdev->max_pkt_sz;
-	ppdev->coherent.buf.size += max(size, PAGE_SIZE);
+		/* Space for TX copies, a slot per frame in flight */
+		size = TX_COPY_SLOTS * ppdev->max_pkt_sz;
+		ppdev->coherent.buf.size += max(size, PAGE_SIZE);
 
-	/* Space for two MACs (first descriptor) */
-	size = ETH_ALEN * 2;
-	ppdev->coherent.buf.size += max(size, PAGE_SIZE);
+#ifdef MVPPND_TSO
+		/* Space for TSO segment headers, in the same slots */
+		size = TX_COPY_SLOTS * TX_TSO_HDR_SZ;
+		ppdev->coherent.buf.size += max(size, PAGE_SIZE);
+#endif
 
-	/* Space for DSA (second descriptor) */
-	size = DSA_SIZE;
-	ppdev->coherent.buf.size += max(size, PAGE_SIZE);
+		/* Space for DSA (second descriptor), per frame in flight */
+		size = TX_RING_SIZE * DSA_SIZE;
+		ppdev->coherent.buf.size += max(size, PAGE_SIZE);
+	}
 
-	/* Space for RX buffers */
-	size = rx_rings_total_size * ppdev->max_pkt_sz;
+	/* Space for the TX DSA template of each flow, and the TX CRC room */
+	size = MAX_NETDEVS * DSA_SIZE + CRC_SIZE;
 	ppdev->coherent.buf.size += max(size, PAGE_SIZE);
 
+	/* Space for RX buffers, page pool provides them in zero-copy mode */
+	if (!ppdev->rx_zero_copy) {
+		size = rx_rings_total_size * ppdev->rx_buff_sz;
+		ppdev->coherent.buf.size += max(size, PAGE_SIZE);
+	}
+
 	/* Round to power of two */
 	ppdev->coherent.buf.size = roundup_pow_of_two(ppdev->coherent.buf.size);
 
@@ -1127,41 +1761,121 @@ static void *mvppnd_alloc_coherent(struct mvppnd_dev *ppdev, size_t size,
 }
 
 /*********** buf wrappers ******************************/
+/*
+ * SDMA reads the DSA of a flow straight from its template, built from
+ * config_tx_dsa when the flow goes up and when dsa is written. Called under
+ * rtnl, frames still in flight may go out with either of the tags.
+ */
+static void mvppnd_build_tx_dsa(struct mvppnd_dev *ppdev,
+				struct mvppnd_switch_flow *flow)
+{
+	if (!ppdev->tx_dsa.virt)
+		return;
+
+	memcpy(ppdev->tx_dsa.virt + flow->flow_id * DSA_SIZE,
+	       flow->config_tx_dsa, DSA_SIZE);
+}
+
 static int mvppnd_copy_skb_to_tx_buff(struct mvppnd_dev *ppdev,
+				      struct mvppnd_txq *txq,
 				      struct sk_buff *skb,
 				      struct mvppnd_dma_sg_buf *sgb)
 {
-	static const size_t PACKET_MIN_SIZE = ETH_ZLEN - ETH_ALEN * 2;
-	int rc = 0;
-	int i;
+	/* Each frame in flight has its own slot, see TX_COPY_SLOTS */
+	size_t off = txq->copy_ptr * ppdev->max_pkt_sz;
+	void *virt = txq->buffs.virt + off;
+	dma_addr_t dma = txq->buffs.dma + off;
+	unsigned int len = skb->len;
+
+	if (unlikely(len > ppdev->max_pkt_sz))
+		return -EMSGSIZE;
+
+	/* MACs, head and frags, xmit_buf splits the MACs off */
+	if (len < ETH_ZLEN)
+		memset(virt + len, 0, ETH_ZLEN - len);
+	skb_copy_bits(skb, 0, virt, len);
+	sgb->mappings[0] = dma;
+	sgb->sizes[0] = max_t(unsigned int, len, ETH_ZLEN);
+
+	return 0;
+}
+
+static void mvppnd_unmap_tx_frame(struct mvppnd_dev *ppdev,
+				  struct mvppnd_tx_frame *frame,
+				  struct mvppnd_dma_sg_buf *sgb)
+{
+	int i = 0;
+
+	if (frame->head_mapped) {
+		dma_unmap_single(ppdev->dev, sgb->mappings[0], sgb->sizes[0],
+				 DMA_TO_DEVICE);
+		i++;
+	}
+
+	for (; i < frame->head_mapped + frame->frags_mapped; i++)
+		dma_unmap_page(ppdev->dev, sgb->mappings[i], sgb->sizes[i],
+			       DMA_TO_DEVICE);
+
+	frame->head_mapped = false;
+	frame->frags_mapped = 0;
+}
+
+/*
+ * Zero-copy, the head from offs on and each of the frags get their own
+ * descriptor. Mappings are recorded in frame so they can be undone on reclaim.
+ * Fails on a mapping out of the streaming MG windows, caller then copies.
+ */
+static int mvppnd_map_skb_to_tx_descs(struct mvppnd_dev *ppdev,
+				      struct sk_buff *skb, unsigned int offs,
+				      struct mvppnd_tx_frame *frame,
+				      struct mvppnd_dma_sg_buf *sgb)
+{
+	unsigned int headlen = skb_headlen(skb) - offs;
+	const skb_frag_t *frag;
+	dma_addr_t dma;
+	int i, n = 0;
 
-	if (unlikely((skb_shinfo(skb)->nr_frags > MAX_FRAGS)))
+	if (skb_shinfo(skb)->nr_frags > MAX_FRAGS)
 		return -EINVAL;
 
-	skb_pull(skb, ETH_ALEN * 2); /* Skip src and dest macs */
+	if (headlen) {
+		dma = dma_map_single(ppdev->dev, skb->data + offs, headlen,
+				     DMA_TO_DEVICE);
+		if (dma_mapping_error(ppdev->dev, dma))
+			return -ENOMEM;
+		if (unlikely(!mvppnd_dma_in_win(ppdev, dma, headlen))) {
+			dma_unmap_single(ppdev->dev, dma, headlen,
+					 DMA_TO_DEVICE);
+			return -ERANGE;
+		}
+		sgb->mappings[n] = dma;
+		sgb->sizes[n++] = headlen;
+		frame->head_mapped = true;
+	}
 
-	memset(ppdev->tx_buffs.virt, 0, PACKET_MIN_SIZE);
-	memcpy(ppdev->tx_buffs.virt, skb->data, skb_headlen(skb));
-	sgb->mappings[0] = ppdev->tx_buffs.dma;
-	sgb->sizes[0] = max_t(unsigned int, skb_headlen(skb),
-			      PACKET_MIN_SIZE);
-	/* Frags starts from index 1 */
 	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
-		const skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,9,0)
-		memcpy(ppdev->tx_buffs.virt + i * skb_frag_size(frag),
-		       page_to_virt(skb_frag_page(frag)),
-		       skb_frag_size(frag));
-#else
-		WARN_ONCE("Older kernel, frags are not supported\n"
-#endif
-		sgb->mappings[i + 1] = ppdev->tx_buffs.dma + i *
-				       skb_frag_size(frag);
-		sgb->sizes[i + 1] = skb_frag_size(frag);
+		frag = &skb_shinfo(skb)->frags[i];
+		dma = skb_frag_dma_map(ppdev->dev, frag, 0, skb_frag_size(frag),
+				       DMA_TO_DEVICE);
+		if (dma_mapping_error(ppdev->dev, dma))
+			goto unmap;
+		if (unlikely(!mvppnd_dma_in_win(ppdev, dma,
+						skb_frag_size(frag)))) {
+			dma_unmap_page(ppdev->dev, dma, skb_frag_size(frag),
+				       DMA_TO_DEVICE);
+			goto unmap;
+		}
+		sgb->mappings[n] = dma;
+		sgb->sizes[n++] = skb_frag_size(frag);
+		frame->frags_mapped++;
 	}
 
-	skb_push(skb, ETH_ALEN * 2); /* We are done, return to MAC header */
-	return rc;
+	return 0;
+
+unmap:
+	mvppnd_unmap_tx_frame(ppdev, frame, sgb);
+
+	return -ENOMEM;
 }
 
 /*********** rings related functions *******************/
@@ -1240,46 +1954,431 @@ free_descs:
 	return rc;
 }
 
-static int mvppnd_setup_tx_ring(struct mvppnd_dev *ppdev)
+static void mvppnd_tx_reclaim(struct mvppnd_dev *ppdev,
+			      struct mvppnd_txq *txq, bool force);
+static int mvppnd_setup_streaming_mg_windows(struct mvppnd_dev *ppdev);
+
+static int mvppnd_setup_tx_ring(struct mvppnd_dev *ppdev,
+				struct mvppnd_txq *txq)
 {
 	int rc = 0;
+	int i;
 
-	if (ppdev->tx_queue_num == -1)
-		return -1;
+	txq->frames = kcalloc(TX_RING_SIZE, sizeof(*txq->frames), GFP_KERNEL);
+	if (!txq->frames)
+		return -ENOMEM;
 
-	rc = mvppnd_alloc_ring(ppdev, &ppdev->tx_queue.ring, TX_RING_SIZE);
+	rc = mvppnd_alloc_ring(ppdev, &txq->ring, TX_RING_SIZE);
 	if (rc)
-		return rc;
-
-	ppdev->tx_buffs.virt =
-		mvppnd_alloc_coherent(ppdev, TX_RING_SIZE *
-				      ppdev->max_pkt_sz, &ppdev->tx_buffs.dma);
+		goto free_frames;
+
+	for (i = 0; i < TX_RING_SIZE; i++)
+		txq->ring.descs[i]->cmd_sts = 0;
+	txq->ring.descs_ptr = 0;
+	txq->clean_ptr = 0;
+	txq->frames_inflight = 0;
+	txq->doorbell = false;
+	txq->copy_ptr = 0;
+
+	txq->buffs.virt = mvppnd_alloc_coherent(ppdev, TX_COPY_SLOTS *
+						ppdev->max_pkt_sz,
+						&txq->buffs.dma);
+#ifdef MVPPND_TSO
+	txq->tso_hdrs.virt = mvppnd_alloc_coherent(ppdev, TX_COPY_SLOTS *
+						   TX_TSO_HDR_SZ,
+						   &txq->tso_hdrs.dma);
+#endif
+	txq->dsa.virt = mvppnd_alloc_coherent(ppdev, TX_RING_SIZE * DSA_SIZE,
+					      &txq->dsa.dma);
 
-	mvppnd_write_tx_first_desc(ppdev, ppdev->tx_queue.ring.ring_dma);
+	/* Programmed once, SDMA then follows the ring on its own */
+	mvppnd_write_tx_first_desc(ppdev, txq->queue, txq->ring.ring_dma);
 
 	return 0;
+
+free_frames:
+	kfree(txq->frames);
+	txq->frames = NULL;
+
+	return rc;
 }
 
-static void mvppnd_destroy_tx_ring(struct mvppnd_dev *ppdev)
+static void mvppnd_destroy_tx_ring(struct mvppnd_dev *ppdev,
+				   struct mvppnd_txq *txq)
 {
-	if (ppdev->tx_queue_num == -1)
+	if (!txq->frames)
 		return;
 
-	mvppnd_write_tx_first_desc(ppdev, 0);
+	/* Buffers and ring go away below, SDMA must be off them by then */
+	if (!mvppnd_disable_tx_queue_sync(ppdev, txq->queue))
+		dev_warn(ppdev->dev, "TX queue %d is still enabled\n",
+			 txq->queue);
+	mvppnd_write_tx_first_desc(ppdev, txq->queue, 0);
+
+	/* Queue is disabled, release whatever SDMA did not complete */
+	spin_lock_bh(&txq->lock);
+	mvppnd_tx_reclaim(ppdev, txq, true);
+	spin_unlock_bh(&txq->lock);
 
-	mvppnd_free_ring_dma(ppdev, &ppdev->tx_queue.ring, TX_RING_SIZE);
+	mvppnd_free_ring_dma(ppdev, &txq->ring, TX_RING_SIZE);
+
+	kfree(txq->frames);
+	txq->frames = NULL;
 }
 
-static void mvppnd_destroy_rx_rings(struct mvppnd_dev *ppdev)
+static void mvppnd_destroy_tx_rings(struct mvppnd_dev *ppdev)
 {
 	int i;
 
-	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
-		if (ppdev->rx_queues[i]) {
-			mvppnd_write_rx_first_desc(ppdev, i, 0);
-			mvppnd_free_ring_dma(ppdev, &ppdev->rx_queues[i]->ring,
-					     ppdev->rx_rings_size[i]);
-			kfree(ppdev->rx_queues[i]);
+	for (i = 0; i < NUM_OF_TX_QUEUES; i++)
+		mvppnd_destroy_tx_ring(ppdev, &ppdev->txqs[i]);
+
+	ppdev->tx_dsa.virt = NULL;
+	ppdev->tx_crc.virt = NULL;
+}
+
+/* A ring for each of the netdev TX queues, see mvppnd_setup_tx_queues */
+static int mvppnd_setup_tx_rings(struct mvppnd_dev *ppdev)
+{
+	int rc;
+	int i;
+
+	if (!ppdev->num_txqs)
+		return -1;
+
+	for (i = 0; i < ppdev->num_txqs; i++) {
+		rc = mvppnd_setup_tx_ring(ppdev, &ppdev->txqs[i]);
+		if (rc) {
+			dev_err(ppdev->dev, "Fail to create tx ring %d\n",
+				ppdev->txqs[i].queue);
+			mvppnd_destroy_tx_rings(ppdev);
+			return rc;
+		}
+	}
+
+	/* Filled by mvppnd_build_tx_dsa as flows go up */
+	ppdev->tx_dsa.virt = mvppnd_alloc_coherent(ppdev,
+						   MAX_NETDEVS * DSA_SIZE,
+						   &ppdev->tx_dsa.dma);
+	ppdev->tx_crc.virt = mvppnd_alloc_coherent(ppdev, CRC_SIZE,
+						   &ppdev->tx_crc.dma);
+	memset(ppdev->tx_crc.virt, 0, CRC_SIZE);
+
+	/* skb pages may be anywhere in the 32bit DMA space, else copy them */
+	ppdev->tx_zero_copy = mvppnd_streaming_dma_ok(ppdev) &&
+			      ppdev->mg_win[MG_WIN_STREAMING1_IDX] &&
+			      ppdev->mg_win[MG_WIN_STREAMING2_IDX] &&
+			      !mvppnd_setup_streaming_mg_windows(ppdev);
+
+	return 0;
+}
+
+/*********** page pool (zero-copy RX) *****************/
+/*
+ * Streaming buffers may be anywhere up to mvppnd_streaming_dma_limit.
+ * Without the oATU both windows are used to cover the 32bit DMA space.
+ * On devices using the oATU window the lower window reprograms it to cover
+ * the first 2G, the whole PCI range with bit 31 set, so nothing else can go
+ * at it: the second window is left unused and the coherent block has to be
+ * in the first 2G as well.
+ */
+static int mvppnd_setup_streaming_mg_windows(struct mvppnd_dev *ppdev)
+{
+	if (!mvppnd_streaming_dma_ok(ppdev)) {
+		dev_err(ppdev->dev,
+			"DMA mask exceeds the streaming MG windows\n");
+		return -EOPNOTSUPP;
+	}
+
+	if (!ppdev->mg_win[MG_WIN_STREAMING1_IDX] ||
+	    !ppdev->mg_win[MG_WIN_STREAMING2_IDX]) {
+		dev_err(ppdev->dev, "Streaming MG windows are not set\n");
+		return -EFAULT;
+	}
+
+	if (mvppnd_uses_oatu(ppdev) &&
+	    !mvppnd_dma_in_win(ppdev, ppdev->coherent.buf.dma,
+			       ppdev->coherent.buf.size)) {
+		dev_err(ppdev->dev,
+			"Coherent block is out of the streaming oATU range\n");
+		return -EOPNOTSUPP;
+	}
+
+	mvppnd_setup_mg_window(ppdev, ppdev->mg_win[MG_WIN_STREAMING1_IDX], 0,
+			       (MG_WIN_STREAMING_SIZE - 1) & 0xFFFF0000);
+	if (!mvppnd_uses_oatu(ppdev))
+		mvppnd_setup_mg_window(ppdev,
+				       ppdev->mg_win[MG_WIN_STREAMING2_IDX],
+				       MG_WIN_STREAMING_SIZE,
+				       (MG_WIN_STREAMING_SIZE - 1) &
+				       0xFFFF0000);
+
+	return 0;
+}
+
+#ifdef MVPPND_RX_PAGE_POOL
+static int mvppnd_create_rx_page_pool(struct mvppnd_dev *ppdev, int queue)
+{
+	struct page_pool_params pp_params = {};
+	struct page_pool *pool;
+	int rc;
+
+	pp_params.order = ppdev->rx_page_order;
+	pp_params.flags = PP_FLAG_DMA_MAP | PP_FLAG_DMA_SYNC_DEV;
+	pp_params.pool_size = ppdev->rx_rings_size[queue];
+	pp_params.nid = dev_to_node(ppdev->dev);
+	pp_params.dev = ppdev->dev;
+	pp_params.dma_dir = DMA_FROM_DEVICE;
+	pp_params.offset = RX_PP_HEADROOM;
+	pp_params.max_len = ppdev->rx_buff_sz;
+
+	pool = page_pool_create(&pp_params);
+	if (IS_ERR(pool)) {
+		dev_err(ppdev->dev, "Fail to create page pool for queue %d\n",
+			queue);
+		return PTR_ERR(pool);
+	}
+
+	ppdev->rx_queues[queue]->page_pool = pool;
+
+	/*
+	 * One XDP RX queue for all flows, the netdev is switched to the flow's
+	 * one before running its program
+	 */
+	rc = xdp_rxq_info_reg(&ppdev->rx_queues[queue]->xdp_rxq,
+			      ppdev->sdev.flows[0]->ndev, queue, 0);
+	if (rc)
+		return rc;
+
+	rc = xdp_rxq_info_reg_mem_model(&ppdev->rx_queues[queue]->xdp_rxq,
+					MEM_TYPE_PAGE_POOL, pool);
+	if (rc)
+		dev_err(ppdev->dev, "Fail to register XDP memory model\n");
+
+	return rc;
+}
+
+/* Attach a page pool page to RX descriptor, SDMA owns it from now on */
+static void mvppnd_attach_rx_page(struct mvppnd_dev *ppdev,
+				  struct mvppnd_ring *r, size_t idx,
+				  struct page *page)
+{
+	struct mvppnd_dma_sg_buf *sgb = r->buffs[idx];
+
+	sgb->virt = page_address(page) + RX_PP_HEADROOM;
+	sgb->mappings[0] = page_pool_get_dma_addr(page) + RX_PP_HEADROOM;
+	sgb->sizes[0] = ppdev->rx_buff_sz;
+
+	r->descs[idx]->buf_addr = sgb->mappings[0];
+	RX_DESC_SET_BUFF_SIZE(r->descs[idx]->bc, sgb->sizes[0]);
+	/* Buffer must be set before ownership is passed */
+	wmb();
+	r->descs[idx]->cmd_sts = RX_CMD_BIT_OWN_SDMA | RX_CMD_BIT_EN_INTR;
+}
+
+/* Page pool page for the RX ring, NULL if SDMA can't reach it */
+static struct page *mvppnd_alloc_rx_page(struct mvppnd_dev *ppdev,
+					 struct page_pool *pool)
+{
+	struct page *page = page_pool_dev_alloc_pages(pool);
+
+	if (unlikely(page &&
+		     !mvppnd_dma_in_win(ppdev, page_pool_get_dma_addr(page) +
+					RX_PP_HEADROOM, ppdev->rx_buff_sz))) {
+		page_pool_put_full_page(pool, page, false);
+		return NULL;
+	}
+
+	return page;
+}
+
+static int mvppnd_fill_rx_ring_pages(struct mvppnd_dev *ppdev, int queue)
+{
+	struct mvppnd_queue *q = ppdev->rx_queues[queue];
+	struct page *page;
+	int j;
+
+	for (j = 0; j < ppdev->rx_rings_size[queue]; j++) {
+		page = mvppnd_alloc_rx_page(ppdev, q->page_pool);
+		if (!page)
+			return -ENOMEM;
+
+		mvppnd_attach_rx_page(ppdev, &q->ring, j, page);
+	}
+
+	return 0;
+}
+
+static void mvppnd_free_rx_ring_pages(struct mvppnd_dev *ppdev, int queue)
+{
+	struct mvppnd_queue *q = ppdev->rx_queues[queue];
+	struct mvppnd_dma_sg_buf *sgb;
+	int j;
+
+	if (!q->page_pool)
+		return;
+
+	for (j = 0; q->ring.buffs && (j < ppdev->rx_rings_size[queue]); j++) {
+		sgb = q->ring.buffs[j];
+		if (!sgb || !sgb->virt)
+			continue;
+
+		page_pool_put_full_page(q->page_pool,
+					virt_to_head_page(sgb->virt), false);
+		sgb->virt = NULL;
+	}
+
+	if (xdp_rxq_info_is_reg(&q->xdp_rxq))
+		xdp_rxq_info_unreg(&q->xdp_rxq);
+	page_pool_destroy(q->page_pool);
+	q->page_pool = NULL;
+}
+
+static void mvppnd_recycle_rx_page(struct mvppnd_queue *rxq, struct page *page)
+{
+	page_pool_recycle_direct(rxq->page_pool, page);
+}
+#else
+static int mvppnd_create_rx_page_pool(struct mvppnd_dev *ppdev, int queue)
+{
+	return -EOPNOTSUPP;
+}
+
+static int mvppnd_fill_rx_ring_pages(struct mvppnd_dev *ppdev, int queue)
+{
+	return -EOPNOTSUPP;
+}
+
+static void mvppnd_free_rx_ring_pages(struct mvppnd_dev *ppdev, int queue)
+{
+}
+
+static void mvppnd_recycle_rx_page(struct mvppnd_queue *rxq, struct page *page)
+{
+}
+#endif
+
+/*********** AF_XDP zero-copy *************************/
+#ifdef MVPPND_XSK
+/* UMEM frame for the RX ring, NULL if SDMA can't reach it */
+static struct xdp_buff *mvppnd_xsk_alloc_rx_buff(struct mvppnd_dev *ppdev,
+						 struct mvppnd_queue *rxq,
+						 struct xsk_buff_pool *pool)
+{
+	struct xdp_buff *xdp = xsk_buff_alloc(pool);
+
+	if (unlikely(xdp && !mvppnd_dma_in_win(ppdev,
+					       xsk_buff_xdp_get_dma(xdp),
+					       rxq->xsk_frame_sz))) {
+		xsk_buff_free(xdp);
+		return NULL;
+	}
+
+	return xdp;
+}
+
+/* Attach a UMEM frame to RX descriptor, SDMA owns it from now on */
+static void mvppnd_xsk_attach_rx_buff(struct mvppnd_queue *rxq, size_t idx,
+				      struct xdp_buff *xdp)
+{
+	struct mvppnd_ring *r = &rxq->ring;
+
+	rxq->xsk_buffs[idx] = xdp;
+	r->descs[idx]->buf_addr = xsk_buff_xdp_get_dma(xdp);
+	RX_DESC_SET_BUFF_SIZE(r->descs[idx]->bc, rxq->xsk_frame_sz);
+	/* Buffer must be set before ownership is passed */
+	wmb();
+	r->descs[idx]->cmd_sts = RX_CMD_BIT_OWN_SDMA | RX_CMD_BIT_EN_INTR;
+}
+
+static void mvppnd_xsk_free_rx_ring(struct mvppnd_dev *ppdev, int queue)
+{
+	struct mvppnd_queue *rxq = ppdev->rx_queues[queue];
+	int j;
+
+	if (!rxq->xsk_buffs)
+		return;
+
+	for (j = 0; j < ppdev->rx_rings_size[queue]; j++)
+		if (rxq->xsk_buffs[j])
+			xsk_buff_free(rxq->xsk_buffs[j]);
+
+	kfree(rxq->xsk_buffs);
+	rxq->xsk_buffs = NULL;
+	rxq->xsk_pool = NULL;
+
+	if (xdp_rxq_info_is_reg(&rxq->xdp_rxq))
+		xdp_rxq_info_unreg(&rxq->xdp_rxq);
+}
+
+static int mvppnd_xsk_fill_rx_ring(struct mvppnd_dev *ppdev, int queue,
+				   struct xsk_buff_pool *pool)
+{
+	struct mvppnd_queue *rxq = ppdev->rx_queues[queue];
+	struct xdp_buff *xdp;
+	int j, rc;
+
+	rxq->xsk_buffs = kcalloc(ppdev->rx_rings_size[queue],
+				 sizeof(*rxq->xsk_buffs), GFP_KERNEL);
+	if (!rxq->xsk_buffs)
+		return -ENOMEM;
+
+	/* XSK checks the netdev and queue the frames come from */
+	rc = xdp_rxq_info_reg(&rxq->xdp_rxq, ppdev->xsk_flows[queue]->ndev,
+			      queue, rxq->rx_napi->napi.napi_id);
+	if (!rc)
+		rc = xdp_rxq_info_reg_mem_model(&rxq->xdp_rxq,
+						MEM_TYPE_XSK_BUFF_POOL, NULL);
+	if (rc)
+		goto free_ring;
+
+	xsk_pool_set_rxq_info(pool, &rxq->xdp_rxq);
+
+	/* SDMA buffer size is in multiplications of 8 */
+	rxq->xsk_frame_sz = round_down(min_t(u32,
+					     xsk_pool_get_rx_frame_size(pool),
+					     ppdev->rx_buff_sz), 8);
+
+	for (j = 0; j < ppdev->rx_rings_size[queue]; j++) {
+		xdp = mvppnd_xsk_alloc_rx_buff(ppdev, rxq, pool);
+		if (!xdp) {
+			dev_err(ppdev->dev,
+				"Fail to fill RX queue %d from the UMEM\n",
+				queue);
+			rc = -ENOMEM;
+			goto free_ring;
+		}
+
+		mvppnd_xsk_attach_rx_buff(rxq, j, xdp);
+	}
+
+	rxq->xsk_pool = pool;
+
+	return 0;
+
+free_ring:
+	mvppnd_xsk_free_rx_ring(ppdev, queue);
+
+	return rc;
+}
+#else
+static void mvppnd_xsk_free_rx_ring(struct mvppnd_dev *ppdev, int queue)
+{
+}
+#endif
+
+static void mvppnd_destroy_rx_rings(struct mvppnd_dev *ppdev)
+{
+	int i;
+
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
+		if (ppdev->rx_queues[i]) {
+			mvppnd_write_rx_first_desc(ppdev, i, 0);
+			mvppnd_xsk_free_rx_ring(ppdev, i);
+			mvppnd_free_rx_ring_pages(ppdev, i);
+			mvppnd_free_ring_dma(ppdev, &ppdev->rx_queues[i]->ring,
+					     ppdev->rx_rings_size[i]);
+			kfree(ppdev->rx_queues[i]);
 			ppdev->rx_queues[i] = NULL;
 		}
 	}
@@ -1288,6 +2387,7 @@ static void mvppnd_destroy_rx_rings(struct mvppnd_dev *ppdev)
 static int mvppnd_setup_rx_rings(struct mvppnd_dev *ppdev)
 {
 	struct mvppnd_ring *r;
+	size_t truesize;
 	int i, j, rc = 0;
 
 	if (!ppdev->mg_win[MG_WIN_STREAMING1_IDX]) {
@@ -1295,6 +2395,17 @@ static int mvppnd_setup_rx_rings(struct mvppnd_dev *ppdev)
 		return -EFAULT;
 	}
 
+	if (ppdev->rx_zero_copy) {
+		rc = mvppnd_setup_streaming_mg_windows(ppdev);
+		if (rc)
+			return rc;
+
+		/* build_skb needs room for headroom and skb_shared_info */
+		truesize = SKB_DATA_ALIGN(RX_PP_HEADROOM + ppdev->rx_buff_sz) +
+			   SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+		ppdev->rx_page_order = get_order(truesize);
+	}
+
 	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
 		if (!ppdev->rx_queues[i])
 			continue;
@@ -1306,14 +2417,25 @@ static int mvppnd_setup_rx_rings(struct mvppnd_dev *ppdev)
 
 		r = &ppdev->rx_queues[i]->ring;
 
-		/* Populate ring with skbs */
-		for (j = 0; j < ppdev->rx_rings_size[i]; j++) {
+		if (ppdev->rx_zero_copy) {
+			rc = mvppnd_create_rx_page_pool(ppdev, i);
+			if (rc)
+				goto destroy_rings;
+
+			rc = mvppnd_fill_rx_ring_pages(ppdev, i);
+			if (rc)
+				goto destroy_rings;
+		}
+
+		/* Populate ring with coherent buffers */
+		for (j = 0; !ppdev->rx_zero_copy &&
+		     (j < ppdev->rx_rings_size[i]); j++) {
 			struct mvppnd_dma_sg_buf *sgb = r->buffs[j];
 
 			r->descs[j]->cmd_sts = RX_CMD_BIT_OWN_SDMA |
 					       RX_CMD_BIT_EN_INTR;
 
-			sgb->sizes[0] = ppdev->max_pkt_sz - DSA_SIZE;
+			sgb->sizes[0] = ppdev->rx_buff_sz - DSA_SIZE;
 			sgb->virt = mvppnd_alloc_coherent(ppdev, sgb->sizes[0],
 							  &sgb->mappings[0]);
 
@@ -1345,7 +2467,7 @@ destroy_rings:
 static void mvppnd_destroy_rings(struct mvppnd_dev *ppdev)
 {
 	mvppnd_destroy_rx_rings(ppdev);
-	mvppnd_destroy_tx_ring(ppdev);
+	mvppnd_destroy_tx_rings(ppdev);
 }
 
 /*
@@ -1390,16 +2512,14 @@ static void print_dsa(const char *netdev, const char *dir, u8 *dsa)
 #define print_dsa(netdev, dir, dsa)
 #endif
 
-static struct mvppnd_switch_flow *mvppnd_get_sw_flow(struct mvppnd_dev *ppdev,
-						     u8 *dsa)
+/* Slow path, used only when there is no demux index */
+static struct mvppnd_switch_flow *mvppnd_scan_sw_flow(struct mvppnd_dev *ppdev,
+						      u8 *dsa)
 {
 	struct mvppnd_128bit_var *v, *m, *d = (struct mvppnd_128bit_var *)dsa;
 	u32 flows_cnt = ppdev->sdev.flows_cnt;
-	struct mvppnd_switch_flow *flow;
 	int i;
 
-	flow = ppdev->sdev.flows[0]; /* Default to main netdev */
-
 	for (i = 1; flows_cnt && (i < MAX_NETDEVS); i++) {
 		if (!ppdev->sdev.flows[i])
 			continue;
@@ -1420,1916 +2540,4265 @@ static struct mvppnd_switch_flow *mvppnd_get_sw_flow(struct mvppnd_dev *ppdev,
 		if (v->low != (d->low & m->low))
 			continue;
 
-		flow = ppdev->sdev.flows[i];
-		break;
+		return ppdev->sdev.flows[i];
 	}
 
-	return flow;
+	return NULL;
 }
 
-static u8 mvppnd_get_vlan_info(u8 *dsa, u16 *vlan)
+/* Port number as encoded by the bits of DEFAULT_RX_DSA_MASK */
+static inline u16 mvppnd_dsa_port(const u8 *dsa)
 {
-	u8 istagged = (dsa[0] & 0x20) >> 5;
-	*vlan = 0;
+	return ((dsa[1] & 0xf8) >> 3) | (((dsa[6] & 0x0c) >> 2) << 5) |
+	       (((dsa[9] & 0x30) >> 4) << 7);
+}
 
-	if (istagged) {
-		*vlan = (dsa[2] & 0x0f) << 8;
-		*vlan |= (dsa[3] & 0xff);
+static inline u32 mvppnd_demux_hash(const struct mvppnd_128bit_var *key,
+				    u8 mask_idx)
+{
+	return jhash(key, sizeof(*key), mask_idx) &
+	       ((1 << RX_DEMUX_HASH_BITS) - 1);
+}
+
+static struct mvppnd_switch_flow *
+mvppnd_demux_find(struct mvppnd_rx_demux *demux,
+		  const struct mvppnd_128bit_var *key, u8 mask_idx)
+{
+	struct mvppnd_demux_entry *e;
+
+	hlist_for_each_entry(e, &demux->hash[mvppnd_demux_hash(key, mask_idx)],
+			     node)
+		if ((e->mask_idx == mask_idx) && (e->val.high == key->high) &&
+		    (e->val.low == key->low))
+			return e->flow;
+
+	return NULL;
+}
+
+/*
+ * One table lookup plus one hash lookup per distinct non-default mask. As in
+ * the linear scan the lowest matching flow wins.
+ */
+static struct mvppnd_switch_flow *
+mvppnd_demux_lookup(struct mvppnd_rx_demux *demux, u8 *dsa)
+{
+	struct mvppnd_128bit_var key, *d = (struct mvppnd_128bit_var *)dsa;
+	struct mvppnd_switch_flow *flow, *match;
+	int i;
+
+	flow = demux->ports[mvppnd_dsa_port(dsa)];
+
+	for (i = 0; i < demux->num_masks; i++) {
+		key.high = d->high & demux->masks[i].high;
+		key.low = d->low & demux->masks[i].low;
+		match = mvppnd_demux_find(demux, &key, i);
+		if (match && (!flow || (match->flow_id < flow->flow_id)))
+			flow = match;
 	}
 
-	return istagged;
+	return flow;
 }
 
-static void mvppnd_process_rx_buff(struct mvppnd_dev *ppdev,
-				   unsigned char *buff, u32 bc,
-				   struct list_head *rx_list_ptr)
+static int mvppnd_fill_rx_demux(struct mvppnd_dev *ppdev,
+				struct mvppnd_rx_demux *demux, u32 max_entries)
 {
+	struct mvppnd_128bit_var *v, *m;
 	struct mvppnd_switch_flow *flow;
-	bool redirect_to_tx = false;
-	struct net_device *ndev;
-	struct vlan_ethhdr veth;
-	char *skb_data, dsa[DSA_SIZE]; /* use dsa on stack - faster than dynamic allocation */
-	struct sk_buff *skb;
-	int rx_bytes;
-	u8 istagged;
-	u16 vlan;
-	int rc;
+	struct mvppnd_demux_entry *e;
+	u16 port;
+	int i, j;
 
-	print_frame(ppdev, buff, RX_DESC_GET_BYTE_CNT(bc), true);
+	/* Ascending order so first match is kept on duplicates */
+	for (i = 1; i < MAX_NETDEVS; i++) {
+		flow = ppdev->sdev.flows[i];
+		if (!flow || !flow->up)
+			continue;
 
-	rx_bytes = RX_DESC_GET_BYTE_CNT(bc) - CRC_SIZE;
+		v = (struct mvppnd_128bit_var *)&flow->rx_dsa_val;
+		m = (struct mvppnd_128bit_var *)&flow->rx_dsa_mask;
 
-	/*
-	 * if RX callback hook exists, call it and according to the
-	 * return value decide what needs to be done with the packet:
-	 */
-	if (ppdev->ops && ppdev->ops->process_rx) {
-		rc = ppdev->ops->process_rx(ppdev->sdev.flows[0]->ndev, buff,
-					    &rx_bytes, ppdev->max_pkt_sz);
-		switch (rc) {
-		case NF_DROP:
-			ppdev->sdev.flows[0]->ndev->stats.rx_dropped++;
-			return;
-		case NF_ACCEPT:
-			break;
-		case NF_STOLEN:
-			return;
-		case NF_QUEUE:
-			/*
- 			 * Continue but check again later, do TX instead of
- 			 * calling to netif_receive_skb
- 			 */
-			redirect_to_tx = true;
-			break;
-		default:
-			WARN_ONCE("%s: Got invalid return value from process_rx\n",
-				  DRV_NAME);
-			ppdev->sdev.flows[0]->ndev->stats.rx_dropped++;
-			return;
-		};
-	}
+		/* Value bits outside of the mask can never match */
+		if ((v->high & ~m->high) || (v->low & ~m->low))
+			continue;
 
-	/* Get vlan info from dsa */
-	istagged = mvppnd_get_vlan_info(buff + ETH_ALEN * 2, &vlan);
+		if (!memcmp(flow->rx_dsa_mask, DEFAULT_RX_DSA_MASK, DSA_SIZE)) {
+			port = mvppnd_dsa_port(flow->rx_dsa_val);
+			if (!demux->ports[port])
+				demux->ports[port] = flow;
+			continue;
+		}
 
-	if (istagged) {
-		rx_bytes = RX_DESC_GET_BYTE_CNT(bc) + VLAN_HLEN - CRC_SIZE;
-	} else {
-		rx_bytes = RX_DESC_GET_BYTE_CNT(bc) - CRC_SIZE;
-	}
+		for (j = 0; j < demux->num_masks; j++)
+			if ((demux->masks[j].high == m->high) &&
+			    (demux->masks[j].low == m->low))
+				break;
 
-	flow = mvppnd_get_sw_flow(ppdev, buff + ETH_ALEN * 2);
-	ndev = flow->ndev;
+		if (j == demux->num_masks) {
+			if (j == RX_DEMUX_MAX_MASKS)
+				return -E2BIG;
+			demux->masks[j] = *m;
+			demux->num_masks++;
+		}
 
-	print_dsa(ndev->name, "rx", buff + ETH_ALEN * 2);
-	if ( (rx_bytes < DSA_SIZE) || (rx_bytes > ppdev->max_pkt_sz) ) {
-		WARN_ONCE("Received packet with illegal size %d!!!\n", rx_bytes);
-		return;
-	}
+		if (mvppnd_demux_find(demux, v, j))
+			continue;
 
-	skb = netdev_alloc_skb(ndev, rx_bytes);
+		if (demux->num_entries == max_entries)
+			return -EINVAL;
 
-	if (!skb) {
-		ndev->stats.rx_dropped++;
-		no_skbs++;
-		return;
+		e = &demux->entries[demux->num_entries++];
+		e->flow = flow;
+		e->val = *v;
+		e->mask_idx = j;
+		hlist_add_head(&e->node, &demux->hash[mvppnd_demux_hash(v, j)]);
 	}
-	/* initialize skb closer to allocation when variables are cache hot: */
-	/* Reserved place for DSA */
-	skb_reserve(skb, DSA_SIZE);
-	/* Bit 30 - csum validity */
-	skb->ip_summed = CHECKSUM_NONE;
-	skb->pkt_type = PACKET_HOST;
 
-	/* Save dsa */
-	memcpy(dsa, buff + ETH_ALEN * 2, DSA_SIZE);
+	return 0;
+}
 
-	/* Delete DSA and move DA & SA in place */
-	memmove(buff + DSA_SIZE, buff, ETH_ALEN * 2);
-	buff += DSA_SIZE;
+static void mvppnd_free_rx_demux_rcu(struct rcu_head *rcu)
+{
+	kvfree(container_of(rcu, struct mvppnd_rx_demux, rcu));
+}
 
-	/* Copy packet */
-	if (istagged) {
-		/* memcpy mac and protocol details to veth */
-		memcpy(&veth, buff, ETH_HLEN);
-		veth.h_vlan_encapsulated_proto = veth.h_vlan_proto;
-		veth.h_vlan_proto = htons(ETH_P_8021Q);
-		veth.h_vlan_TCI = htons(vlan);
-		skb_data = skb_put(skb, rx_bytes - DSA_SIZE);
-		/* copy eth hdr with vlan tag */
-		memcpy(skb_data, &veth, VLAN_ETH_HLEN);
-		/* copy rest of packet from buff */
-		memcpy(skb_data + VLAN_ETH_HLEN, buff + ETH_HLEN, rx_bytes -
-				DSA_SIZE - VLAN_ETH_HLEN);
-	} else {
-		skb_data = skb_put_data(skb, buff, rx_bytes - DSA_SIZE);
-	}
+/*
+ * On failure the index is dropped, lookups then fall back to the linear scan
+ * so RX keeps working, just slower.
+ */
+static void mvppnd_rebuild_rx_demux(struct mvppnd_dev *ppdev)
+{
+	struct mvppnd_rx_demux *demux, *old;
+	u32 max_entries;
+	int rc = -ENOMEM;
 
-	/* Copy DSA to the reserved place */
-	memcpy(skb_data - DSA_SIZE, dsa, DSA_SIZE);
+	mutex_lock(&ppdev->sdev.demux_lock);
 
-#ifdef MVPPND_DEBUG_REG
-	/* Print packet for debug */
-	if (ppdev->print_packets_interval &&
-	    (!(ndev->stats.rx_packets % ppdev->print_packets_interval)))
-		print_buff("rx", skb->data, skb->len);
-#endif
+	max_entries = ppdev->sdev.flows_cnt;
+	demux = kvzalloc(struct_size(demux, entries, max_entries), GFP_KERNEL);
+	if (demux)
+		rc = mvppnd_fill_rx_demux(ppdev, demux, max_entries);
 
-	print_skb_hdr(ppdev, "rx", skb);
+	if (rc) {
+		dev_warn(ppdev->dev,
+			 "Fail to build RX demux index (%d), using slow lookup\n",
+			 rc);
+		kvfree(demux);
+		demux = NULL;
+	}
 
-	skb->protocol = eth_type_trans(skb, skb->dev);
+	old = rcu_dereference_protected(ppdev->sdev.rx_demux,
+				lockdep_is_held(&ppdev->sdev.demux_lock));
+	rcu_assign_pointer(ppdev->sdev.rx_demux, demux);
 
-	if (unlikely(redirect_to_tx)) { /* redirect to tx is rarely used */
-		mvppnd_start_xmit(skb, skb->dev);
-		consume_skb(skb);
-		ndev->stats.rx_packets++;
-		ndev->stats.rx_bytes += rx_bytes;
-	} else {
-		list_add_tail(&skb->list, rx_list_ptr); /* add to list - caller will pass all buffer in one go to the kernel - faster */
-		dev_dbg(ppdev->dev, "netif_receive_skb returns %d\n", rc);
-		ndev->stats.rx_packets++;
-		ndev->stats.rx_bytes += rx_bytes;
-		print_frame(ppdev, skb->data, skb->len, true);
-	}
+	mutex_unlock(&ppdev->sdev.demux_lock);
+
+	if (old)
+		call_rcu(&old->rcu, mvppnd_free_rx_demux_rcu);
 }
 
-static int mvppnd_process_rx_queue(struct mvppnd_dev *ppdev, int queue,
-				   int budget,
-				   struct list_head *rx_list_ptr)
+static struct mvppnd_switch_flow *mvppnd_get_sw_flow(struct mvppnd_dev *ppdev,
+						     u8 *dsa)
 {
-	struct mvppnd_ring *r = &ppdev->rx_queues[queue]->ring;
-	struct mvppnd_dma_sg_buf *buff;
-	int done = 0;
-
-	/* called only from NAPI poll context, hence no need for mutex */
-	while (((r->descs[r->descs_ptr]->cmd_sts & RX_CMD_BIT_OWN_SDMA) !=
-	       RX_CMD_BIT_OWN_SDMA) && (done < budget)) {
+	struct mvppnd_switch_flow *flow;
+	struct mvppnd_rx_demux *demux;
 
-		/* TODO: Assumption now that each desc holds only *one* packet
-			 so we expect bits last and first to be set.
-			 Look for if there are other drivers that need to
-			 compose several frags to one skb */
+	rcu_read_lock();
+	demux = rcu_dereference(ppdev->sdev.rx_demux);
+	if (demux)
+		flow = mvppnd_demux_lookup(demux, dsa);
+	else
+		flow = mvppnd_scan_sw_flow(ppdev, dsa);
+	rcu_read_unlock();
 
-		/* TODO: Check resource error bit (28) */
+	return flow ? flow : ppdev->sdev.flows[0]; /* Default to main netdev */
+}
 
-		buff = r->buffs[r->buffs_ptr];
+static u8 mvppnd_get_vlan_info(u8 *dsa, u16 *vlan)
+{
+	u8 istagged = (dsa[0] & 0x20) >> 5;
+	*vlan = 0;
 
-		/* Populate skb details and pass to network stack */
-		mvppnd_process_rx_buff(ppdev, buff->virt,
-				       r->descs[r->descs_ptr]->bc,
-				       rx_list_ptr); /* add buffer to list, caller will pass entire list to kernel - faster */
+	if (istagged) {
+		*vlan = (dsa[2] & 0x0f) << 8;
+		*vlan |= (dsa[3] & 0xff);
+	}
 
-		/* Pass ownership back to SDMA */
-		r->descs[r->descs_ptr]->cmd_sts = RX_CMD_BIT_OWN_SDMA |
-						  RX_CMD_BIT_EN_INTR;
+	return istagged;
+}
 
-		/* Goto next desc */
-		cyclic_inc(&r->descs_ptr, ppdev->rx_rings_size[queue]);
+/*
+ * DSA is removed from the page pool buffer in place by moving the MACs over it
+ * (and making room for the 802.1Q header if needed). As in the copy path, the
+ * DSA is kept just before the MAC header. Returns the new start of the frame.
+ */
+static unsigned char *mvppnd_strip_rx_dsa(unsigned char *buff, u8 istagged,
+					  u16 vlan)
+{
+	char dsa[DSA_SIZE]; /* use dsa on stack - faster than dynamic allocation */
+	struct vlan_ethhdr *veth;
+	unsigned char *data;
 
-		/* Goto next buff */
-		cyclic_inc(&r->buffs_ptr, ppdev->rx_rings_size[queue]);
+	memcpy(dsa, buff + ETH_ALEN * 2, DSA_SIZE);
 
-		done++;
+	if (istagged) {
+		data = buff + DSA_SIZE - VLAN_HLEN;
+		memmove(data, buff, ETH_ALEN * 2);
+		veth = (struct vlan_ethhdr *)data;
+		veth->h_vlan_proto = htons(ETH_P_8021Q);
+		veth->h_vlan_TCI = htons(vlan);
+	} else {
+		data = buff + DSA_SIZE;
+		memmove(data, buff, ETH_ALEN * 2);
 	}
 
-	/* return the number of processed frames */
-	return done;
+	/* Headroom is large enough to hold the DSA in both cases */
+	memcpy(data - DSA_SIZE, dsa, DSA_SIZE);
+
+	return data;
 }
 
-int mvppnd_poll(struct napi_struct *napi, int budget)
+#ifdef MVPPND_RX_PAGE_POOL
+/* Build the skb around the page pool buffer, data is the MAC header */
+static struct sk_buff *mvppnd_build_rx_skb(struct mvppnd_dev *ppdev,
+					   unsigned char *data, int len)
 {
-	struct mvppnd_dev *ppdev = container_of(napi, struct mvppnd_dev, napi);
-	int done_queue, done_total = 0, queue_budget;
-	unsigned num_rx_q_proc = 0, num_rx_q_nonempty = 0;
-	struct list_head rx_list;
-	size_t queue_idx = 0;
+	struct sk_buff *skb;
+	void *page_va;
 
-	while (!ppdev->rx_queues[queue_idx]) { /* skip unused queues */
-		cyclic_inc(&queue_idx, NUM_OF_RX_QUEUES);
-	}
-	INIT_LIST_HEAD(&rx_list); /* list containing all received buffers for passing to kernel in one go - faster */
+	page_va = page_address(virt_to_head_page(data));
+	skb = napi_build_skb(page_va, PAGE_SIZE << ppdev->rx_page_order);
+	if (unlikely(!skb))
+		return NULL;
 
-#ifdef DBG_BUDGET
-	last_budget_pkts = budget;
-	if (budget > max_budget_pkts)
-		max_budget_pkts = budget; /* for debug telemetries only */
-#endif
+	skb_reserve(skb, data - (unsigned char *)page_va);
+	skb_put(skb, len);
+	skb_mark_for_recycle(skb);
 
-	/* dev_dbg(&ppdev->pdev->dev, "budget %d\n", budget); */
-#ifdef DBG_DELAY
-	pr_err("mvppnd_poll - NAPI poll\n");
+	return skb;
+}
+#else
+static struct sk_buff *mvppnd_build_rx_skb(struct mvppnd_dev *ppdev,
+					   unsigned char *data, int len)
+{
+	return NULL;
+}
 #endif
-	mvppnd_inc_stat(ppdev, STATS_NAPI_POLL_CALLS, 1);
-	/*
-	 * For now just give each queue 1/8 of the NAPI budget,
-	 * but no less than one buffer.
-	 * In the future we will create a sysfs interface which
-	 * will allow the user to specify the exact weight to
-	 * give each queue, which will determine how many buffer
-	 * can be read in one go from the queue:
-	 */
-	queue_budget = budget >> 3;
-	if (!queue_budget)
-		queue_budget = 1;
-
-	do {
-		done_queue = mvppnd_process_rx_queue(ppdev, queue_idx,
-						     queue_budget,
-						     &rx_list);
-		if (done_queue > 0)
-			num_rx_q_nonempty++; /* record how many reads from queues yielded at least one buffer */
-		num_rx_q_proc++; /* and how many reads were done at all */
-
-		mvppnd_inc_stat(ppdev,
-				STATS_RX_Q0_PACKETS + queue_idx,
-				done_queue);
-
-		done_total += done_queue;
-
-		cyclic_inc(&queue_idx, NUM_OF_RX_QUEUES); /* move to next queue */
-		while (!ppdev->rx_queues[queue_idx]) { /* skip unused queues */
-			cyclic_inc(&queue_idx, NUM_OF_RX_QUEUES);
-		}
-		/*
-		 * if we cycled through all of the queues
-		 * and at least one queue yielded buffers,
-		 * then do another round, as due to the weights
-		 * used (fixed or in the future configurable)
-		 * there could be still more buffers to be received.
-		 * only once we exhausted all queues or our NAPI
-		 * budget should we bail out:
-		 */
-		if ( (!queue_idx) && (num_rx_q_nonempty) ) {
-			num_rx_q_nonempty = 0;
-			num_rx_q_proc = 0;
-		}
 
-	} while ((done_total < budget) && /* look for packets as long as budget was not exhausted */
-		 (num_rx_q_proc < NUM_OF_RX_QUEUES) ); /* and not all RX queues were exhausted */
-
-	/* dev_dbg(&ppdev->pdev->dev, "done %d\n", done_total); */
+/* Outcome of the XDP program from the driver's point of view */
+enum mvppnd_xdp_res {
+	MVPPND_XDP_PASS, /* Continue to the network stack */
+	MVPPND_XDP_DROP, /* Buffers are to be recycled by the caller */
+	MVPPND_XDP_TAKEN, /* Buffers were handed over */
+};
 
-	if (done_total < budget) { /* No more packets */
-		dev_dbg(&ppdev->pdev.pdev->dev, "re-enable interrupts\n");
-		napi_complete(napi);
-		mvppnd_en_rx_queues_intr(ppdev, 1);
+#ifdef MVPPND_XDP
+/*
+ * Run the flow's XDP program on a frame of a single page pool buffer. The
+ * program sees the frame without the DSA which is given as the 16 bytes of
+ * metadata. On XDP_PASS, data, len and metalen describe the frame to build
+ * the skb around.
+ */
+static enum mvppnd_xdp_res mvppnd_run_xdp(struct mvppnd_dev *ppdev,
+					  struct mvppnd_queue *rxq,
+					  struct net_device *ndev,
+					  struct bpf_prog *prog,
+					  unsigned char **data, int *len,
+					  int *metalen)
+{
+	void *page_va = page_address(virt_to_head_page(*data));
+	struct xdp_buff xdp;
+	struct sk_buff *skb;
+	u32 act;
+
+	/* The RX queue is shared by all the flows */
+	rxq->xdp_rxq.dev = ndev;
+
+	xdp_init_buff(&xdp, PAGE_SIZE << ppdev->rx_page_order, &rxq->xdp_rxq);
+	xdp_prepare_buff(&xdp, page_va, *data - (unsigned char *)page_va,
+			 *len, true);
+	xdp.data_meta = xdp.data - DSA_SIZE;
+
+	act = bpf_prog_run_xdp(prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+		*data = xdp.data;
+		*len = xdp.data_end - xdp.data;
+		*metalen = xdp.data - xdp.data_meta;
+		return MVPPND_XDP_PASS;
+	case XDP_TX:
 		/*
-		 * Read Receive_SDMA_Interrupt_Cause1 to clear the register
+		 * The skb owns the page from here. A copied frame releases it
+		 * right away, a zero-copy one is held by the TX ring and
+		 * mvppnd_tx_reclaim unmaps it before freeing the skb, which is
+		 * when the page goes back to the pool.
 		 */
-		mvppnd_read_reg(ppdev, REG_ADDR_RX_CAUSE_1);
-	} else {
-		mvppnd_inc_stat(ppdev, STATS_NAPI_BURN_BUDGET, 1);
-	}
-
-	mvppnd_inc_stat(ppdev, STATS_RX_PACKETS, done_total);
-	/*
-	 * Read Receive_SDMA_Interrupt_Cause1 to clear the register
-	 */
-	mvppnd_read_reg(ppdev, REG_ADDR_RX_CAUSE_1);
-
-	/* dev_dbg(&ppdev->pdev->dev, "done napi poll\n"); */
-#ifdef DBG_DELAY
-	pr_err("mvppnd_poll - NAPI poll - end\n");
+		skb = mvppnd_build_rx_skb(ppdev, xdp.data,
+					  xdp.data_end - xdp.data);
+		if (unlikely(!skb))
+			goto aborted;
+		skb->dev = ndev;
+		mvppnd_xmit_skb(skb, smp_processor_id(), true);
+		rxq->rx_napi->tx_doorbell = true;
+		mvppnd_inc_stat(ppdev, STATS_RX_XDP_TX, 1);
+		return MVPPND_XDP_TAKEN;
+	case XDP_REDIRECT:
+		if (unlikely(xdp_do_redirect(ndev, &xdp, prog)))
+			goto aborted;
+		rxq->rx_napi->xdp_redirect = true;
+		mvppnd_inc_stat(ppdev, STATS_RX_XDP_REDIRECT, 1);
+		return MVPPND_XDP_TAKEN;
+	default:
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,17,0)
+		bpf_warn_invalid_xdp_action(ndev, prog, act);
+#else
+		bpf_warn_invalid_xdp_action(act);
 #endif
+		fallthrough;
+	case XDP_ABORTED:
+aborted:
+		trace_xdp_exception(ndev, prog, act);
+		mvppnd_inc_stat(ppdev, STATS_RX_XDP_ABORTED, 1);
+		return MVPPND_XDP_DROP;
+	case XDP_DROP:
+		mvppnd_inc_stat(ppdev, STATS_RX_XDP_DROP, 1);
+		return MVPPND_XDP_DROP;
+	}
+}
 
-	/*
-	 * process skbs in a list. This is much more
-	 * cache efficient as Linux kernel has a lot
-	 * of function called, and this allows only
-	 * the Linux kernel function to stay hot in
-	 * the CPU cache, imrpvoing performance.
-	 */
-	netif_receive_skb_list(&rx_list);
-
-#ifdef DBG_BUDGET
-	last_poll_pkts = done_total;
-	if (done_total > max_poll_pkts)
-		max_poll_pkts = done_total; /* debug telemetries */
-#endif
+static void mvppnd_xdp_flush(struct mvppnd_napi *rx_napi)
+{
+	if (!rx_napi->xdp_redirect)
+		return;
 
-	return done_total;
+	xdp_do_flush();
+	rx_napi->xdp_redirect = false;
+}
+#else
+static enum mvppnd_xdp_res mvppnd_run_xdp(struct mvppnd_dev *ppdev,
+					  struct mvppnd_queue *rxq,
+					  struct net_device *ndev,
+					  struct bpf_prog *prog,
+					  unsigned char **data, int *len,
+					  int *metalen)
+{
+	return MVPPND_XDP_PASS;
 }
 
-/*********** sysfs *************************************/
+static void mvppnd_xdp_flush(struct mvppnd_napi *rx_napi)
+{
+}
+#endif
 
-static void mvppnd_print_ring(struct mvppnd_dev *ppdev,
-			      struct mvppnd_ring *ring, size_t ring_size,
-			      size_t curr_ptr)
+/* Copy the frame to a new skb, DSA is removed and kept before MAC header */
+static struct sk_buff *mvppnd_copy_rx_skb(struct mvppnd_dev *ppdev,
+					  struct net_device *ndev,
+					  unsigned char *buff, int rx_bytes,
+					  u8 istagged, u16 vlan)
 {
-	u32 dma;
-	int i, j;
+	char *skb_data, dsa[DSA_SIZE]; /* use dsa on stack - faster than dynamic allocation */
+	struct vlan_ethhdr veth;
+	struct sk_buff *skb;
 
-	for (j = curr_ptr; j < curr_ptr + 3; j++) {
-		i = cyclic_idx(j, ring_size);
-		if (i == 0)
-			dma = ring->ring_dma;
-		else
-			dma = ring->descs[i - 1]->next_desc_ptr;
+	skb = netdev_alloc_skb(ndev, rx_bytes);
+	if (!skb)
+		return NULL;
 
-		dev_dbg(ppdev->dev,
-			"\t[%d, 0x%x]: 0x%x, 0x%x, 0x%x, 0x%x\n",
-			i, dma, ring->descs[i]->cmd_sts,
-			__builtin_bswap32(ring->descs[i]->bc),
-			ring->descs[i]->buf_addr,
-			ring->descs[i]->next_desc_ptr);
-	}
-}
+	/* Reserved place for DSA */
+	skb_reserve(skb, DSA_SIZE);
 
-static ssize_t mvppnd_show_rx_queues(struct kobject *kobj,
-				     struct kobj_attribute *attr, char *buf)
-{
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_rx_queues);
-	int i;
+	/* Save dsa */
+	memcpy(dsa, buff + ETH_ALEN * 2, DSA_SIZE);
 
-	strcpy(buf, "");
+	/* Delete DSA and move DA & SA in place */
+	memmove(buff + DSA_SIZE, buff, ETH_ALEN * 2);
+	buff += DSA_SIZE;
 
-	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
-		snprintf(buf, PAGE_SIZE, "%s[%c%d] 0x%x, %ld/%ld\n", buf,
-			 ppdev->rx_queues[i] ? '*' : ' ', i,
-			 mvppnd_read_rx_first_desc(ppdev, i),
-			 ppdev->rx_queues[i] ?
-			 ppdev->rx_queues[i]->ring.descs_ptr : -1,
-			 ppdev->rx_queues[i] ?  ppdev->rx_rings_size[i] : -1);
-		if (ppdev->rx_queues[i] && ppdev->rx_queues[i]->ring.descs)
-			mvppnd_print_ring(ppdev, &ppdev->rx_queues[i]->ring,
-					    ppdev->rx_rings_size[i],
-					    ppdev->rx_queues[i]->ring.
-					    descs_ptr);
+	/* Copy packet */
+	if (istagged) {
+		/* memcpy mac and protocol details to veth */
+		memcpy(&veth, buff, ETH_HLEN);
+		veth.h_vlan_encapsulated_proto = veth.h_vlan_proto;
+		veth.h_vlan_proto = htons(ETH_P_8021Q);
+		veth.h_vlan_TCI = htons(vlan);
+		skb_data = skb_put(skb, rx_bytes - DSA_SIZE);
+		/* copy eth hdr with vlan tag */
+		memcpy(skb_data, &veth, VLAN_ETH_HLEN);
+		/* copy rest of packet from buff */
+		memcpy(skb_data + VLAN_ETH_HLEN, buff + ETH_HLEN, rx_bytes -
+				DSA_SIZE - VLAN_ETH_HLEN);
+	} else {
+		skb_data = skb_put_data(skb, buff, rx_bytes - DSA_SIZE);
 	}
 
-	return strlen(buf);
+	/* Copy DSA to the reserved place */
+	memcpy(skb_data - DSA_SIZE, dsa, DSA_SIZE);
+
+	return skb;
 }
 
-static void mvppnd_alloc_rx_queues(struct mvppnd_dev *ppdev)
+/*
+ * Attach the buffers which follow the head of a multi-descriptor frame as skb
+ * frags, len is what is left of the frame without the CRC. Page pool pages are
+ * attached as is, coherent buffers are copied.
+ */
+static int mvppnd_add_rx_frags(struct mvppnd_dev *ppdev,
+			       struct mvppnd_queue *rxq, struct sk_buff *skb,
+			       int nfrags, int len)
 {
-	int i;
+	size_t ring_size = ppdev->rx_rings_size[rxq->queue];
+	struct mvppnd_ring *r = &rxq->ring;
+	struct mvppnd_dma_sg_buf *buff;
+	struct page *page;
+	int i, frag_len;
+	void *data;
+
+	for (i = 1; i <= nfrags; i++) {
+		buff = r->buffs[cyclic_idx(r->buffs_ptr + i, ring_size)];
+		frag_len = min_t(int, len, buff->sizes[0]);
+		len -= frag_len;
+
+		if (rxq->page_pool) {
+			page = virt_to_head_page(buff->virt);
+			/* Buffer holding only CRC */
+			if (!frag_len) {
+				mvppnd_recycle_rx_page(rxq, page);
+				continue;
+			}
+			data = page_address(page);
+			skb_add_rx_frag(skb, skb_shinfo(skb)->nr_frags, page,
+					buff->virt - (unsigned char *)data,
+					frag_len,
+					PAGE_SIZE << ppdev->rx_page_order);
+			continue;
+		}
 
-	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
-		if (!test_bit(i, (unsigned long *)&ppdev->rx_queues_mask))
+		if (!frag_len)
 			continue;
-		ppdev->rx_queues[i] = kmalloc(sizeof(*ppdev->rx_queues[i]),
-				              GFP_KERNEL);
-	}
-}
 
-static void mvppnd_free_rx_queues(struct mvppnd_dev *ppdev)
-{
-	int i;
+		data = napi_alloc_frag(frag_len);
+		if (!data)
+			return -ENOMEM;
 
-	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
-		kfree(ppdev->rx_queues[i]);
-		ppdev->rx_queues[i] = NULL;
+		memcpy(data, buff->virt, frag_len);
+		page = virt_to_head_page(data);
+		skb_add_rx_frag(skb, skb_shinfo(skb)->nr_frags, page,
+				data - page_address(page), frag_len,
+				SKB_DATA_ALIGN(frag_len));
 	}
+
+	return 0;
 }
 
-static ssize_t mvppnd_store_rx_queues(struct kobject *kobj,
-				      struct kobj_attribute *attr,
-				      const char *buf, size_t count)
+/* Unfragmented TCP/UDP over IPv4/IPv6, skb->data at the network header */
+static bool mvppnd_rx_has_l4_csum(struct sk_buff *skb)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_rx_queues);
-	unsigned long queues_bitmap;
-	int rc;
-
-	if ((ppdev->pdev.pdev) && (unlikely(ppdev->pdev.atu_win == -1)) &&
-	    (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2)) {
-		dev_err(&ppdev->pdev.pdev->dev,
-			"Required atu_win configuration is missing\n");
-		return -ENOSYS;
+	const struct ipv6hdr *ip6h;
+	const struct iphdr *iph;
+	struct ipv6hdr _ip6h;
+	struct iphdr _iph;
+	u8 proto;
+
+	switch (skb->protocol) {
+	case htons(ETH_P_IP):
+		iph = skb_header_pointer(skb, 0, sizeof(_iph), &_iph);
+		if (!iph || ip_is_fragment(iph))
+			return false;
+		proto = iph->protocol;
+		break;
+	case htons(ETH_P_IPV6):
+		/* Fragments and extension headers show up as nexthdr */
+		ip6h = skb_header_pointer(skb, 0, sizeof(_ip6h), &_ip6h);
+		if (!ip6h)
+			return false;
+		proto = ip6h->nexthdr;
+		break;
+	default:
+		return false;
 	}
 
-	rc = sscanf(buf, "0x%lx", &queues_bitmap);
-	if (rc != 1) {
-		dev_err(ppdev->dev,
-			"Invalid input, expecting 0xlx\n");
-		return -EINVAL;
-	}
-
-	/* Save for interrupt masking */
-	ppdev->rx_queues_mask = queues_bitmap;
-
-	return count;
+	return (proto == IPPROTO_TCP) || (proto == IPPROTO_UDP);
 }
 
-static ssize_t mvppnd_show_tx_queue(struct kobject *kobj,
-				    struct kobj_attribute *attr, char *buf)
+/*
+ * nfrags is the number of descriptors following the head buffer which holds
+ * the rest of the frame. Returns true if the buffers were taken, i.e. the page
+ * pool pages are not to be recycled by the caller.
+ */
+static bool mvppnd_process_rx_buff(struct mvppnd_dev *ppdev,
+				   struct mvppnd_queue *rxq,
+				   unsigned char *buff, u32 bc, int nfrags,
+				   struct list_head *rx_list_ptr)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_tx_queue);
-	int i;
+	struct mvppnd_switch_flow *flow;
+	int rx_bytes, head_bytes, len;
+	enum mvppnd_xdp_res xdp_res;
+	bool redirect_to_tx = false;
+	struct bpf_prog *xdp_prog;
+	struct net_device *ndev;
+	unsigned char *data;
+	bool vlan_hwaccel;
+	gro_result_t gro_rc;
+	struct sk_buff *skb;
+	int metalen = 0;
+	u8 istagged;
+	u16 vlan;
+	int rc;
 
-	for (i = 0; i < NUM_OF_TX_QUEUES; i++) {
-		snprintf(buf, PAGE_SIZE, "%s[%c%d] %d, 0x%x\n", buf,
-			 (i == ppdev->tx_queue_num) ? '*' : ' ', i,
-			 mvppnd_queue_enabled(ppdev, REG_ADDR_TX_QUEUE_CMD, i) ?
-			 1 : 0, mvppnd_read_tx_first_desc(ppdev, i));
+	print_frame(ppdev, buff, RX_DESC_GET_BYTE_CNT(bc), true);
+
+	rx_bytes = RX_DESC_GET_BYTE_CNT(bc) - CRC_SIZE;
+
+	/*
+	 * if RX callback hook exists, call it and according to the
+	 * return value decide what needs to be done with the packet.
+	 * The hook works on a linear buffer so frames spanning several
+	 * descriptors are not passed to it:
+	 */
+	if (!nfrags && ppdev->ops && ppdev->ops->process_rx) {
+		rc = ppdev->ops->process_rx(ppdev->sdev.flows[0]->ndev, buff,
+					    &rx_bytes, ppdev->max_pkt_sz);
+		switch (rc) {
+		case NF_DROP:
+			mvppnd_inc_flow_stat(ppdev->sdev.flows[0]->ndev,
+					     FLOW_STATS_RX_DROPPED, 1);
+			return false;
+		case NF_ACCEPT:
+			break;
+		case NF_STOLEN:
+			return false;
+		case NF_QUEUE:
+			/*
+ 			 * Continue but check again later, do TX instead of
+ 			 * calling to netif_receive_skb
+ 			 */
+			redirect_to_tx = true;
+			break;
+		default:
+			WARN_ONCE("%s: Got invalid return value from process_rx\n",
+				  DRV_NAME);
+			mvppnd_inc_flow_stat(ppdev->sdev.flows[0]->ndev,
+					     FLOW_STATS_RX_DROPPED, 1);
+			return false;
+		};
 	}
 
-	if (ppdev->tx_queue.ring.ring_dma) /* Ring is initialized? */
-		mvppnd_print_ring(ppdev, &ppdev->tx_queue.ring, TX_RING_SIZE,
-				  0);
+	/* Get vlan info from dsa */
+	istagged = mvppnd_get_vlan_info(buff + ETH_ALEN * 2, &vlan);
 
-	return strlen(buf);
-}
+	flow = mvppnd_get_sw_flow(ppdev, buff + ETH_ALEN * 2);
+	ndev = flow->ndev;
 
-static ssize_t mvppnd_store_tx_queue(struct kobject *kobj,
-				     struct kobj_attribute *attr,
-				     const char *buf, size_t count)
-{
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_tx_queue);
-	if ((sscanf(buf, "%d", &ppdev->tx_queue_num) != 1) ||
-	    (ppdev->tx_queue_num < -1) ||
-	    (ppdev->tx_queue_num >= NUM_OF_TX_QUEUES)) {
-		dev_err(ppdev->dev,
-			"Invalid queue number %d\n", ppdev->tx_queue_num);
-		ppdev->tx_queue_num = -1;
-		return -EINVAL;
+	/*
+	 * With VLAN RX offload the tag goes to skb metadata and the frame is
+	 * taken as is, otherwise the 802.1Q header is rebuilt in the frame
+	 */
+	vlan_hwaccel = istagged && (ndev->features & NETIF_F_HW_VLAN_CTAG_RX);
+	if (vlan_hwaccel)
+		istagged = 0;
+
+	if (istagged) {
+		rx_bytes = RX_DESC_GET_BYTE_CNT(bc) + VLAN_HLEN - CRC_SIZE;
+	} else {
+		rx_bytes = RX_DESC_GET_BYTE_CNT(bc) - CRC_SIZE;
 	}
 
-	/* Verify that the requested queue is not used by Packet Generator */
-	if (mvppnd_read_reg(ppdev, REG_ADDR_PG_CFG_QUEUE +
-			    REG_ADDR_PG_CFG_QUEUE_OFFSET_FORMULA *
-			    ppdev->tx_queue_num)) {
-		dev_err(ppdev->dev,
-			"Queue %d is used by Packet Generator\n",
-			ppdev->tx_queue_num);
-		ppdev->tx_queue_num = -1;
-		return -EINVAL;
+	print_dsa(ndev->name, "rx", buff + ETH_ALEN * 2);
+	if ( (rx_bytes < DSA_SIZE) || (rx_bytes > ppdev->max_pkt_sz) ) {
+		WARN_ONCE("Received packet with illegal size %d!!!\n", rx_bytes);
+		return false;
 	}
 
-	return count;
-}
+	/* Only the head buffer goes to the linear part of the skb */
+	head_bytes = rx_bytes;
+	if (nfrags) {
+		head_bytes = rxq->ring.buffs[rxq->ring.buffs_ptr]->sizes[0];
+		if (istagged)
+			head_bytes += VLAN_HLEN;
+		head_bytes = min(head_bytes, rx_bytes);
+	}
 
-static ssize_t mvppnd_show_atu_win(struct kobject *kobj,
-				   struct kobj_attribute *attr, char *buf)
-{
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_atu_win);
-	u32 addr;
-	int i;
+	if (rxq->page_pool) {
+		data = mvppnd_strip_rx_dsa(buff, istagged, vlan);
+		len = head_bytes - DSA_SIZE;
 
-	snprintf(buf, PAGE_SIZE, "%s%-8s\t%-8s\t%-8s\t%-8s\t%-8s\t%-8s\t%-8s\n",
-		 "                   ", "ctrl1", "ctrl2", "low-base",
-		 "upper-base", "limit", "low-target", "upper-target");
+		/* XDP works on single buffer frames only */
+		xdp_prog = READ_ONCE(flow->xdp_prog);
+		if (xdp_prog && nfrags) {
+			mvppnd_inc_flow_stat(ndev, FLOW_STATS_RX_DROPPED, 1);
+			return false;
+		}
 
-	if (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2) {
-		for (i = 0; i < NUM_OF_ATU_WINDOWS; i++) {
-			addr = ATU_OFFS + i * 0x0200;
-			snprintf(buf, PAGE_SIZE,
-				"%s[%c%d] (0x%x) out: 0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\n",
-				buf, (i == ppdev->pdev.atu_win ? '*' : ' '), i, addr,
-				ioread32(ppdev->pdev.bar0 + addr + 0x0000),
-				ioread32(ppdev->pdev.bar0 + addr + 0x0004),
-				ioread32(ppdev->pdev.bar0 + addr + 0x0008),
-				ioread32(ppdev->pdev.bar0 + addr + 0x000c),
-				ioread32(ppdev->pdev.bar0 + addr + 0x0010),
-				ioread32(ppdev->pdev.bar0 + addr + 0x0014),
-				ioread32(ppdev->pdev.bar0 + addr + 0x0018));
-			addr += 0x0100; /* Now inbound */
-			snprintf(buf, PAGE_SIZE,
-				"%s[%c%d] (0x%x) in : 0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\n",
-				buf, (i == ppdev->pdev.atu_win ? '*' : ' '), i, addr,
-				ioread32(ppdev->pdev.bar0 + addr + 0x0000),
-				ioread32(ppdev->pdev.bar0 + addr + 0x0004),
-				ioread32(ppdev->pdev.bar0 + addr + 0x0008),
-				ioread32(ppdev->pdev.bar0 + addr + 0x000c),
-				ioread32(ppdev->pdev.bar0 + addr + 0x0010),
-				ioread32(ppdev->pdev.bar0 + addr + 0x0014),
-				ioread32(ppdev->pdev.bar0 + addr + 0x0018));
+		if (xdp_prog) {
+			xdp_res = mvppnd_run_xdp(ppdev, rxq, ndev, xdp_prog,
+						 &data, &len, &metalen);
+			if (xdp_res != MVPPND_XDP_PASS) {
+				rxq->rx_napi->rx_bytes += rx_bytes;
+				mvppnd_count_flow_rx(ndev, 1, rx_bytes);
+				return xdp_res == MVPPND_XDP_TAKEN;
+			}
 		}
+
+		skb = mvppnd_build_rx_skb(ppdev, data, len);
+		if (skb && metalen)
+			skb_metadata_set(skb, metalen);
+	} else {
+		skb = mvppnd_copy_rx_skb(ppdev, ndev, buff, head_bytes,
+					 istagged, vlan);
+	}
+	if (!skb) {
+		mvppnd_inc_flow_stat(ndev, FLOW_STATS_RX_DROPPED, 1);
+		mvppnd_inc_stat(ppdev, STATS_RX_NO_BUFFS, 1);
+		return false;
 	}
 
-	return strlen(buf);
-}
+	if (nfrags && mvppnd_add_rx_frags(ppdev, rxq, skb, nfrags,
+					  rx_bytes - head_bytes)) {
+		/* Frags attached so far go with the skb */
+		kfree_skb(skb);
+		mvppnd_inc_flow_stat(ndev, FLOW_STATS_RX_DROPPED, 1);
+		mvppnd_inc_stat(ppdev, STATS_RX_NO_BUFFS, 1);
+		return true;
+	}
 
-static ssize_t mvppnd_store_atu_win(struct kobject *kobj,
-				    struct kobj_attribute *attr,
-				    const char *buf, size_t count)
-{
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_atu_win);
-	int rc;
+	if (vlan_hwaccel)
+		__vlan_hwaccel_put_tag(skb, htons(ETH_P_8021Q), vlan);
 
-	rc = sscanf(buf, "%d", &ppdev->pdev.atu_win);
-	if (rc != 1) {
-		dev_err(ppdev->dev, "Invalid input\n");
-		ppdev->pdev.atu_win = -1;
-		return -EINVAL;
-	}
+	skb->pkt_type = PACKET_HOST;
 
-	rc = mvppnd_setup_iatu_window(ppdev, ppdev->pdev.mg_cluster);
-	if (rc)
-		return rc;
+#ifdef MVPPND_DEBUG_REG
+	/* Print packet for debug */
+	if (ppdev->print_packets_interval &&
+	    (!(this_cpu_ptr(flow->stats)->stats[FLOW_STATS_RX_PACKETS] %
+	       ppdev->print_packets_interval)))
+		print_buff("rx", skb->data, skb->len);
+#endif
 
-	debug_print_some_registers(ppdev);
+	print_skb_hdr(ppdev, "rx", skb);
 
-	return count;
-}
+	skb->protocol = eth_type_trans(skb, ndev);
 
-static int mvppnd_is_our_win(struct mvppnd_dev *ppdev, u8 win)
-{
-	int i;
+	/*
+	 * Csum validity bit, trusted only when RX checksum offload is turned
+	 * on (ethtool -K rx on) for devices known to set it. Frames without a
+	 * TCP/UDP checksum never have it set, they are not counted as bad.
+	 */
+	if (!(ndev->features & NETIF_F_RXCSUM)) {
+		skb->ip_summed = CHECKSUM_NONE;
+	} else if (bc & RX_DESC_BC_BIT_CSUM) {
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+	} else {
+		skb->ip_summed = CHECKSUM_NONE;
+		if (mvppnd_rx_has_l4_csum(skb))
+			mvppnd_inc_stat(ppdev,
+					STATS_RX_Q0_CSUM_BAD + rxq->queue, 1);
+	}
 
-	for (i = 0; i < sizeof(ppdev->mg_win); i++)
-		if (win == ppdev->mg_win[i])
-			return true;
+	/* Lets sockets with SO_BUSY_POLL find the NAPI context to spin on */
+	skb_mark_napi_id(skb, &rxq->rx_napi->napi);
 
-	return false;
+	rxq->rx_napi->rx_bytes += rx_bytes;
+
+	if (unlikely(redirect_to_tx)) { /* redirect to tx is rarely used */
+		mvppnd_xmit_skb(skb, smp_processor_id(), true);
+		rxq->rx_napi->tx_doorbell = true;
+		mvppnd_count_flow_rx(ndev, 1, rx_bytes);
+	} else if (ndev->features & NETIF_F_GRO) {
+		/* GRO is per netdev, can be toggled with ethtool -K */
+		rxq->rx_napi->gro_pkts++;
+		gro_rc = napi_gro_receive(&rxq->rx_napi->napi, skb);
+		if ((gro_rc == GRO_MERGED) || (gro_rc == GRO_MERGED_FREE))
+			mvppnd_inc_stat(ppdev, STATS_RX_GRO_MERGED, 1);
+		mvppnd_inc_stat(ppdev, STATS_RX_GRO_PACKETS, 1);
+		mvppnd_count_flow_rx(ndev, 1, rx_bytes);
+	} else {
+		list_add_tail(&skb->list, rx_list_ptr); /* add to list - caller will pass all buffer in one go to the kernel - faster */
+		dev_dbg(ppdev->dev, "netif_receive_skb returns %d\n", rc);
+		mvppnd_count_flow_rx(ndev, 1, rx_bytes);
+		print_frame(ppdev, skb->data, skb->len, true);
+	}
+
+	return true;
 }
 
-static ssize_t mvppnd_show_mg_win(struct kobject *kobj,
-				  struct kobj_attribute *attr, char *buf)
+/*
+ * Number of descriptors holding the frame at the head of the ring, zero if
+ * SDMA did not finish writing it yet.
+ * As in CPSS, byte count of the first descriptor is the frame length and all
+ * buffers but the last are full.
+ */
+static int mvppnd_rx_frame_descs(struct mvppnd_dev *ppdev,
+				 struct mvppnd_queue *rxq)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_mg_win);
-	int i;
-
-	for (i = 0; i < NUM_OF_MG_WINDOWS; i++) {
-		snprintf(buf, PAGE_SIZE,
-			 "%s[%c%d] 0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\n", buf,
-			 mvppnd_is_our_win(ppdev, i) ?  '*' : ' ', i,
-			 mvppnd_read_reg(ppdev, REG_ADDR_MG_BASE_ADDR + i *
-					 REG_ADDR_MG_BASE_ADDR_OFFSET_FORMULA),
-			 mvppnd_read_reg(ppdev, REG_ADDR_MG_SIZE + i *
-					 REG_ADDR_MG_SIZE_OFFSET_FORMULA),
-			 mvppnd_read_reg(ppdev, REG_ADDR_MG_HA + i *
-					 REG_ADDR_MG_HA_OFFSET_FORMULA),
-			 mvppnd_read_reg(ppdev, REG_ADDR_MG_CONTROL + i *
-					 REG_ADDR_MG_CONTROL_OFFSET_FORMULA));
+	size_t ring_size = ppdev->rx_rings_size[rxq->queue];
+	struct mvppnd_ring *r = &rxq->ring;
+	u32 cmd_sts;
+	int n;
+
+	for (n = 1; n <= ring_size; n++) {
+		cmd_sts = r->descs[cyclic_idx(r->descs_ptr + n - 1,
+					      ring_size)]->cmd_sts;
+		if (cmd_sts & RX_CMD_BIT_OWN_SDMA)
+			return 0;
+		if (cmd_sts & RX_CMD_BIT_LAST)
+			return n;
 	}
 
-	return strlen(buf);
+	/* No LAST in the whole ring, give it all back */
+	return ring_size;
 }
 
-static void mvppnd_save_mg_wins(struct mvppnd_dev *ppdev, long bitmask)
+/*
+ * Pass ownership of the frame descriptors back to SDMA, last to first so
+ * SDMA never sees the head before the rest of the frame
+ */
+static void mvppnd_return_rx_descs(struct mvppnd_dev *ppdev,
+				   struct mvppnd_queue *rxq, int ndescs)
 {
-	int i, j;
-
-	memset(ppdev->mg_win, 0, sizeof(ppdev->mg_win));
-	for (i = 0, j = 0; (i < NUM_OF_MG_WINDOWS) &&
-	     (j < sizeof(ppdev->mg_win)) ; i++)
-		if (test_bit(i, &bitmask))
-			ppdev->mg_win[j++] = i;
+	size_t ring_size = ppdev->rx_rings_size[rxq->queue];
+	struct mvppnd_ring *r = &rxq->ring;
+	struct mvppnd_dma_sg_buf *buff;
+	size_t idx;
+
+	while (ndescs--) {
+		idx = cyclic_idx(r->descs_ptr + ndescs, ring_size);
+		buff = r->buffs[idx];
+		if (rxq->page_pool)
+			dma_sync_single_for_device(ppdev->dev,
+						   buff->mappings[0],
+						   buff->sizes[0],
+						   DMA_FROM_DEVICE);
+		r->descs[idx]->cmd_sts = RX_CMD_BIT_OWN_SDMA |
+					 RX_CMD_BIT_EN_INTR;
+	}
 }
 
-static ssize_t mvppnd_store_mg_win(struct kobject *kobj,
-				   struct kobj_attribute *attr,
-				   const char *buf, size_t count)
+#ifdef MVPPND_RX_PAGE_POOL
+/*
+ * Zero-copy flavour, the received pages go up with the skb and the
+ * descriptors get fresh pages from the pool. If not enough pages are
+ * available the frame is dropped and the old pages stay in the ring.
+ */
+static void mvppnd_process_rx_page(struct mvppnd_dev *ppdev,
+				   struct mvppnd_queue *rxq, int ndescs,
+				   struct list_head *rx_list_ptr)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_mg_win);
-	int win_mask;
+	size_t ring_size = ppdev->rx_rings_size[rxq->queue];
+	struct page *new_pages[MAX_SKB_FRAGS + 1];
+	struct mvppnd_ring *r = &rxq->ring;
+	u32 bc = r->descs[r->descs_ptr]->bc;
+	struct mvppnd_dma_sg_buf *buff;
+	int i, len, sync_len;
 
-	if (sscanf(buf, "0x%x", &win_mask) != 1) {
-		netdev_err(ppdev->sdev.flows[0]->ndev, "Invalid input\n");
-		goto out;
+	for (i = 0; i < ndescs; i++) {
+		new_pages[i] = mvppnd_alloc_rx_page(ppdev, rxq->page_pool);
+		if (unlikely(!new_pages[i]))
+			break;
 	}
 
-	mvppnd_save_mg_wins(ppdev, win_mask);
-out:
-	return count;
-}
+	if (unlikely(i < ndescs)) {
+		while (i--)
+			page_pool_recycle_direct(rxq->page_pool, new_pages[i]);
+		mvppnd_inc_flow_stat(ppdev->sdev.flows[0]->ndev,
+				     FLOW_STATS_RX_DROPPED, 1);
+		mvppnd_inc_stat(ppdev, STATS_RX_NO_BUFFS, 1);
+		/* Hand the same pages back to the SDMA */
+		mvppnd_return_rx_descs(ppdev, rxq, ndescs);
+		return;
+	}
 
-static ssize_t mvppnd_show_max_pkt_sz(struct kobject *kobj,
-				      struct kobj_attribute *attr, char *buf)
-{
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_max_pkt_sz);
+	len = RX_DESC_GET_BYTE_CNT(bc);
+	for (i = 0; i < ndescs; i++) {
+		buff = r->buffs[cyclic_idx(r->buffs_ptr + i, ring_size)];
+		sync_len = min_t(int, len, buff->sizes[0]);
+		len -= sync_len;
+		dma_sync_single_for_cpu(ppdev->dev, buff->mappings[0],
+					sync_len, DMA_FROM_DEVICE);
+	}
 
-	snprintf(buf, PAGE_SIZE, "%ld\n", ppdev->max_pkt_sz);
+	buff = r->buffs[r->buffs_ptr];
+	if (!mvppnd_process_rx_buff(ppdev, rxq, buff->virt, bc, ndescs - 1,
+				    rx_list_ptr))
+		for (i = 0; i < ndescs; i++) {
+			buff = r->buffs[cyclic_idx(r->buffs_ptr + i,
+						   ring_size)];
+			page_pool_recycle_direct(rxq->page_pool,
+						 virt_to_head_page(buff->virt));
+		}
 
-	return strlen(buf);
+	/* Last to first, as in mvppnd_return_rx_descs */
+	for (i = ndescs - 1; i >= 0; i--)
+		mvppnd_attach_rx_page(ppdev, r,
+				      cyclic_idx(r->descs_ptr + i, ring_size),
+				      new_pages[i]);
+}
+#else
+static void mvppnd_process_rx_page(struct mvppnd_dev *ppdev,
+				   struct mvppnd_queue *rxq, int ndescs,
+				   struct list_head *rx_list_ptr)
+{
 }
+#endif
 
-static ssize_t mvppnd_store_max_pkt_sz(struct kobject *kobj,
-				       struct kobj_attribute *attr,
-				       const char *buf, size_t count)
+#ifdef MVPPND_XSK
+/* XDP_PASS and XDP_TX on UMEM frames, the frame and its DSA are copied out */
+static struct sk_buff *mvppnd_xsk_copy_skb(struct mvppnd_queue *rxq,
+					   struct xdp_buff *xdp)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_max_pkt_sz);
+	unsigned int metalen = xdp->data - xdp->data_meta;
+	unsigned int len = xdp->data_end - xdp->data_meta;
+	struct sk_buff *skb;
 
-	sscanf(buf, "%ld", &ppdev->max_pkt_sz);
-	ppdev->max_pkt_sz = ((ppdev->max_pkt_sz / 8) + 1) * 8;
+	skb = napi_alloc_skb(&rxq->rx_napi->napi, len);
+	if (unlikely(!skb))
+		return NULL;
 
-	ppdev->sdev.flows[0]->ndev->max_mtu = ppdev->max_pkt_sz - CRC_SIZE;
+	skb_put_data(skb, xdp->data_meta, len);
+	if (metalen) {
+		__skb_pull(skb, metalen);
+		skb_metadata_set(skb, metalen);
+	}
 
-	return count;
+	return skb;
 }
 
-static ssize_t mvppnd_show_mac(struct kobject *kobj,
-			       struct kobj_attribute *attr, char *buf)
+/*
+ * Zero-copy AF_XDP flavour, the program of the netdev the socket is bound to
+ * runs on the UMEM frame, laid out as in mvppnd_run_xdp. The descriptor gets
+ * a fresh frame from the fill ring, if there is none the frame is dropped and
+ * the old one stays in the ring.
+ */
+static void mvppnd_process_rx_xsk(struct mvppnd_dev *ppdev,
+				  struct mvppnd_queue *rxq, int ndescs,
+				  struct list_head *rx_list_ptr)
 {
-	struct mvppnd_switch_flow *flow =
-		container_of(attr, struct mvppnd_switch_flow, attr_mac);
+	struct mvppnd_switch_flow *xsk_flow = ppdev->xsk_flows[rxq->queue];
+	struct net_device *xsk_ndev = xsk_flow->ndev;
+	struct mvppnd_ring *r = &rxq->ring;
+	u32 bc = r->descs[r->descs_ptr]->bc;
+	struct mvppnd_switch_flow *flow;
+	struct xdp_buff *xdp, *new_xdp;
+	struct bpf_prog *prog;
+	struct sk_buff *skb;
+	u8 istagged;
+	u16 vlan;
+	int len;
+	u32 act;
 
-	snprintf(buf, PAGE_SIZE, "%pM\n", flow->ndev->dev_addr);
+	len = RX_DESC_GET_BYTE_CNT(bc) - CRC_SIZE;
 
-	return strlen(buf);
-}
+	/* UMEM frames are not chained, neither are runts */
+	if (unlikely((ndescs > 1) || (len < DSA_SIZE + ETH_HLEN))) {
+		mvppnd_inc_flow_stat(xsk_ndev, FLOW_STATS_RX_LENGTH_ERRORS, 1);
+		mvppnd_return_rx_descs(ppdev, rxq, ndescs);
+		return;
+	}
 
-static ssize_t mvppnd_store_mac(struct kobject *kobj,
-				struct kobj_attribute *attr,
-				const char *buf, size_t count)
-{
-	struct mvppnd_switch_flow *flow =
-		container_of(attr, struct mvppnd_switch_flow, attr_mac);
-	unsigned int mac[ETH_ALEN];
-#if LINUX_VERSION_CODE < KERNEL_VERSION(5,15,0)
-	int i;
-#endif
+	new_xdp = mvppnd_xsk_alloc_rx_buff(ppdev, rxq, rxq->xsk_pool);
+	if (unlikely(!new_xdp)) {
+		mvppnd_inc_stat(ppdev, STATS_XSK_RX_NO_BUFF, 1);
+		mvppnd_inc_flow_stat(xsk_ndev, FLOW_STATS_RX_DROPPED, 1);
+		rxq->xsk_no_buff = true;
+		mvppnd_return_rx_descs(ppdev, rxq, ndescs);
+		return;
+	}
 
-	sscanf(buf, "%x:%x:%x:%x:%x:%x\n", &mac[0], &mac[1], &mac[2], &mac[3],
-	       &mac[4], &mac[5]);
+	xdp = rxq->xsk_buffs[r->descs_ptr];
+	xdp->data_end = xdp->data + len;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,10,0)
+	xsk_buff_dma_sync_for_cpu(xdp);
+#else
+	xsk_buff_dma_sync_for_cpu(xdp, rxq->xsk_pool);
+#endif
 
-#if LINUX_VERSION_CODE < KERNEL_VERSION(5,15,0)
-	for (i = 0; i < ETH_ALEN; i++)
-		flow->ndev->dev_addr[i] = mac[i];
+	flow = mvppnd_get_sw_flow(ppdev, xdp->data + ETH_ALEN * 2);
+	istagged = mvppnd_get_vlan_info(xdp->data + ETH_ALEN * 2, &vlan);
+	xdp->data = mvppnd_strip_rx_dsa(xdp->data, istagged, vlan);
+	xdp->data_meta = xdp->data - DSA_SIZE;
+
+	rxq->rx_napi->rx_bytes += len;
+	mvppnd_count_flow_rx(xsk_ndev, 1, len);
+
+	prog = READ_ONCE(xsk_flow->xdp_prog);
+	act = prog ? bpf_prog_run_xdp(prog, xdp) : XDP_PASS;
+	switch (act) {
+	case XDP_REDIRECT:
+		if (unlikely(xdp_do_redirect(xsk_ndev, xdp, prog)))
+			goto aborted;
+		rxq->rx_napi->xdp_redirect = true;
+		mvppnd_inc_stat(ppdev, STATS_RX_XDP_REDIRECT, 1);
+		/* Frame is owned by the socket now */
+		xdp = NULL;
+		break;
+	case XDP_PASS:
+		/* Delivered to the flow as any other frame */
+		skb = mvppnd_xsk_copy_skb(rxq, xdp);
+		if (unlikely(!skb)) {
+			mvppnd_inc_flow_stat(flow->ndev,
+					     FLOW_STATS_RX_DROPPED, 1);
+			mvppnd_inc_stat(ppdev, STATS_RX_NO_BUFFS, 1);
+			break;
+		}
+		skb->protocol = eth_type_trans(skb, flow->ndev);
+		skb_mark_napi_id(skb, &rxq->rx_napi->napi);
+		list_add_tail(&skb->list, rx_list_ptr);
+		break;
+	case XDP_TX:
+		skb = mvppnd_xsk_copy_skb(rxq, xdp);
+		if (unlikely(!skb))
+			goto aborted;
+		skb->dev = xsk_ndev;
+		mvppnd_xmit_skb(skb, smp_processor_id(), true);
+		rxq->rx_napi->tx_doorbell = true;
+		mvppnd_inc_stat(ppdev, STATS_RX_XDP_TX, 1);
+		break;
+	default:
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,17,0)
+		bpf_warn_invalid_xdp_action(xsk_ndev, prog, act);
 #else
-	dev_addr_mod(flow->ndev, 0, mac, ETH_ALEN);
+		bpf_warn_invalid_xdp_action(act);
 #endif
+		fallthrough;
+	case XDP_ABORTED:
+aborted:
+		trace_xdp_exception(xsk_ndev, prog, act);
+		mvppnd_inc_stat(ppdev, STATS_RX_XDP_ABORTED, 1);
+		break;
+	case XDP_DROP:
+		mvppnd_inc_stat(ppdev, STATS_RX_XDP_DROP, 1);
+		break;
+	}
 
-	return count;
+	if (xdp)
+		xsk_buff_free(xdp);
+
+	mvppnd_xsk_attach_rx_buff(rxq, r->descs_ptr, new_xdp);
 }
 
-static ssize_t mvppnd_show_dsa(struct kobject *kobj,
-			       struct kobj_attribute *attr, char *buf)
+/* Let the socket know whether the fill ring needs a kick */
+static void mvppnd_xsk_update_need_wakeup(struct mvppnd_queue *rxq)
 {
-	struct mvppnd_switch_flow *flow =
-		container_of(attr, struct mvppnd_switch_flow, attr_tx_dsa);
-	unsigned int dsa[DSA_SIZE];
-	int i;
+	if (!xsk_uses_need_wakeup(rxq->xsk_pool))
+		return;
 
-	for (i = 0; i < DSA_SIZE; i++)
-		dsa[i] = flow->config_tx_dsa[i];
+	if (rxq->xsk_no_buff)
+		xsk_set_rx_need_wakeup(rxq->xsk_pool);
+	else
+		xsk_clear_rx_need_wakeup(rxq->xsk_pool);
 
-	snprintf(buf, PAGE_SIZE,
-		 "%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x\n",
-		 dsa[0], dsa[1], dsa[2], dsa[3], dsa[4], dsa[5], dsa[6], dsa[7],
-		 dsa[8], dsa[9], dsa[10], dsa[11], dsa[12], dsa[13], dsa[14],
-		 dsa[15]);
-	snprintf(buf, PAGE_SIZE,
-		 "%s%.2x%.2x%.2x%.2x %.2x%.2x%.2x%.2x %.2x%.2x%.2x%.2x %.2x%.2x%.2x%.2x\n",
-		 buf, dsa[0], dsa[1], dsa[2], dsa[3], dsa[4], dsa[5], dsa[6],
-		 dsa[7], dsa[8], dsa[9], dsa[10], dsa[11], dsa[12], dsa[13],
-		 dsa[14], dsa[15]);
-	snprintf(buf, PAGE_SIZE,
-		 "%s%.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x\n",
-		 buf, dsa[0], dsa[1], dsa[2], dsa[3], dsa[4], dsa[5], dsa[6],
-		 dsa[7], dsa[8], dsa[9], dsa[10], dsa[11], dsa[12], dsa[13],
-		 dsa[14], dsa[15]);
+	rxq->xsk_no_buff = false;
+}
+#else
+static void mvppnd_process_rx_xsk(struct mvppnd_dev *ppdev,
+				  struct mvppnd_queue *rxq, int ndescs,
+				  struct list_head *rx_list_ptr)
+{
+}
 
-	return strlen(buf);
+static void mvppnd_xsk_update_need_wakeup(struct mvppnd_queue *rxq)
+{
 }
+#endif
 
-static ssize_t mvppnd_store_dsa(struct kobject *kobj,
-				struct kobj_attribute *attr,
-				const char *buf, size_t count)
+static int mvppnd_process_rx_queue(struct mvppnd_dev *ppdev, int queue,
+				   int budget,
+				   struct list_head *rx_list_ptr)
 {
-	struct mvppnd_switch_flow *flow =
-		container_of(attr, struct mvppnd_switch_flow, attr_tx_dsa);
-	unsigned int dsa[DSA_SIZE];
-	int i;
+	struct mvppnd_queue *rxq = ppdev->rx_queues[queue];
+	struct mvppnd_ring *r = &rxq->ring;
+	struct mvppnd_dma_sg_buf *buff;
+	int done = 0, ndescs, i;
 
-	i = sscanf(buf, "%x %x %x %x %x %x %x %x %x %x %x %x %x %x %x %x",
-		  &dsa[0], &dsa[1], &dsa[2], &dsa[3], &dsa[4], &dsa[5], &dsa[6],
-		  &dsa[7], &dsa[8], &dsa[9], &dsa[10], &dsa[11], &dsa[12],
-		  &dsa[13], &dsa[14], &dsa[15]);
+	/* called only from NAPI poll context, hence no need for mutex */
+	while (((r->descs[r->descs_ptr]->cmd_sts & RX_CMD_BIT_OWN_SDMA) !=
+	       RX_CMD_BIT_OWN_SDMA) && (done < budget)) {
 
-	if (i > DSA_SIZE) {
-		netdev_err(flow->ndev,
-			   "Invalid input, expecting less than %d vytes\n",
-			   DSA_SIZE);
-		return -EINVAL;
-	}
+		/* TODO: Check resource error bit (28) */
 
-	flow->config_tx_dsa_size = i;
+		/* Frame may span several descriptors, wait for all of them */
+		ndescs = mvppnd_rx_frame_descs(ppdev, rxq);
+		if (!ndescs)
+			break;
 
-	memset(flow->config_tx_dsa, 0, sizeof(flow->config_tx_dsa));
-	for (i = 0; i < DSA_SIZE; i++)
-		if (i < flow->config_tx_dsa_size)
-			flow->config_tx_dsa[i] = dsa[i];
+		/* Descriptor content is valid only after ownership check */
+		dma_rmb();
+
+		if (unlikely(ndescs > MAX_SKB_FRAGS + 1)) {
+			mvppnd_inc_flow_stat(ppdev->sdev.flows[0]->ndev,
+					     FLOW_STATS_RX_LENGTH_ERRORS, 1);
+			mvppnd_return_rx_descs(ppdev, rxq, ndescs);
+		} else if (rxq->xsk_pool) {
+			mvppnd_process_rx_xsk(ppdev, rxq, ndescs, rx_list_ptr);
+		} else if (rxq->page_pool) {
+			mvppnd_process_rx_page(ppdev, rxq, ndescs, rx_list_ptr);
+		} else {
+			buff = r->buffs[r->buffs_ptr];
 
-	return count;
-}
+			/* Populate skb details and pass to network stack */
+			mvppnd_process_rx_buff(ppdev, rxq, buff->virt,
+					       r->descs[r->descs_ptr]->bc,
+					       ndescs - 1,
+					       rx_list_ptr); /* add buffer to list, caller will pass entire list to kernel - faster */
 
-static ssize_t mvppnd_show_tx_queue_size(struct kobject *kobj,
-					 struct kobj_attribute *attr,
-					 char *buf)
-{
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_tx_queue_size);
+			/* Pass ownership back to SDMA */
+			mvppnd_return_rx_descs(ppdev, rxq, ndescs);
+		}
 
-	sprintf(buf, "%d\n", ppdev->tx_queue_size);
+		for (i = 0; i < ndescs; i++) {
+			/* Goto next desc */
+			cyclic_inc(&r->descs_ptr, ppdev->rx_rings_size[queue]);
 
-	return strlen(buf);
+			/* Goto next buff */
+			cyclic_inc(&r->buffs_ptr, ppdev->rx_rings_size[queue]);
+		}
+
+		done++;
+	}
+
+	if (rxq->xsk_pool)
+		mvppnd_xsk_update_need_wakeup(rxq);
+
+	/* return the number of processed frames */
+	return done;
 }
 
-static ssize_t mvppnd_store_tx_queue_size(struct kobject *kobj,
-					  struct kobj_attribute *attr,
-					  const char *buf, size_t count)
+static bool mvppnd_rings_empty(struct mvppnd_dev *ppdev, u32 queues_mask)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_tx_queue_size);
-	int rc;
+	struct mvppnd_ring *r = NULL;
+	u32 rxqs;
 
-	rc = sscanf(buf, "%d", &ppdev->tx_queue_size);
-	if (rc != 1) {
-		ppdev->tx_queue_size = TX_QUEUE_SIZE;
-		return -EINVAL;
+	for(rxqs = 0; rxqs< NUM_OF_RX_QUEUES; rxqs++) {
+		if (ppdev->rx_queues[rxqs] && (queues_mask & BIT(rxqs))) {
+			r = &ppdev->rx_queues[rxqs]->ring;
+			if((r->descs[r->descs_ptr]->cmd_sts &
+			    RX_CMD_BIT_OWN_SDMA) != RX_CMD_BIT_OWN_SDMA)
+				return false;
+		}
 	}
 
-	return count;
+	return true;
 }
 
-static ssize_t mvppnd_show_rx_ring_size(struct kobject *kobj,
-					struct kobj_attribute *attr,
-					char *buf)
+/* True if at least frames are waiting in one of the queues */
+static bool mvppnd_rx_frames_pending(struct mvppnd_dev *ppdev, u32 queues_mask,
+				     u32 frames)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_rx_ring_size);
-	int i;
+	struct mvppnd_ring *r;
+	size_t ring_size;
+	u32 rxqs;
 
-	strcpy(buf, "");
+	if (frames <= 1)
+		return true;
 
-	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
-		if (!ppdev->rx_queues[i])
+	for (rxqs = 0; rxqs < NUM_OF_RX_QUEUES; rxqs++) {
+		if (!ppdev->rx_queues[rxqs] || !(queues_mask & BIT(rxqs)))
 			continue;
 
-		sprintf(buf, "%s[%d] %ld\n", buf, i, ppdev->rx_rings_size[i]);
+		r = &ppdev->rx_queues[rxqs]->ring;
+		ring_size = ppdev->rx_rings_size[rxqs];
+		if (!(r->descs[cyclic_idx(r->descs_ptr +
+					  min_t(size_t, frames, ring_size) - 1,
+					  ring_size)]->cmd_sts &
+		      RX_CMD_BIT_OWN_SDMA))
+			return true;
 	}
 
-	return strlen(buf);
+	return false;
 }
 
-static ssize_t mvppnd_store_rx_ring_size(struct kobject *kobj,
-					 struct kobj_attribute *attr,
-					 const char *buf, size_t count)
+#ifdef MVPPND_RX_DIM
+static void mvppnd_rx_dim_work(struct work_struct *work)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_rx_ring_size);
-	size_t arg1, arg2, i;
-	int rc;
+	struct dim *dim = container_of(work, struct dim, work);
+	struct mvppnd_napi *rx_napi = container_of(dim, struct mvppnd_napi,
+						   dim);
+	struct dim_cq_moder moder;
 
-	rc = sscanf(buf, "%ld %ld", &arg1, &arg2);
-	switch (rc) {
-	case 1:
-		/* one arg, for backward compatibility - size of all */
-		for (i = 0; i < NUM_OF_RX_QUEUES; i++)
-			ppdev->rx_rings_size[i] =
-				roundup_pow_of_two(arg1);
-		break;
-	case 2:
-		if (arg1 > NUM_OF_RX_QUEUES) {
-			dev_err(ppdev->dev, "Invalid input, expecting < %d\n",
-				NUM_OF_RX_QUEUES);
-			return -EINVAL;
-		}
-		ppdev->rx_rings_size[arg1] = roundup_pow_of_two(arg2);
-		break;
-	default:
-		dev_err(ppdev->dev,
-			"Invalid input, expecting one or two args\n");
-		return -EINVAL;
-	};
+	moder = net_dim_get_rx_moderation(dim->mode, dim->profile_ix);
+	rx_napi->coal_usecs = moder.usec;
+	rx_napi->coal_frames = moder.pkts;
 
-	return count;
+	dim->state = DIM_START_MEASURE;
 }
 
-static ssize_t mvppnd_show_napi_budget(struct kobject *kobj,
-				       struct kobj_attribute *attr, char *buf)
+/* Feed DIM with the traffic seen so far, called on NAPI completion */
+static void mvppnd_rx_dim_update(struct mvppnd_dev *ppdev,
+				 struct mvppnd_napi *rx_napi)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_napi_budget);
+	struct dim_sample sample = {};
 
-	sprintf(buf, "%d", ppdev->napi_budget);
+	if (!ppdev->rx_coal_adaptive)
+		return;
 
-	return strlen(buf);
+	dim_update_sample(++rx_napi->events, rx_napi->rx_packets,
+			  rx_napi->rx_bytes, &sample);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,14,0)
+	net_dim(&rx_napi->dim, &sample);
+#else
+	net_dim(&rx_napi->dim, sample);
+#endif
 }
 
-static ssize_t mvppnd_store_napi_budget(struct kobject *kobj,
-					struct kobj_attribute *attr,
-					const char *buf, size_t count)
+static void mvppnd_rx_dim_init(struct mvppnd_dev *ppdev,
+			       struct mvppnd_napi *rx_napi)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_napi_budget);
-	int rc;
+	struct dim_cq_moder moder;
 
-	rc = sscanf(buf, "%d", &ppdev->napi_budget);
-	if (rc != 1) {
-		dev_err(&ppdev->pdev.pdev->dev,
-			"Invalid input, expecting napi budget\n");
-		return -EINVAL;
-	}
+	memset(&rx_napi->dim, 0, sizeof(rx_napi->dim));
+	INIT_WORK(&rx_napi->dim.work, mvppnd_rx_dim_work);
+	rx_napi->dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
 
-	return count;
+	if (ppdev->rx_coal_adaptive) {
+		moder = net_dim_get_def_rx_moderation(rx_napi->dim.mode);
+		rx_napi->coal_usecs = moder.usec;
+		rx_napi->coal_frames = moder.pkts;
+	}
 }
 
-static ssize_t mvppnd_show_driver_statistics(struct kobject *kobj,
-					     struct kobj_attribute *attr,
-					     char *buf)
+static void mvppnd_rx_dim_stop(struct mvppnd_napi *rx_napi)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_driver_statistics);
-	static unsigned long last_jiffies;
-	int i;
-	char lstr[96];
-
+	cancel_work_sync(&rx_napi->dim.work);
+}
+#else
+static void mvppnd_rx_dim_update(struct mvppnd_dev *ppdev,
+				 struct mvppnd_napi *rx_napi)
+{
+}
 
-	for (i = 0; i <= STATS_LAST; i++)
-		sprintf(buf, "%s%s: %ld\n", buf, mvppnd_get_stat_desc(i),
-			mvppnd_get_stat(ppdev, i, last_jiffies));
-	last_jiffies = jiffies;
-	/* debug counters - either last + max or incrementing counters: */
-	/* how much budget did we get from the kernel */
-	sprintf(lstr, "last budget packets: %d\n", last_budget_pkts);
-	strcat(buf, lstr);
-	sprintf(lstr, "max budget packets: %d\n", max_budget_pkts);
-	strcat(buf, lstr);
-	/* how many packets were polled in the NAPI poll handling: */
-	sprintf(lstr, "last poll packets: %d\n", last_poll_pkts);
-	strcat(buf, lstr);
-	sprintf(lstr, "max poll packets: %d\n", max_poll_pkts);
-	strcat(buf, lstr);
-	sprintf(lstr, "Failure to allocate receive buffers: %ld\n", no_skbs); /* failure to allocate RX SKBs counter */
-	strcat(buf, lstr);
-	sprintf(lstr, "DMA TX timeout: %ld\n", tx_tout); /* SDMA TX timeout counter */
-	strcat(buf, lstr);
-	sprintf(lstr, "tx busy returned due to size queued: %ld\n", tx_busy_size); /* driver ndo tx handler returned busy because too many buffers were queued for transmission */
-	strcat(buf, lstr);
-	sprintf(lstr, "tx busy returned due to memory allocation failure: %ld\n", tx_busy_mem); /* driver ndo tx handler returned busy because no memory could be allocated for buffer */
-	strcat(buf, lstr);
+static void mvppnd_rx_dim_init(struct mvppnd_dev *ppdev,
+			       struct mvppnd_napi *rx_napi)
+{
+}
 
-	return strlen(buf);
+static void mvppnd_rx_dim_stop(struct mvppnd_napi *rx_napi)
+{
 }
+#endif
 
-static ssize_t mvppnd_store_driver_statistics(struct kobject *kobj,
-					      struct kobj_attribute *attr,
-					      const char *buf, size_t count)
+int mvppnd_poll(struct napi_struct *napi, int budget)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_driver_statistics);
-	u32 entries_bitmask;
-	int rc, i;
+	struct mvppnd_napi *rx_napi = container_of(napi, struct mvppnd_napi,
+						   napi);
+	struct mvppnd_dev *ppdev = rx_napi->ppdev;
+	u32 queues_mask = rx_napi->queues_mask;
+	int done_queue, done_total = 0, quantum[NUM_OF_RX_QUEUES];
+	int allowed, round_total, weights_sum = 0;
+	u32 served_mask = 0, starved_mask;
+	size_t queue_idx;
+	struct list_head rx_list;
 
-	last_poll_pkts = max_poll_pkts = 0; /* zero debug statistics */
-	last_budget_pkts = max_budget_pkts = 0;
+	INIT_LIST_HEAD(&rx_list); /* list containing all received buffers for passing to kernel in one go - faster */
 
-	rc = sscanf(buf, "0x%x", &entries_bitmask);
-	if (rc != 1) {
-		dev_err(ppdev->dev,
-			"Invalid input, expecting 32 bit hex number\n");
-		return -EINVAL;
+#ifdef DBG_BUDGET
+	last_budget_pkts = budget;
+	if (budget > max_budget_pkts)
+		max_budget_pkts = budget; /* for debug telemetries only */
+#endif
+
+	/* dev_dbg(&ppdev->pdev->dev, "budget %d\n", budget); */
+#ifdef DBG_DELAY
+	pr_err("mvppnd_poll - NAPI poll\n");
+#endif
+	mvppnd_inc_stat(ppdev, STATS_NAPI_POLL_CALLS, 1);
+	rx_napi->gro_pkts = 0;
+
+	/*
+	 * Deficit round robin across the queues of this context. Each
+	 * queue is granted a quantum, its weighted share of the budget,
+	 * when its turn starts. A queue which runs dry forfeits what is
+	 * left of its quantum, while a queue cut short because the budget
+	 * ran out keeps its deficit and the next poll resumes from it, so
+	 * a flood on one queue can not take the share of the others.
+	 */
+	for (queue_idx = 0; queue_idx < NUM_OF_RX_QUEUES; queue_idx++)
+		if (queues_mask & BIT(queue_idx))
+			weights_sum += ppdev->rx_queues_weight[queue_idx];
+
+	for (queue_idx = 0; queue_idx < NUM_OF_RX_QUEUES; queue_idx++)
+		if (queues_mask & BIT(queue_idx))
+			quantum[queue_idx] =
+				max(budget * ppdev->rx_queues_weight[queue_idx] /
+				    weights_sum, 1);
+
+	queue_idx = rx_napi->drr_queue;
+	if (!(queues_mask & BIT(queue_idx)))
+		queue_idx = __ffs(queues_mask);
+
+	do {
+		size_t first_queue_idx = queue_idx;
+
+		round_total = 0;
+		do {
+			int *deficit = &ppdev->rx_queues_deficit[queue_idx];
+
+			if (!*deficit)
+				*deficit = quantum[queue_idx];
+
+			allowed = min(*deficit, budget - done_total);
+			done_queue = mvppnd_process_rx_queue(ppdev, queue_idx,
+							     allowed,
+							     &rx_list);
+			served_mask |= BIT(queue_idx);
+
+			mvppnd_inc_stat(ppdev,
+					STATS_RX_Q0_PACKETS + queue_idx,
+					done_queue);
+
+			done_total += done_queue;
+			round_total += done_queue;
+
+			if (done_queue < allowed) {
+				*deficit = 0; /* ran dry, no carry-over */
+			} else {
+				*deficit -= done_queue;
+				if (*deficit) {
+					/* budget exhausted mid-turn */
+					ppdev->rx_queues_carried[queue_idx]++;
+					break;
+				}
+			}
+
+			/* move to next queue, skip queues of other contexts */
+			queue_idx = mvppnd_next_queue(queues_mask, queue_idx);
+		} while ((done_total < budget) &&
+			 (queue_idx != first_queue_idx));
+		/*
+		 * another round is needed only if this one yielded
+		 * buffers and there is budget left
+		 */
+	} while ((done_total < budget) && round_total);
+
+	rx_napi->drr_queue = queue_idx;
+
+	if (done_total >= budget) {
+		/* queues with pending buffers which did not get a turn */
+		starved_mask = queues_mask & ~served_mask;
+		for (queue_idx = 0; queue_idx < NUM_OF_RX_QUEUES; queue_idx++)
+			if ((starved_mask & BIT(queue_idx)) &&
+			    !mvppnd_rings_empty(ppdev, BIT(queue_idx)))
+				ppdev->rx_queues_starved[queue_idx]++;
 	}
 
-	for (i = 0; i <= STATS_LAST; i++) {
-		if ((entries_bitmask & 0x00000001) == 0x00000001)
-			mvppnd_clear_stat(ppdev, i);
-		entries_bitmask = entries_bitmask >> 1;
+	/* dev_dbg(&ppdev->pdev->dev, "done %d\n", done_total); */
+
+	/*
+	 * process skbs in a list. This is much more
+	 * cache efficient as Linux kernel has a lot
+	 * of function called, and this allows only
+	 * the Linux kernel function to stay hot in
+	 * the CPU cache, imrpvoing performance.
+	 * Delivered before completion so a busy-poller sees them on return.
+	 */
+	netif_receive_skb_list(&rx_list);
+	mvppnd_xdp_flush(rx_napi);
+	if (rx_napi->tx_doorbell) {
+		rx_napi->tx_doorbell = false;
+		mvppnd_tx_flush(ppdev);
 	}
+	mvppnd_tx_complete(ppdev);
 
-	return count;
+	if (done_total < budget) { /* No more packets */
+		dev_dbg(&ppdev->pdev.pdev->dev, "re-enable interrupts\n");
+		/*
+		 * Flushes what GRO holds for this context. Returns false while
+		 * a busy-poller owns the context, interrupts are then left
+		 * masked and the poller re-arms them when it is done.
+		 */
+		if (napi_complete_done(napi, done_total)) {
+			if (rx_napi->gro_pkts)
+				mvppnd_inc_stat(ppdev, STATS_NAPI_GRO_FLUSHES,
+						1);
+			mvppnd_rx_dim_update(ppdev, rx_napi);
+			mvppnd_en_rx_queues_intr(ppdev, 1, queues_mask);
+			if (rx_napi == ppdev->tx_napi)
+				mvppnd_en_tx_queue_intr(ppdev);
+			/*
+			 * Read Receive_SDMA_Interrupt_Cause1 to clear the
+			 * register
+			 */
+			mvppnd_read_reg(ppdev, REG_ADDR_RX_CAUSE_1);
+		} else {
+			mvppnd_inc_stat(ppdev, STATS_NAPI_BUSY_POLL_HELD, 1);
+		}
+	} else {
+		mvppnd_inc_stat(ppdev, STATS_NAPI_BURN_BUDGET, 1);
+	}
+
+	mvppnd_inc_stat(ppdev, STATS_RX_PACKETS, done_total);
+	rx_napi->rx_packets += done_total;
+	/*
+	 * Read Receive_SDMA_Interrupt_Cause1 to clear the register
+	 */
+	mvppnd_read_reg(ppdev, REG_ADDR_RX_CAUSE_1);
+
+	/* dev_dbg(&ppdev->pdev->dev, "done napi poll\n"); */
+#ifdef DBG_DELAY
+	pr_err("mvppnd_poll - NAPI poll - end\n");
+#endif
+
+#ifdef DBG_BUDGET
+	last_poll_pkts = done_total;
+	if (done_total > max_poll_pkts)
+		max_poll_pkts = done_total; /* debug telemetries */
+#endif
+
+	return done_total;
 }
 
-static ssize_t mvppnd_store_if_create(struct kobject *kobj,
-				 struct kobj_attribute *attr,
-				 const char *buf, size_t count)
+/*********** sysfs *************************************/
+
+static void mvppnd_print_ring(struct mvppnd_dev *ppdev,
+			      struct mvppnd_ring *ring, size_t ring_size,
+			      size_t curr_ptr)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_if_create);
-	char name[IFNAMSIZ];
-	int rc, port;
+	u32 dma;
+	int i, j;
 
-	/*
- 	 * Port argument is optional, if set by the user then let
- 	 * mvppnd_create_netdev use it, otherwise pass -1 as indication to pick
- 	 * the next port.
- 	 * Set to -2 since convention for ports numbers is 1-based.
- 	 */
-	port = -2;
+	for (j = curr_ptr; j < curr_ptr + 3; j++) {
+		i = cyclic_idx(j, ring_size);
+		if (i == 0)
+			dma = ring->ring_dma;
+		else
+			dma = ring->descs[i - 1]->next_desc_ptr;
 
-	rc = sscanf(buf, "%s %d", name, &port);
-	if ((rc != 1) && (rc != 2)) {
-		dev_err(ppdev->dev,
-			"Invalid input, expecting ifname [port]\n");
-		return -EINVAL;
+		dev_dbg(ppdev->dev,
+			"\t[%d, 0x%x]: 0x%x, 0x%x, 0x%x, 0x%x\n",
+			i, dma, ring->descs[i]->cmd_sts,
+			__builtin_bswap32(ring->descs[i]->bc),
+			ring->descs[i]->buf_addr,
+			ring->descs[i]->next_desc_ptr);
 	}
+}
 
-	rc = mvppnd_create_netdev(ppdev, name, port + 1 /* 1 based */);
-	if (rc < 0) {
-		dev_err(ppdev->dev,
-			"Fail to create netdev %s, aborting.\n", name);
-		return -EINVAL;
+static ssize_t mvppnd_show_rx_queues(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_rx_queues);
+	int i;
+
+	strcpy(buf, "");
+
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
+		snprintf(buf, PAGE_SIZE, "%s[%c%d] 0x%x, %ld/%ld\n", buf,
+			 ppdev->rx_queues[i] ? '*' : ' ', i,
+			 mvppnd_read_rx_first_desc(ppdev, i),
+			 ppdev->rx_queues[i] ?
+			 ppdev->rx_queues[i]->ring.descs_ptr : -1,
+			 ppdev->rx_queues[i] ?  ppdev->rx_rings_size[i] : -1);
+		if (ppdev->rx_queues[i] && ppdev->rx_queues[i]->ring.descs)
+			mvppnd_print_ring(ppdev, &ppdev->rx_queues[i]->ring,
+					    ppdev->rx_rings_size[i],
+					    ppdev->rx_queues[i]->ring.
+					    descs_ptr);
 	}
 
-	return count;
+	return strlen(buf);
 }
 
-static inline int mvppnd_get_flow_id(struct mvppnd_dev *ppdev,
-				     const char *ifname)
+static void mvppnd_alloc_rx_queues(struct mvppnd_dev *ppdev)
 {
 	int i;
 
-	/* 1 based as we will never look for 0 */
-	for (i = 1; i < MAX_NETDEVS; i++)
-		if ((ppdev->sdev.flows[i]) &&
-		    (!strcmp(ifname, netdev_name(ppdev->sdev.flows[i]->ndev))))
-			return i;
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
+		if (!test_bit(i, (unsigned long *)&ppdev->rx_queues_mask))
+			continue;
+		ppdev->rx_queues[i] = kzalloc(sizeof(*ppdev->rx_queues[i]),
+					      GFP_KERNEL);
+		if (ppdev->rx_queues[i])
+			ppdev->rx_queues[i]->queue = i;
+	}
+}
 
-	dev_err(ppdev->dev, "Fail to find %s\n", ifname);
-	return -ENOENT;
+static void mvppnd_free_rx_queues(struct mvppnd_dev *ppdev)
+{
+	int i;
+
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
+		kfree(ppdev->rx_queues[i]);
+		ppdev->rx_queues[i] = NULL;
+	}
 }
 
-static ssize_t mvppnd_store_if_delete(struct kobject *kobj,
+/* netdev TX queue i posts to the i-th SDMA queue in tx_queues_mask */
+static void mvppnd_setup_tx_queues(struct mvppnd_dev *ppdev)
+{
+	int i, n = 0;
+
+	for (i = 0; i < NUM_OF_TX_QUEUES; i++) {
+		if (!(ppdev->tx_queues_mask & BIT(i)))
+			continue;
+		ppdev->txqs[n].queue = i;
+		ppdev->txqs[n].idx = n;
+		n++;
+	}
+
+	ppdev->num_txqs = n;
+
+	mvppnd_map_tx_prios(ppdev);
+}
+
+static ssize_t mvppnd_store_rx_queues(struct kobject *kobj,
 				      struct kobj_attribute *attr,
 				      const char *buf, size_t count)
 {
 	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_if_delete);
-	char name[IFNAMSIZ];
-	int rc, flow_id;
+						attr_rx_queues);
+	unsigned long queues_bitmap;
+	int rc;
 
-	rc = sscanf(buf, "%s", name);
-	if (rc != 1) {
-		dev_err(ppdev->dev,
-			"Invalid input, expecting ifname\n");
-		return -EINVAL;
+	if ((ppdev->pdev.pdev) && (unlikely(ppdev->pdev.atu_win == -1)) &&
+	    (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2)) {
+		dev_err(&ppdev->pdev.pdev->dev,
+			"Required atu_win configuration is missing\n");
+		return -ENOSYS;
 	}
 
-	flow_id = mvppnd_get_flow_id(ppdev, name);
-	if (flow_id < 0) {
-		dev_err(ppdev->dev, "Fail to remove %s\n", name);
+	rc = sscanf(buf, "0x%lx", &queues_bitmap);
+	if (rc != 1) {
+		dev_err(ppdev->dev,
+			"Invalid input, expecting 0xlx\n");
 		return -EINVAL;
 	}
 
-	mvppnd_destroy_netdev(ppdev, flow_id);
+	/* Save for interrupt masking */
+	ppdev->rx_queues_mask = queues_bitmap;
 
 	return count;
 }
 
-static ssize_t mvppnd_show_rx_dsa_mask(struct kobject *kobj,
-				       struct kobj_attribute *attr, char *buf)
+static ssize_t mvppnd_show_rx_queues_napi(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  char *buf)
 {
-	struct mvppnd_switch_flow *flow =
-		container_of(attr, struct mvppnd_switch_flow, attr_rx_dsa_mask);
-	unsigned int dsa[DSA_SIZE];
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_rx_queues_napi);
 	int i;
 
-	for (i = 0; i < DSA_SIZE; i++)
-		dsa[i] = flow->rx_dsa_mask[i];
+	strcpy(buf, "");
 
-	snprintf(buf, PAGE_SIZE,
-		 "%.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x\n",
-		 dsa[0], dsa[1], dsa[2], dsa[3], dsa[4], dsa[5], dsa[6], dsa[7],
-		 dsa[8], dsa[9], dsa[10], dsa[11], dsa[12], dsa[13], dsa[14],
-		 dsa[15]);
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++)
+		snprintf(buf, PAGE_SIZE, "%s[%c%d] %d\n", buf,
+			 ppdev->rx_queues[i] ? '*' : ' ', i,
+			 ppdev->rx_queue_napi[i]);
 
 	return strlen(buf);
 }
 
-static ssize_t mvppnd_store_rx_dsa_mask(struct kobject *kobj,
-					struct kobj_attribute *attr,
-					const char *buf, size_t count)
+static ssize_t mvppnd_store_rx_queues_napi(struct kobject *kobj,
+					   struct kobj_attribute *attr,
+					   const char *buf, size_t count)
 {
-	struct mvppnd_switch_flow *flow =
-		container_of(attr, struct mvppnd_switch_flow, attr_rx_dsa_mask);
-	unsigned int dsa[DSA_SIZE];
-	int sz, i;
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_rx_queues_napi);
+	u32 map;
 
-	sz = sscanf(buf, "%x %x %x %x %x %x %x %x %x %x %x %x %x %x %x %x",
-		    &dsa[0], &dsa[1], &dsa[2], &dsa[3], &dsa[4], &dsa[5],
-		    &dsa[6], &dsa[7], &dsa[8], &dsa[9], &dsa[10], &dsa[11],
-		    &dsa[12], &dsa[13], &dsa[14], &dsa[15]);
-	if (sz > DSA_SIZE) {
-		netdev_err(flow->ndev,
-			   "Invalid input, expecting less than %d vytes\n",
-			   DSA_SIZE);
+	if (sscanf(buf, "0x%x", &map) != 1) {
+		dev_err(ppdev->dev,
+			"Invalid input, expecting 0x%%x, nibble per queue\n");
 		return -EINVAL;
 	}
 
-	if (sz != flow->config_tx_dsa_size) {
-		netdev_warn(flow->ndev, "mask size != dsa size (%d, %d)\n",
-			    sz, flow->config_tx_dsa_size);
-	}
-
-	for (i = 0; i < sz; i++)
-		flow->rx_dsa_mask[i] = dsa[i];
+	mvppnd_setup_rx_queues_napi(ppdev, map);
 
 	return count;
 }
 
-static ssize_t mvppnd_show_rx_dsa_val(struct kobject *kobj,
-				      struct kobj_attribute *attr, char *buf)
+static ssize_t mvppnd_show_rx_queues_weight(struct kobject *kobj,
+					    struct kobj_attribute *attr,
+					    char *buf)
 {
-	struct mvppnd_switch_flow *flow =
-		container_of(attr, struct mvppnd_switch_flow, attr_rx_dsa_val);
-	unsigned int dsa[DSA_SIZE];
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_rx_queues_weight);
 	int i;
 
-	for (i = 0; i < DSA_SIZE; i++)
-		dsa[i] = flow->rx_dsa_val[i];
+	strcpy(buf, "");
 
-	snprintf(buf, PAGE_SIZE,
-		 "%.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x\n",
-		 dsa[0], dsa[1], dsa[2], dsa[3], dsa[4], dsa[5], dsa[6], dsa[7],
-		 dsa[8], dsa[9], dsa[10], dsa[11], dsa[12], dsa[13], dsa[14],
-		 dsa[15]);
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++)
+		snprintf(buf, PAGE_SIZE,
+			 "%s[%c%d] weight %d, deficit %d, starved %lu, carried %lu\n",
+			 buf, ppdev->rx_queues[i] ? '*' : ' ', i,
+			 ppdev->rx_queues_weight[i],
+			 ppdev->rx_queues_deficit[i],
+			 ppdev->rx_queues_starved[i],
+			 ppdev->rx_queues_carried[i]);
 
 	return strlen(buf);
 }
 
-static ssize_t mvppnd_store_rx_dsa_val(struct kobject *kobj,
-				       struct kobj_attribute *attr,
-				       const char *buf, size_t count)
+static ssize_t mvppnd_store_rx_queues_weight(struct kobject *kobj,
+					     struct kobj_attribute *attr,
+					     const char *buf, size_t count)
 {
-	struct mvppnd_switch_flow *flow =
-		container_of(attr, struct mvppnd_switch_flow, attr_rx_dsa_val);
-	unsigned int dsa[DSA_SIZE];
-	int sz, i;
-
-	sz = sscanf(buf, "%x %x %x %x %x %x %x %x %x %x %x %x %x %x %x %x",
-		    &dsa[0], &dsa[1], &dsa[2], &dsa[3], &dsa[4], &dsa[5],
-		    &dsa[6], &dsa[7], &dsa[8], &dsa[9], &dsa[10], &dsa[11],
-		    &dsa[12], &dsa[13], &dsa[14], &dsa[15]);
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_rx_queues_weight);
+	u32 weights;
 
-	if (sz > DSA_SIZE) {
-		netdev_err(flow->ndev,
-			   "Invalid input, expecting less than %d vytes\n",
-			   DSA_SIZE);
+	if (sscanf(buf, "0x%x", &weights) != 1) {
+		dev_err(ppdev->dev,
+			"Invalid input, expecting 0x%%x, nibble per queue\n");
 		return -EINVAL;
 	}
 
-	if (sz != flow->config_tx_dsa_size) {
-		netdev_warn(flow->ndev, "val size != dsa size (%d, %d)\n",
-			    sz, flow->config_tx_dsa_size);
-	}
-
-	for (i = 0; i < sz; i++)
-		flow->rx_dsa_val[i] = dsa[i];
+	/* Takes effect from the next NAPI poll, no need to stop the device */
+	mvppnd_setup_rx_queues_weights(ppdev, weights);
 
 	return count;
 }
 
-static ssize_t mvppnd_show_mg(struct kobject *kobj,
-			      struct kobj_attribute *attr, char *buf)
+static ssize_t mvppnd_print_tx_queues(struct mvppnd_dev *ppdev, char *buf)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_mg);
+	int i;
 
-	snprintf(buf, PAGE_SIZE, "%d\n", ppdev->pdev.mg_cluster);
+	for (i = 0; i < NUM_OF_TX_QUEUES; i++) {
+		snprintf(buf, PAGE_SIZE, "%s[%c%d] %d, 0x%x\n", buf,
+			 (ppdev->tx_queues_mask & BIT(i)) ? '*' : ' ', i,
+			 mvppnd_queue_enabled(ppdev, REG_ADDR_TX_QUEUE_CMD, i) ?
+			 1 : 0, mvppnd_read_tx_first_desc(ppdev, i));
+	}
+
+	for (i = 0; i < ppdev->num_txqs; i++)
+		if (ppdev->txqs[i].frames) /* Ring is initialized? */
+			mvppnd_print_ring(ppdev, &ppdev->txqs[i].ring,
+					  TX_RING_SIZE, ppdev->txqs[i].clean_ptr);
 
 	return strlen(buf);
 }
 
-static ssize_t mvppnd_store_mg(struct kobject *kobj,
-			       struct kobj_attribute *attr,
-			       const char *buf, size_t count)
+/* Verify that the requested queues are not used by Packet Generator */
+static int mvppnd_check_tx_queues(struct mvppnd_dev *ppdev, u32 queues_mask)
 {
-	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_mg);
-	int rc, mg_cluster;
+	int i;
 
-	rc = sscanf(buf, "%d", &mg_cluster);
-	if (rc != 1) {
-		dev_err(ppdev->dev, "Invalid input\n");
-		return -EINVAL;
+	for (i = 0; i < NUM_OF_TX_QUEUES; i++) {
+		if (!(queues_mask & BIT(i)))
+			continue;
+		if (mvppnd_read_reg(ppdev, REG_ADDR_PG_CFG_QUEUE +
+				    REG_ADDR_PG_CFG_QUEUE_OFFSET_FORMULA * i)) {
+			dev_err(ppdev->dev,
+				"Queue %d is used by Packet Generator\n", i);
+			return -EINVAL;
+		}
 	}
 
-	ppdev->pdev.mg_cluster = mg_cluster;
-
-	rc = mvppnd_setup_iatu_window(ppdev, ppdev->pdev.mg_cluster);
-	if (rc)
-		return rc;
-
-	return count;
+	return 0;
 }
 
-#ifdef MVPPND_DEBUG_REG
-static ssize_t mvppnd_store_reg(struct kobject *kobj,
-				struct kobj_attribute *attr,
-				const char *buf, size_t count)
+static ssize_t mvppnd_show_tx_queue(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
 {
 	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
-						attr_reg);
-	int argc, cmd, arg1, arg2, arg3;
-
-	argc = sscanf(buf, "0x%x 0x%x 0x%x 0x%x", &cmd, &arg1,&arg2, &arg3);
+						attr_tx_queue);
 
-	switch (cmd) {
-	case 0x1: /* oATU */
-		if (argc != 4) {
-			printk("Expecting 4 args (win, field, val)\n");
-			return -EINVAL;
-		}
-		printk("win 0x%x, field 0x%x, val 0x%x\n", arg1, arg2,
-		       arg3);
-		iowrite32(arg3, ppdev->pdev.bar0 + ATU_OFFS + arg1 *
-			  0x0200 + arg2);
-		break;
+	return mvppnd_print_tx_queues(ppdev, buf);
+}
 
-	case 0x2: /* iATU */
-		if (argc != 4) {
-			printk("Expecting 4 args (win, field, val)\n");
-			return -EINVAL;
-		}
-		printk("win 0x%x, field 0x%x, val 0x%x\n", arg1, arg2,
-		       arg3);
-		iowrite32(arg3, ppdev->pdev.bar0 + ATU_OFFS + arg1 *
-			  0x0200 + arg2 + 0x100);
-		break;
+/* Single queue, kept for existing setups, see tx_queues */
+static ssize_t mvppnd_store_tx_queue(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_tx_queue);
+	int queue;
 
-	case 0x3:
-		if (argc != 2) {
-			printk("Expecting 1 arg (print_packets_interval)\n");
-			return -EINVAL;
-		}
-		ppdev->print_packets_interval = arg1;
-		break;
+	if ((sscanf(buf, "%d", &queue) != 1) || (queue < -1) ||
+	    (queue >= NUM_OF_TX_QUEUES)) {
+		dev_err(ppdev->dev, "Invalid queue number %d\n", queue);
+		ppdev->tx_queues_mask = 0;
+		return -EINVAL;
+	}
 
-	default:
-		printk("Invalid command 0x%x\n", cmd);
+	if ((queue != -1) && mvppnd_check_tx_queues(ppdev, BIT(queue))) {
+		ppdev->tx_queues_mask = 0;
 		return -EINVAL;
-	};
+	}
+
+	ppdev->tx_queues_mask = (queue == -1) ? 0 : BIT(queue);
 
 	return count;
 }
-#endif
 
-static int mvppnd_sysfs_create_file(struct net_device *ndev,
-				    struct kobj_attribute *attr,
-				    const char *name, umode_t mode,
-				    ssize_t (*show)(struct kobject *kobj,
-						    struct kobj_attribute *attr,
-						    char *buf),
-				    ssize_t (*store)(struct kobject *kobj,
-						     struct kobj_attribute *attr,
-						     const char *buf,
-						     size_t count))
+static ssize_t mvppnd_show_tx_queues(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
 {
-	attr->attr.name = name;
-	attr->attr.mode = mode;
-	attr->show = show;
-	attr->store = store;
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_tx_queues);
 
-	return sysfs_create_file(&ndev->dev.kobj, &attr->attr);
+	return mvppnd_print_tx_queues(ppdev, buf);
 }
 
-static int mvppnd_sysfs_create_files(struct mvppnd_dev *ppdev, int flow_id)
+/* Bit per SDMA queue, each becomes a TX queue of the netdevs */
+static ssize_t mvppnd_store_tx_queues(struct kobject *kobj,
+				      struct kobj_attribute *attr,
+				      const char *buf, size_t count)
 {
-	struct mvppnd_switch_flow *flow = ppdev->sdev.flows[flow_id];
-	int rc;
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_tx_queues);
+	unsigned long queues_bitmap;
 
-	rc = mvppnd_sysfs_create_file(flow->ndev, &flow->attr_mac, "mac",
-				      S_IRUSR | S_IWUSR, mvppnd_show_mac,
-				      mvppnd_store_mac);
-	if (rc) {
+	if ((sscanf(buf, "0x%lx", &queues_bitmap) != 1) ||
+	    (queues_bitmap & ~BIT_MASK(NUM_OF_TX_QUEUES))) {
 		dev_err(ppdev->dev,
-			"Fail to create mac sysfs file\n");
-		return rc;
+			"Invalid input, expecting 0x%%x, bit per queue\n");
+		return -EINVAL;
 	}
 
-	rc = mvppnd_sysfs_create_file(flow->ndev, &flow->attr_tx_dsa, "dsa",
-				      S_IRUSR | S_IWUSR, mvppnd_show_dsa,
-				      mvppnd_store_dsa);
-	if (rc) {
-		dev_err(ppdev->dev,
-			"Fail to create dsa sysfs file\n");
-		goto remove_mac;
-	}
+	if (mvppnd_check_tx_queues(ppdev, queues_bitmap))
+		return -EINVAL;
 
-	if (flow_id) {
-		rc = mvppnd_sysfs_create_file(flow->ndev,
-					      &flow->attr_rx_dsa_val,
-					      "rx_dsa_val", S_IRUSR | S_IWUSR,
-					      mvppnd_show_rx_dsa_val,
-					      mvppnd_store_rx_dsa_val);
-		if (rc) {
-			dev_err(ppdev->dev,
-				"Fail to create rx_dsa_val sysfs file\n");
-			goto remove_dsa;
-		}
+	ppdev->tx_queues_mask = queues_bitmap;
 
-		rc = mvppnd_sysfs_create_file(flow->ndev,
-					      &flow->attr_rx_dsa_mask,
-					      "rx_dsa_mask", S_IRUSR | S_IWUSR,
-					      mvppnd_show_rx_dsa_mask,
-					      mvppnd_store_rx_dsa_mask);
-		if (rc) {
-			dev_err(ppdev->dev,
-				"Fail to create rx_dsa_mask sysfs file\n");
-			goto remove_rx_dsa_val;
-		}
+	return count;
+}
 
-		/* The next entries applies only to main device, exit here */
-		return 0;
-	}
+static ssize_t mvppnd_show_tx_prio_queues(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  char *buf)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_tx_prio_queues);
+	int i;
 
-	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_rx_queues,
-				      "rx_queues", S_IRUSR | S_IWUSR,
-				      mvppnd_show_rx_queues,
-				      mvppnd_store_rx_queues);
-	if (rc) {
-		dev_err(ppdev->dev,
-			"Fail to create rx_queues sysfs file\n");
-		goto remove_rx_dsa_mask;
-	}
+	strcpy(buf, "");
 
-	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_tx_queue,
-				      "tx_queue", S_IRUSR | S_IWUSR,
-				      mvppnd_show_tx_queue,
-		   		      mvppnd_store_tx_queue);
-	if (rc) {
-		dev_err(ppdev->dev,
-			"Fail to create tx_queue sysfs file\n");
-		goto remove_rx_queue;
-	}
+	for (i = 0; i < NUM_OF_TX_PRIOS; i++)
+		snprintf(buf, PAGE_SIZE, "%s[%c%d] 0x%x, %d\n", buf,
+			 (ppdev->tx_prio_txq[i] != -1) ? '*' : ' ', i,
+			 ppdev->tx_prio_queue[i], ppdev->tx_prio_txq[i]);
 
-	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_mg_win, "mg_win",
-				      S_IRUSR | S_IWUSR, mvppnd_show_mg_win,
-				      mvppnd_store_mg_win);
-	if (rc) {
-		dev_err(ppdev->dev,
-			"Fail to create mg_win sysfs file\n");
-		goto remove_tx_queue;
-	}
+	return strlen(buf);
+}
 
-	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_max_pkt_sz,
-				      "max_pkt_sz", S_IRUSR | S_IWUSR,
-				      mvppnd_show_max_pkt_sz,
-				      mvppnd_store_max_pkt_sz);
-	if (rc) {
-		dev_err(ppdev->dev,
-			"Fail to create max_pkt_sz sysfs file\n");
-		goto remove_mg_win;
-	}
+static ssize_t mvppnd_store_tx_prio_queues(struct kobject *kobj,
+					   struct kobj_attribute *attr,
+					   const char *buf, size_t count)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_tx_prio_queues);
+	u32 map;
 
-	rc = mvppnd_sysfs_create_file(flow->ndev,
-				      &ppdev->attr_driver_statistics,
-				      "driver_statistics", S_IRUSR | S_IWUSR,
-				      mvppnd_show_driver_statistics,
-				      mvppnd_store_driver_statistics);
-	if (rc) {
+	if (sscanf(buf, "0x%x", &map) != 1) {
 		dev_err(ppdev->dev,
-			"Fail to create driver_statistics sysfs file\n");
-		goto remove_max_pkt_sz;
+			"Invalid input, expecting 0x%%x, nibble per priority\n");
+		return -EINVAL;
 	}
 
-	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_napi_budget,
-				      "napi_budget", S_IRUSR | S_IWUSR,
-				      mvppnd_show_napi_budget,
-				      mvppnd_store_napi_budget);
-	if (rc) {
-		dev_err(&ppdev->pdev.pdev->dev,
-			"Fail to create napi_budget sysfs file\n");
-		goto remove_driver_statistics;
-	}
+	/* Takes effect from the next frame, no need to stop the device */
+	mvppnd_setup_tx_prio_queues(ppdev, map);
 
-	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_rx_ring_size,
-				      "rx_ring_size", S_IRUSR | S_IWUSR,
-				      mvppnd_show_rx_ring_size,
-				      mvppnd_store_rx_ring_size);
-	if (rc) {
-		dev_err(ppdev->dev,
-			"Fail to create rx_ring_size sysfs file\n");
-		goto remove_napi_budget;
+	return count;
+}
+
+static ssize_t mvppnd_show_atu_win(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_atu_win);
+	u32 addr;
+	int i;
+
+	snprintf(buf, PAGE_SIZE, "%s%-8s\t%-8s\t%-8s\t%-8s\t%-8s\t%-8s\t%-8s\n",
+		 "                   ", "ctrl1", "ctrl2", "low-base",
+		 "upper-base", "limit", "low-target", "upper-target");
+
+	if (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2) {
+		for (i = 0; i < NUM_OF_ATU_WINDOWS; i++) {
+			addr = ATU_OFFS + i * 0x0200;
+			snprintf(buf, PAGE_SIZE,
+				"%s[%c%d] (0x%x) out: 0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\n",
+				buf, (i == ppdev->pdev.atu_win ? '*' : ' '), i, addr,
+				ioread32(ppdev->pdev.bar0 + addr + 0x0000),
+				ioread32(ppdev->pdev.bar0 + addr + 0x0004),
+				ioread32(ppdev->pdev.bar0 + addr + 0x0008),
+				ioread32(ppdev->pdev.bar0 + addr + 0x000c),
+				ioread32(ppdev->pdev.bar0 + addr + 0x0010),
+				ioread32(ppdev->pdev.bar0 + addr + 0x0014),
+				ioread32(ppdev->pdev.bar0 + addr + 0x0018));
+			addr += 0x0100; /* Now inbound */
+			snprintf(buf, PAGE_SIZE,
+				"%s[%c%d] (0x%x) in : 0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\n",
+				buf, (i == ppdev->pdev.atu_win ? '*' : ' '), i, addr,
+				ioread32(ppdev->pdev.bar0 + addr + 0x0000),
+				ioread32(ppdev->pdev.bar0 + addr + 0x0004),
+				ioread32(ppdev->pdev.bar0 + addr + 0x0008),
+				ioread32(ppdev->pdev.bar0 + addr + 0x000c),
+				ioread32(ppdev->pdev.bar0 + addr + 0x0010),
+				ioread32(ppdev->pdev.bar0 + addr + 0x0014),
+				ioread32(ppdev->pdev.bar0 + addr + 0x0018));
+		}
 	}
 
-	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_if_create,
-				      "if_create", S_IWUSR, NULL,
-				      mvppnd_store_if_create);
-	if (rc) {
+	return strlen(buf);
+}
+
+static ssize_t mvppnd_store_atu_win(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t count)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_atu_win);
+	int rc;
+
+	rc = sscanf(buf, "%d", &ppdev->pdev.atu_win);
+	if (rc != 1) {
+		dev_err(ppdev->dev, "Invalid input\n");
+		ppdev->pdev.atu_win = -1;
+		return -EINVAL;
+	}
+
+	rc = mvppnd_setup_iatu_window(ppdev, ppdev->pdev.mg_cluster);
+	if (rc)
+		return rc;
+
+	debug_print_some_registers(ppdev);
+
+	return count;
+}
+
+static int mvppnd_is_our_win(struct mvppnd_dev *ppdev, u8 win)
+{
+	int i;
+
+	for (i = 0; i < sizeof(ppdev->mg_win); i++)
+		if (win == ppdev->mg_win[i])
+			return true;
+
+	return false;
+}
+
+static ssize_t mvppnd_show_mg_win(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_mg_win);
+	int i;
+
+	for (i = 0; i < NUM_OF_MG_WINDOWS; i++) {
+		snprintf(buf, PAGE_SIZE,
+			 "%s[%c%d] 0x%-8x\t0x%-8x\t0x%-8x\t0x%-8x\n", buf,
+			 mvppnd_is_our_win(ppdev, i) ?  '*' : ' ', i,
+			 mvppnd_read_reg(ppdev, REG_ADDR_MG_BASE_ADDR + i *
+					 REG_ADDR_MG_BASE_ADDR_OFFSET_FORMULA),
+			 mvppnd_read_reg(ppdev, REG_ADDR_MG_SIZE + i *
+					 REG_ADDR_MG_SIZE_OFFSET_FORMULA),
+			 mvppnd_read_reg(ppdev, REG_ADDR_MG_HA + i *
+					 REG_ADDR_MG_HA_OFFSET_FORMULA),
+			 mvppnd_read_reg(ppdev, REG_ADDR_MG_CONTROL + i *
+					 REG_ADDR_MG_CONTROL_OFFSET_FORMULA));
+	}
+
+	return strlen(buf);
+}
+
+static void mvppnd_save_mg_wins(struct mvppnd_dev *ppdev, long bitmask)
+{
+	int i, j;
+
+	memset(ppdev->mg_win, 0, sizeof(ppdev->mg_win));
+	for (i = 0, j = 0; (i < NUM_OF_MG_WINDOWS) &&
+	     (j < sizeof(ppdev->mg_win)) ; i++)
+		if (test_bit(i, &bitmask))
+			ppdev->mg_win[j++] = i;
+}
+
+static ssize_t mvppnd_store_mg_win(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_mg_win);
+	int win_mask;
+
+	if (sscanf(buf, "0x%x", &win_mask) != 1) {
+		netdev_err(ppdev->sdev.flows[0]->ndev, "Invalid input\n");
+		goto out;
+	}
+
+	mvppnd_save_mg_wins(ppdev, win_mask);
+out:
+	return count;
+}
+
+static ssize_t mvppnd_show_max_pkt_sz(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_max_pkt_sz);
+
+	snprintf(buf, PAGE_SIZE, "%ld\n", ppdev->max_pkt_sz);
+
+	return strlen(buf);
+}
+
+static ssize_t mvppnd_store_max_pkt_sz(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_max_pkt_sz);
+
+	size_t max_pkt_sz;
+
+	sscanf(buf, "%ld", &max_pkt_sz);
+	max_pkt_sz = ((max_pkt_sz / 8) + 1) * 8;
+
+	if (atomic_read(&ppdev->xdp_progs) && (max_pkt_sz > RX_MAX_BUFF_SZ)) {
+		dev_err(ppdev->dev, "XDP supports up to %u bytes frames\n",
+			RX_MAX_BUFF_SZ);
+		return -EINVAL;
+	}
+
+	ppdev->max_pkt_sz = max_pkt_sz;
+
+	ppdev->sdev.flows[0]->ndev->max_mtu = ppdev->max_pkt_sz - CRC_SIZE;
+
+	return count;
+}
+
+static ssize_t mvppnd_show_rx_zero_copy(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_rx_zero_copy);
+
+	snprintf(buf, PAGE_SIZE, "%d\n", ppdev->rx_zero_copy);
+
+	return strlen(buf);
+}
+
+static ssize_t mvppnd_store_rx_zero_copy(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 const char *buf, size_t count)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_rx_zero_copy);
+	int val;
+
+	if (sscanf(buf, "%d", &val) != 1) {
+		dev_err(ppdev->dev, "Invalid input, expecting 0 or 1\n");
+		return -EINVAL;
+	}
+
+#ifndef MVPPND_RX_PAGE_POOL
+	if (val) {
 		dev_err(ppdev->dev,
-			"Fail to create if_create sysfs file\n");
-		goto remove_rx_ring_size;
+			"Zero-copy RX requires page pool support\n");
+		return -EOPNOTSUPP;
 	}
+#endif
 
-	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_if_delete,
-				      "if_delete", S_IWUSR, NULL,
-				      mvppnd_store_if_delete);
-	if (rc) {
+	if (val && !mvppnd_streaming_dma_ok(ppdev)) {
 		dev_err(ppdev->dev,
-			"Fail to create if_delete sysfs file\n");
-		goto remove_if_create;
+			"Zero-copy RX buffers would be out of the MG windows\n");
+		return -EOPNOTSUPP;
 	}
 
-	if ((ppdev->pdev.pdev) &&
-	    (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2)) {
-		rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_atu_win,
-					      "atu_win", S_IRUSR | S_IWUSR,
-					      mvppnd_show_atu_win,
-					      mvppnd_store_atu_win);
-		if (rc) {
-			dev_err(ppdev->dev,
-				"Fail to create atu_win sysfs file\n");
-				goto remove_if_delete;
+	if (!val && atomic_read(&ppdev->xdp_progs)) {
+		dev_err(ppdev->dev, "Zero-copy RX is required by XDP\n");
+		return -EBUSY;
+	}
+
+	ppdev->rx_zero_copy = !!val;
+
+	return count;
+}
+
+static ssize_t mvppnd_show_mac(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	struct mvppnd_switch_flow *flow =
+		container_of(attr, struct mvppnd_switch_flow, attr_mac);
+
+	snprintf(buf, PAGE_SIZE, "%pM\n", flow->ndev->dev_addr);
+
+	return strlen(buf);
+}
+
+static ssize_t mvppnd_store_mac(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct mvppnd_switch_flow *flow =
+		container_of(attr, struct mvppnd_switch_flow, attr_mac);
+	unsigned int mac[ETH_ALEN];
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,15,0)
+	int i;
+#endif
+
+	sscanf(buf, "%x:%x:%x:%x:%x:%x\n", &mac[0], &mac[1], &mac[2], &mac[3],
+	       &mac[4], &mac[5]);
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,15,0)
+	for (i = 0; i < ETH_ALEN; i++)
+		flow->ndev->dev_addr[i] = mac[i];
+#else
+	dev_addr_mod(flow->ndev, 0, mac, ETH_ALEN);
+#endif
+
+	return count;
+}
+
+static ssize_t mvppnd_show_dsa(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	struct mvppnd_switch_flow *flow =
+		container_of(attr, struct mvppnd_switch_flow, attr_tx_dsa);
+	unsigned int dsa[DSA_SIZE];
+	int i;
+
+	for (i = 0; i < DSA_SIZE; i++)
+		dsa[i] = flow->config_tx_dsa[i];
+
+	snprintf(buf, PAGE_SIZE,
+		 "%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x%.2x\n",
+		 dsa[0], dsa[1], dsa[2], dsa[3], dsa[4], dsa[5], dsa[6], dsa[7],
+		 dsa[8], dsa[9], dsa[10], dsa[11], dsa[12], dsa[13], dsa[14],
+		 dsa[15]);
+	snprintf(buf, PAGE_SIZE,
+		 "%s%.2x%.2x%.2x%.2x %.2x%.2x%.2x%.2x %.2x%.2x%.2x%.2x %.2x%.2x%.2x%.2x\n",
+		 buf, dsa[0], dsa[1], dsa[2], dsa[3], dsa[4], dsa[5], dsa[6],
+		 dsa[7], dsa[8], dsa[9], dsa[10], dsa[11], dsa[12], dsa[13],
+		 dsa[14], dsa[15]);
+	snprintf(buf, PAGE_SIZE,
+		 "%s%.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x\n",
+		 buf, dsa[0], dsa[1], dsa[2], dsa[3], dsa[4], dsa[5], dsa[6],
+		 dsa[7], dsa[8], dsa[9], dsa[10], dsa[11], dsa[12], dsa[13],
+		 dsa[14], dsa[15]);
+
+	return strlen(buf);
+}
+
+static ssize_t mvppnd_store_dsa(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct mvppnd_switch_flow *flow =
+		container_of(attr, struct mvppnd_switch_flow, attr_tx_dsa);
+	unsigned int dsa[DSA_SIZE];
+	int i;
+
+	i = sscanf(buf, "%x %x %x %x %x %x %x %x %x %x %x %x %x %x %x %x",
+		  &dsa[0], &dsa[1], &dsa[2], &dsa[3], &dsa[4], &dsa[5], &dsa[6],
+		  &dsa[7], &dsa[8], &dsa[9], &dsa[10], &dsa[11], &dsa[12],
+		  &dsa[13], &dsa[14], &dsa[15]);
+
+	if (i > DSA_SIZE) {
+		netdev_err(flow->ndev,
+			   "Invalid input, expecting less than %d vytes\n",
+			   DSA_SIZE);
+		return -EINVAL;
+	}
+
+	/* Serialize with open and stop, they own the template buffer */
+	if (!rtnl_trylock())
+		return restart_syscall();
+
+	flow->config_tx_dsa_size = i;
+
+	memset(flow->config_tx_dsa, 0, sizeof(flow->config_tx_dsa));
+	for (i = 0; i < DSA_SIZE; i++)
+		if (i < flow->config_tx_dsa_size)
+			flow->config_tx_dsa[i] = dsa[i];
+
+	if (flow->up)
+		mvppnd_build_tx_dsa(flow->ppdev, flow);
+
+	rtnl_unlock();
+
+	return count;
+}
+
+static ssize_t mvppnd_show_tx_backlog(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	struct mvppnd_switch_flow *flow =
+		container_of(attr, struct mvppnd_switch_flow, attr_tx_backlog);
+	unsigned long backlogged = 0, dropped = 0;
+	u32 backlog = 0;
+	int i;
+
+	for (i = 0; i < NUM_OF_TX_QUEUES; i++) {
+		backlog += READ_ONCE(flow->tx_backlog[i].skbs.qlen);
+		backlogged += READ_ONCE(flow->tx_backlog[i].backlogged);
+		dropped += READ_ONCE(flow->tx_backlog[i].dropped);
+	}
+
+	return sprintf(buf,
+		       "frames in backlog: %u\nframes backlogged: %ld\nframes dropped from backlog: %ld\n",
+		       backlog, backlogged, dropped);
+}
+
+static ssize_t mvppnd_show_tx_queue_size(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 char *buf)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_tx_queue_size);
+
+	sprintf(buf, "%d\n", ppdev->tx_queue_size);
+
+	return strlen(buf);
+}
+
+static ssize_t mvppnd_store_tx_queue_size(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  const char *buf, size_t count)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_tx_queue_size);
+	int rc;
+
+	rc = sscanf(buf, "%d", &ppdev->tx_queue_size);
+	if (rc != 1) {
+		ppdev->tx_queue_size = TX_QUEUE_SIZE;
+		return -EINVAL;
+	}
+
+	return count;
+}
+
+static ssize_t mvppnd_show_rx_ring_size(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					char *buf)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_rx_ring_size);
+	int i;
+
+	strcpy(buf, "");
+
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
+		if (!ppdev->rx_queues[i])
+			continue;
+
+		sprintf(buf, "%s[%d] %ld\n", buf, i, ppdev->rx_rings_size[i]);
+	}
+
+	return strlen(buf);
+}
+
+static ssize_t mvppnd_store_rx_ring_size(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 const char *buf, size_t count)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_rx_ring_size);
+	size_t arg1, arg2, i;
+	int rc;
+
+	rc = sscanf(buf, "%ld %ld", &arg1, &arg2);
+	switch (rc) {
+	case 1:
+		/* one arg, for backward compatibility - size of all */
+		for (i = 0; i < NUM_OF_RX_QUEUES; i++)
+			ppdev->rx_rings_size[i] =
+				roundup_pow_of_two(arg1);
+		break;
+	case 2:
+		if (arg1 > NUM_OF_RX_QUEUES) {
+			dev_err(ppdev->dev, "Invalid input, expecting < %d\n",
+				NUM_OF_RX_QUEUES);
+			return -EINVAL;
+		}
+		ppdev->rx_rings_size[arg1] = roundup_pow_of_two(arg2);
+		break;
+	default:
+		dev_err(ppdev->dev,
+			"Invalid input, expecting one or two args\n");
+		return -EINVAL;
+	};
+
+	return count;
+}
+
+static ssize_t mvppnd_show_napi_budget(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_napi_budget);
+
+	sprintf(buf, "%d", ppdev->napi_budget);
+
+	return strlen(buf);
+}
+
+static ssize_t mvppnd_store_napi_budget(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					const char *buf, size_t count)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_napi_budget);
+	int rc;
+
+	rc = sscanf(buf, "%d", &ppdev->napi_budget);
+	if (rc != 1) {
+		dev_err(&ppdev->pdev.pdev->dev,
+			"Invalid input, expecting napi budget\n");
+		return -EINVAL;
+	}
+
+	return count;
+}
+
+static ssize_t mvppnd_show_driver_statistics(struct kobject *kobj,
+					     struct kobj_attribute *attr,
+					     char *buf)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_driver_statistics);
+	static unsigned long last_jiffies;
+	int i;
+	char lstr[96];
+
+
+	for (i = 0; i <= STATS_LAST; i++)
+		sprintf(buf, "%s%s: %llu\n", buf, mvppnd_get_stat_desc(i),
+			mvppnd_get_stat(ppdev, i, last_jiffies));
+	last_jiffies = jiffies;
+	/* debug counters - either last + max or incrementing counters: */
+	/* how much budget did we get from the kernel */
+	sprintf(lstr, "last budget packets: %d\n", last_budget_pkts);
+	strcat(buf, lstr);
+	sprintf(lstr, "max budget packets: %d\n", max_budget_pkts);
+	strcat(buf, lstr);
+	/* how many packets were polled in the NAPI poll handling: */
+	sprintf(lstr, "last poll packets: %d\n", last_poll_pkts);
+	strcat(buf, lstr);
+	sprintf(lstr, "max poll packets: %d\n", max_poll_pkts);
+	strcat(buf, lstr);
+
+	return strlen(buf);
+}
+
+static ssize_t mvppnd_store_driver_statistics(struct kobject *kobj,
+					      struct kobj_attribute *attr,
+					      const char *buf, size_t count)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_driver_statistics);
+	u64 entries_bitmask;
+	int rc, i;
+
+	last_poll_pkts = max_poll_pkts = 0; /* zero debug statistics */
+	last_budget_pkts = max_budget_pkts = 0;
+
+	rc = sscanf(buf, "0x%llx", &entries_bitmask);
+	if (rc != 1) {
+		dev_err(ppdev->dev,
+			"Invalid input, expecting 64 bit hex number\n");
+		return -EINVAL;
+	}
+
+	for (i = 0; i <= STATS_LAST; i++) {
+		if (entries_bitmask & 1)
+			mvppnd_clear_stat(ppdev, i);
+		entries_bitmask = entries_bitmask >> 1;
+	}
+
+	return count;
+}
+
+static ssize_t mvppnd_store_if_create(struct kobject *kobj,
+				 struct kobj_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_if_create);
+	char name[IFNAMSIZ];
+	int rc, port;
+
+	/*
+ 	 * Port argument is optional, if set by the user then let
+ 	 * mvppnd_create_netdev use it, otherwise pass -1 as indication to pick
+ 	 * the next port.
+ 	 * Set to -2 since convention for ports numbers is 1-based.
+ 	 */
+	port = -2;
+
+	rc = sscanf(buf, "%s %d", name, &port);
+	if ((rc != 1) && (rc != 2)) {
+		dev_err(ppdev->dev,
+			"Invalid input, expecting ifname [port]\n");
+		return -EINVAL;
+	}
+
+	rc = mvppnd_create_netdev(ppdev, name, port + 1 /* 1 based */);
+	if (rc < 0) {
+		dev_err(ppdev->dev,
+			"Fail to create netdev %s, aborting.\n", name);
+		return -EINVAL;
+	}
+
+	return count;
+}
+
+static inline int mvppnd_get_flow_id(struct mvppnd_dev *ppdev,
+				     const char *ifname)
+{
+	int i;
+
+	/* 1 based as we will never look for 0 */
+	for (i = 1; i < MAX_NETDEVS; i++)
+		if ((ppdev->sdev.flows[i]) &&
+		    (!strcmp(ifname, netdev_name(ppdev->sdev.flows[i]->ndev))))
+			return i;
+
+	dev_err(ppdev->dev, "Fail to find %s\n", ifname);
+	return -ENOENT;
+}
+
+static ssize_t mvppnd_store_if_delete(struct kobject *kobj,
+				      struct kobj_attribute *attr,
+				      const char *buf, size_t count)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_if_delete);
+	char name[IFNAMSIZ];
+	int rc, flow_id;
+
+	rc = sscanf(buf, "%s", name);
+	if (rc != 1) {
+		dev_err(ppdev->dev,
+			"Invalid input, expecting ifname\n");
+		return -EINVAL;
+	}
+
+	flow_id = mvppnd_get_flow_id(ppdev, name);
+	if (flow_id < 0) {
+		dev_err(ppdev->dev, "Fail to remove %s\n", name);
+		return -EINVAL;
+	}
+
+	mvppnd_destroy_netdev(ppdev, flow_id);
+
+	return count;
+}
+
+static ssize_t mvppnd_show_rx_dsa_mask(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	struct mvppnd_switch_flow *flow =
+		container_of(attr, struct mvppnd_switch_flow, attr_rx_dsa_mask);
+	unsigned int dsa[DSA_SIZE];
+	int i;
+
+	for (i = 0; i < DSA_SIZE; i++)
+		dsa[i] = flow->rx_dsa_mask[i];
+
+	snprintf(buf, PAGE_SIZE,
+		 "%.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x\n",
+		 dsa[0], dsa[1], dsa[2], dsa[3], dsa[4], dsa[5], dsa[6], dsa[7],
+		 dsa[8], dsa[9], dsa[10], dsa[11], dsa[12], dsa[13], dsa[14],
+		 dsa[15]);
+
+	return strlen(buf);
+}
+
+static ssize_t mvppnd_store_rx_dsa_mask(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					const char *buf, size_t count)
+{
+	struct mvppnd_switch_flow *flow =
+		container_of(attr, struct mvppnd_switch_flow, attr_rx_dsa_mask);
+	unsigned int dsa[DSA_SIZE];
+	int sz, i;
+
+	sz = sscanf(buf, "%x %x %x %x %x %x %x %x %x %x %x %x %x %x %x %x",
+		    &dsa[0], &dsa[1], &dsa[2], &dsa[3], &dsa[4], &dsa[5],
+		    &dsa[6], &dsa[7], &dsa[8], &dsa[9], &dsa[10], &dsa[11],
+		    &dsa[12], &dsa[13], &dsa[14], &dsa[15]);
+	if (sz > DSA_SIZE) {
+		netdev_err(flow->ndev,
+			   "Invalid input, expecting less than %d vytes\n",
+			   DSA_SIZE);
+		return -EINVAL;
+	}
+
+	if (sz != flow->config_tx_dsa_size) {
+		netdev_warn(flow->ndev, "mask size != dsa size (%d, %d)\n",
+			    sz, flow->config_tx_dsa_size);
+	}
+
+	for (i = 0; i < sz; i++)
+		flow->rx_dsa_mask[i] = dsa[i];
+
+	mvppnd_rebuild_rx_demux(flow->ppdev);
+
+	return count;
+}
+
+static ssize_t mvppnd_show_rx_dsa_val(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	struct mvppnd_switch_flow *flow =
+		container_of(attr, struct mvppnd_switch_flow, attr_rx_dsa_val);
+	unsigned int dsa[DSA_SIZE];
+	int i;
+
+	for (i = 0; i < DSA_SIZE; i++)
+		dsa[i] = flow->rx_dsa_val[i];
+
+	snprintf(buf, PAGE_SIZE,
+		 "%.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x\n",
+		 dsa[0], dsa[1], dsa[2], dsa[3], dsa[4], dsa[5], dsa[6], dsa[7],
+		 dsa[8], dsa[9], dsa[10], dsa[11], dsa[12], dsa[13], dsa[14],
+		 dsa[15]);
+
+	return strlen(buf);
+}
+
+static ssize_t mvppnd_store_rx_dsa_val(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	struct mvppnd_switch_flow *flow =
+		container_of(attr, struct mvppnd_switch_flow, attr_rx_dsa_val);
+	unsigned int dsa[DSA_SIZE];
+	int sz, i;
+
+	sz = sscanf(buf, "%x %x %x %x %x %x %x %x %x %x %x %x %x %x %x %x",
+		    &dsa[0], &dsa[1], &dsa[2], &dsa[3], &dsa[4], &dsa[5],
+		    &dsa[6], &dsa[7], &dsa[8], &dsa[9], &dsa[10], &dsa[11],
+		    &dsa[12], &dsa[13], &dsa[14], &dsa[15]);
+
+	if (sz > DSA_SIZE) {
+		netdev_err(flow->ndev,
+			   "Invalid input, expecting less than %d vytes\n",
+			   DSA_SIZE);
+		return -EINVAL;
+	}
+
+	if (sz != flow->config_tx_dsa_size) {
+		netdev_warn(flow->ndev, "val size != dsa size (%d, %d)\n",
+			    sz, flow->config_tx_dsa_size);
+	}
+
+	for (i = 0; i < sz; i++)
+		flow->rx_dsa_val[i] = dsa[i];
+
+	mvppnd_rebuild_rx_demux(flow->ppdev);
+
+	return count;
+}
+
+static ssize_t mvppnd_show_mg(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_mg);
+
+	snprintf(buf, PAGE_SIZE, "%d\n", ppdev->pdev.mg_cluster);
+
+	return strlen(buf);
+}
+
+static ssize_t mvppnd_store_mg(struct kobject *kobj,
+			       struct kobj_attribute *attr,
+			       const char *buf, size_t count)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_mg);
+	int rc, mg_cluster;
+
+	rc = sscanf(buf, "%d", &mg_cluster);
+	if (rc != 1) {
+		dev_err(ppdev->dev, "Invalid input\n");
+		return -EINVAL;
+	}
+
+	ppdev->pdev.mg_cluster = mg_cluster;
+
+	rc = mvppnd_setup_iatu_window(ppdev, ppdev->pdev.mg_cluster);
+	if (rc)
+		return rc;
+
+	return count;
+}
+
+#ifdef MVPPND_DEBUG_REG
+static ssize_t mvppnd_store_reg(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct mvppnd_dev *ppdev = container_of(attr, struct mvppnd_dev,
+						attr_reg);
+	int argc, cmd, arg1, arg2, arg3;
+
+	argc = sscanf(buf, "0x%x 0x%x 0x%x 0x%x", &cmd, &arg1,&arg2, &arg3);
+
+	switch (cmd) {
+	case 0x1: /* oATU */
+		if (argc != 4) {
+			printk("Expecting 4 args (win, field, val)\n");
+			return -EINVAL;
+		}
+		printk("win 0x%x, field 0x%x, val 0x%x\n", arg1, arg2,
+		       arg3);
+		iowrite32(arg3, ppdev->pdev.bar0 + ATU_OFFS + arg1 *
+			  0x0200 + arg2);
+		break;
+
+	case 0x2: /* iATU */
+		if (argc != 4) {
+			printk("Expecting 4 args (win, field, val)\n");
+			return -EINVAL;
+		}
+		printk("win 0x%x, field 0x%x, val 0x%x\n", arg1, arg2,
+		       arg3);
+		iowrite32(arg3, ppdev->pdev.bar0 + ATU_OFFS + arg1 *
+			  0x0200 + arg2 + 0x100);
+		break;
+
+	case 0x3:
+		if (argc != 2) {
+			printk("Expecting 1 arg (print_packets_interval)\n");
+			return -EINVAL;
+		}
+		ppdev->print_packets_interval = arg1;
+		break;
+
+	default:
+		printk("Invalid command 0x%x\n", cmd);
+		return -EINVAL;
+	};
+
+	return count;
+}
+#endif
+
+static int mvppnd_sysfs_create_file(struct net_device *ndev,
+				    struct kobj_attribute *attr,
+				    const char *name, umode_t mode,
+				    ssize_t (*show)(struct kobject *kobj,
+						    struct kobj_attribute *attr,
+						    char *buf),
+				    ssize_t (*store)(struct kobject *kobj,
+						     struct kobj_attribute *attr,
+						     const char *buf,
+						     size_t count))
+{
+	attr->attr.name = name;
+	attr->attr.mode = mode;
+	attr->show = show;
+	attr->store = store;
+
+	return sysfs_create_file(&ndev->dev.kobj, &attr->attr);
+}
+
+static int mvppnd_sysfs_create_files(struct mvppnd_dev *ppdev, int flow_id)
+{
+	struct mvppnd_switch_flow *flow = ppdev->sdev.flows[flow_id];
+	int rc;
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &flow->attr_mac, "mac",
+				      S_IRUSR | S_IWUSR, mvppnd_show_mac,
+				      mvppnd_store_mac);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create mac sysfs file\n");
+		return rc;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &flow->attr_tx_dsa, "dsa",
+				      S_IRUSR | S_IWUSR, mvppnd_show_dsa,
+				      mvppnd_store_dsa);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create dsa sysfs file\n");
+		goto remove_mac;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &flow->attr_tx_backlog,
+				      "tx_backlog", S_IRUSR,
+				      mvppnd_show_tx_backlog, NULL);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create tx_backlog sysfs file\n");
+		goto remove_dsa;
+	}
+
+	if (flow_id) {
+		rc = mvppnd_sysfs_create_file(flow->ndev,
+					      &flow->attr_rx_dsa_val,
+					      "rx_dsa_val", S_IRUSR | S_IWUSR,
+					      mvppnd_show_rx_dsa_val,
+					      mvppnd_store_rx_dsa_val);
+		if (rc) {
+			dev_err(ppdev->dev,
+				"Fail to create rx_dsa_val sysfs file\n");
+			goto remove_tx_backlog;
+		}
+
+		rc = mvppnd_sysfs_create_file(flow->ndev,
+					      &flow->attr_rx_dsa_mask,
+					      "rx_dsa_mask", S_IRUSR | S_IWUSR,
+					      mvppnd_show_rx_dsa_mask,
+					      mvppnd_store_rx_dsa_mask);
+		if (rc) {
+			dev_err(ppdev->dev,
+				"Fail to create rx_dsa_mask sysfs file\n");
+			goto remove_rx_dsa_val;
+		}
+
+		/* The next entries applies only to main device, exit here */
+		return 0;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_rx_queues,
+				      "rx_queues", S_IRUSR | S_IWUSR,
+				      mvppnd_show_rx_queues,
+				      mvppnd_store_rx_queues);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create rx_queues sysfs file\n");
+		goto remove_rx_dsa_mask;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_rx_queues_napi,
+				      "rx_queues_napi", S_IRUSR | S_IWUSR,
+				      mvppnd_show_rx_queues_napi,
+				      mvppnd_store_rx_queues_napi);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create rx_queues_napi sysfs file\n");
+		goto remove_rx_queue;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_rx_queues_weight,
+				      "rx_queues_weight", S_IRUSR | S_IWUSR,
+				      mvppnd_show_rx_queues_weight,
+				      mvppnd_store_rx_queues_weight);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create rx_queues_weight sysfs file\n");
+		goto remove_rx_queues_napi;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_tx_queue,
+				      "tx_queue", S_IRUSR | S_IWUSR,
+				      mvppnd_show_tx_queue,
+		   		      mvppnd_store_tx_queue);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create tx_queue sysfs file\n");
+		goto remove_rx_queues_weight;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_tx_queues,
+				      "tx_queues", S_IRUSR | S_IWUSR,
+				      mvppnd_show_tx_queues,
+				      mvppnd_store_tx_queues);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create tx_queues sysfs file\n");
+		goto remove_tx_queue;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_tx_prio_queues,
+				      "tx_prio_queues", S_IRUSR | S_IWUSR,
+				      mvppnd_show_tx_prio_queues,
+				      mvppnd_store_tx_prio_queues);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create tx_prio_queues sysfs file\n");
+		goto remove_tx_queues;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_mg_win, "mg_win",
+				      S_IRUSR | S_IWUSR, mvppnd_show_mg_win,
+				      mvppnd_store_mg_win);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create mg_win sysfs file\n");
+		goto remove_tx_prio_queues;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_max_pkt_sz,
+				      "max_pkt_sz", S_IRUSR | S_IWUSR,
+				      mvppnd_show_max_pkt_sz,
+				      mvppnd_store_max_pkt_sz);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create max_pkt_sz sysfs file\n");
+		goto remove_mg_win;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_rx_zero_copy,
+				      "rx_zero_copy", S_IRUSR | S_IWUSR,
+				      mvppnd_show_rx_zero_copy,
+				      mvppnd_store_rx_zero_copy);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create rx_zero_copy sysfs file\n");
+		goto remove_max_pkt_sz;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev,
+				      &ppdev->attr_driver_statistics,
+				      "driver_statistics", S_IRUSR | S_IWUSR,
+				      mvppnd_show_driver_statistics,
+				      mvppnd_store_driver_statistics);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create driver_statistics sysfs file\n");
+		goto remove_rx_zero_copy;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_napi_budget,
+				      "napi_budget", S_IRUSR | S_IWUSR,
+				      mvppnd_show_napi_budget,
+				      mvppnd_store_napi_budget);
+	if (rc) {
+		dev_err(&ppdev->pdev.pdev->dev,
+			"Fail to create napi_budget sysfs file\n");
+		goto remove_driver_statistics;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_rx_ring_size,
+				      "rx_ring_size", S_IRUSR | S_IWUSR,
+				      mvppnd_show_rx_ring_size,
+				      mvppnd_store_rx_ring_size);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create rx_ring_size sysfs file\n");
+		goto remove_napi_budget;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_if_create,
+				      "if_create", S_IWUSR, NULL,
+				      mvppnd_store_if_create);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create if_create sysfs file\n");
+		goto remove_rx_ring_size;
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_if_delete,
+				      "if_delete", S_IWUSR, NULL,
+				      mvppnd_store_if_delete);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create if_delete sysfs file\n");
+		goto remove_if_create;
+	}
+
+	if ((ppdev->pdev.pdev) &&
+	    (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2)) {
+		rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_atu_win,
+					      "atu_win", S_IRUSR | S_IWUSR,
+					      mvppnd_show_atu_win,
+					      mvppnd_store_atu_win);
+		if (rc) {
+			dev_err(ppdev->dev,
+				"Fail to create atu_win sysfs file\n");
+				goto remove_if_delete;
+		}
+
+		rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_mg,
+					      "mg", S_IRUSR | S_IWUSR,
+					      mvppnd_show_mg, mvppnd_store_mg);
+		if (rc) {
+			dev_err(ppdev->dev, "Fail to create mg sysfs file\n");
+			goto remove_atu_win;
+		}
+	}
+
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_tx_queue_size,
+				      "tx_queue_size", S_IRUSR | S_IWUSR,
+				      mvppnd_show_tx_queue_size,
+				      mvppnd_store_tx_queue_size);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create tx_queue_size sysfs file\n");
+		goto remove_mg;
+	}
+
+#ifdef MVPPND_DEBUG_REG
+	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_reg,
+				      "reg", S_IRUSR | S_IWUSR, NULL,
+				      mvppnd_store_reg);
+	if (rc) {
+		dev_err(ppdev->dev,
+			"Fail to create reg sysfs file\n");
+		goto remove_tx_queue_size;
+	}
+
+	goto out;
+
+remove_tx_queue_size:
+	if (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2)
+		sysfs_remove_file(&flow->ndev->dev.kobj,
+				  &ppdev->attr_tx_queue_size.attr);
+#else
+	goto out;
+#endif
+
+remove_mg:
+	if (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2)
+		sysfs_remove_file(&flow->ndev->dev.kobj,
+				  &ppdev->attr_mg.attr);
+remove_atu_win:
+	if (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2)
+		sysfs_remove_file(&flow->ndev->dev.kobj,
+				  &ppdev->attr_atu_win.attr);
+remove_if_delete:
+	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_if_delete.attr);
+
+remove_if_create:
+	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_if_create.attr);
+
+remove_rx_ring_size:
+	sysfs_remove_file(&flow->ndev->dev.kobj,
+			  &ppdev->attr_rx_ring_size.attr);
+
+remove_napi_budget:
+	sysfs_remove_file(&flow->ndev->dev.kobj,
+			  &ppdev->attr_napi_budget.attr);
+
+remove_driver_statistics:
+	sysfs_remove_file(&flow->ndev->dev.kobj,
+			  &ppdev->attr_driver_statistics.attr);
+
+remove_rx_zero_copy:
+	sysfs_remove_file(&flow->ndev->dev.kobj,
+			  &ppdev->attr_rx_zero_copy.attr);
+
+remove_max_pkt_sz:
+	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_max_pkt_sz.attr);
+
+remove_mg_win:
+	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_mg_win.attr);
+
+remove_tx_prio_queues:
+	sysfs_remove_file(&flow->ndev->dev.kobj,
+			  &ppdev->attr_tx_prio_queues.attr);
+
+remove_tx_queues:
+	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_tx_queues.attr);
+
+remove_tx_queue:
+	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_tx_queue.attr);
+
+remove_rx_queues_weight:
+	sysfs_remove_file(&flow->ndev->dev.kobj,
+			  &ppdev->attr_rx_queues_weight.attr);
+
+remove_rx_queues_napi:
+	sysfs_remove_file(&flow->ndev->dev.kobj,
+			  &ppdev->attr_rx_queues_napi.attr);
+
+remove_rx_queue:
+	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_rx_queues.attr);
+
+remove_rx_dsa_mask:
+	if (flow_id)
+		sysfs_remove_file(&flow->ndev->dev.kobj,
+				  &flow->attr_rx_dsa_mask.attr);
+
+remove_rx_dsa_val:
+	if (flow_id)
+		sysfs_remove_file(&flow->ndev->dev.kobj,
+				  &flow->attr_rx_dsa_val.attr);
+
+remove_tx_backlog:
+	sysfs_remove_file(&flow->ndev->dev.kobj, &flow->attr_tx_backlog.attr);
+
+remove_dsa:
+	sysfs_remove_file(&flow->ndev->dev.kobj, &flow->attr_tx_dsa.attr);
+
+remove_mac:
+	sysfs_remove_file(&flow->ndev->dev.kobj, &flow->attr_mac.attr);
+
+out:
+	return rc;
+}
+
+static void mvppnd_sysfs_remove_files(struct mvppnd_dev *ppdev, int flow_id)
+{
+	struct mvppnd_switch_flow *flow = ppdev->sdev.flows[flow_id];
+
+	sysfs_remove_file(&flow->ndev->dev.kobj, &flow->attr_tx_backlog.attr);
+	sysfs_remove_file(&flow->ndev->dev.kobj, &flow->attr_tx_dsa.attr);
+	sysfs_remove_file(&flow->ndev->dev.kobj, &flow->attr_mac.attr);
+
+	if (flow_id) {
+		sysfs_remove_file(&flow->ndev->dev.kobj,
+				  &flow->attr_rx_dsa_mask.attr);
+		sysfs_remove_file(&flow->ndev->dev.kobj,
+				  &flow->attr_rx_dsa_val.attr);
+		return;
+	}
+#ifdef MVPPND_DEBUG_REG
+	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_reg.attr);
+#endif
+	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_if_delete.attr);
+	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_if_create.attr);
+	sysfs_remove_file(&flow->ndev->dev.kobj,
+			  &ppdev->attr_rx_ring_size.attr);
+	sysfs_remove_file(&flow->ndev->dev.kobj,
+			  &ppdev->attr_napi_budget.attr);
+	sysfs_remove_file(&flow->ndev->dev.kobj,
+			  &ppdev->attr_driver_statistics.attr);
+	sysfs_remove_file(&flow->ndev->dev.kobj,
+			  &ppdev->attr_rx_zero_copy.attr);
+	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_max_pkt_sz.attr);
+	if ((ppdev->pdev.pdev) &&
+	    (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2)) {
+		sysfs_remove_file(&flow->ndev->dev.kobj,
+				  &ppdev->attr_mg_win.attr);
+		sysfs_remove_file(&flow->ndev->dev.kobj,
+				  &ppdev->attr_atu_win.attr);
+	}
+	sysfs_remove_file(&flow->ndev->dev.kobj,
+			  &ppdev->attr_tx_prio_queues.attr);
+	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_tx_queues.attr);
+	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_tx_queue.attr);
+	sysfs_remove_file(&flow->ndev->dev.kobj,
+			  &ppdev->attr_rx_queues_weight.attr);
+	sysfs_remove_file(&flow->ndev->dev.kobj,
+			  &ppdev->attr_rx_queues_napi.attr);
+	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_rx_queues.attr);
+}
+
+static void mvppnd_sysfs_set_mode(struct mvppnd_dev *ppdev, umode_t mode)
+{
+	struct kobject *kobj = &ppdev->sdev.flows[0]->ndev->dev.kobj;
+	int rc = 0;
+
+	rc += sysfs_chmod_file(kobj, &ppdev->attr_rx_ring_size.attr, mode);
+	rc += sysfs_chmod_file(kobj, &ppdev->attr_max_pkt_sz.attr, mode);
+	rc += sysfs_chmod_file(kobj, &ppdev->attr_rx_zero_copy.attr, mode);
+	rc += sysfs_chmod_file(kobj, &ppdev->attr_tx_queue.attr, mode);
+	rc += sysfs_chmod_file(kobj, &ppdev->attr_tx_queues.attr, mode);
+	rc += sysfs_chmod_file(kobj, &ppdev->attr_rx_queues.attr, mode);
+	rc += sysfs_chmod_file(kobj, &ppdev->attr_rx_queues_napi.attr, mode);
+
+	/*
+ 	 * We could be called also when driver goes down where we need to
+ 	 * un-register our netdev. During this un-registration the ndo_close is
+ 	 * called which in turn calls us.
+ 	 * The framework do not provides the information that the ndo_close was
+ 	 * called as part of un-registration so we need to rely on ourselves -
+ 	 * hence the ppdev->going_down.
+ 	 */
+	if (rc && !ppdev->going_down)
+		dev_err(ppdev->dev,
+			"Fail to change file attrs, driver is unstable now\n");
+}
+
+/*********** netdev utilities ******************************/
+static void mvppnd_stop_all_netdevs(struct mvppnd_dev *ppdev, bool going_down)
+{
+	int i;
+
+	for (i = 1; i < MAX_NETDEVS; i++)
+		if (ppdev->sdev.flows[i]) {
+			netif_tx_stop_all_queues(ppdev->sdev.flows[i]->ndev);
+			if (going_down) {
+				clear_bit(__LINK_STATE_START,
+					  &ppdev->sdev.flows[i]->ndev->state);
+				ppdev->sdev.flows[i]->ndev->flags &= ~IFF_UP;
+			}
+		}
+}
+
+/*
+ * A TX queue for each of the SDMA TX rings. XPS spreads the CPUs over them so
+ * each CPU posts to a ring of its own. It is set only when the number of
+ * rings changes, admin tuning is kept over a reopen.
+ */
+static int mvppnd_setup_netdev_txqs(struct mvppnd_dev *ppdev,
+				    struct net_device *dev)
+{
+	cpumask_var_t mask;
+	int i, cpu, rc;
+
+	if (dev->real_num_tx_queues == ppdev->num_txqs)
+		return 0;
+
+	rc = netif_set_real_num_tx_queues(dev, ppdev->num_txqs);
+	if (rc)
+		return rc;
+
+	if (!zalloc_cpumask_var(&mask, GFP_KERNEL))
+		return 0;
+
+	for (i = 0; i < ppdev->num_txqs; i++) {
+		cpumask_clear(mask);
+		for_each_online_cpu(cpu)
+			if ((cpu % ppdev->num_txqs) == i)
+				cpumask_set_cpu(cpu, mask);
+		netif_set_xps_queue(dev, mask, i);
+	}
+
+	free_cpumask_var(mask);
+
+	return 0;
+}
+
+/* Flows might be in the middle of a transmit on other CPUs */
+static void mvppnd_set_tx_ready(struct mvppnd_dev *ppdev, bool ready)
+{
+	struct mvppnd_txq *txq;
+	int i;
+
+	for (i = 0; i < ppdev->num_txqs; i++) {
+		txq = &ppdev->txqs[i];
+		spin_lock_bh(&txq->lock);
+		txq->stopped = false;
+		txq->ready = ready;
+		while (!ready && !list_empty(&txq->backlogs))
+			mvppnd_tx_purge_backlog(
+				list_first_entry(&txq->backlogs,
+						 struct mvppnd_tx_backlog,
+						 node));
+		spin_unlock_bh(&txq->lock);
+	}
+}
+
+/*********** tx functions ******************************/
+static void mvppnd_tx_dump_stall(struct mvppnd_dev *ppdev,
+				 struct mvppnd_txq *txq, size_t first,
+				 size_t last)
+{
+	pr_err("TX TOUT q %d first desc ptr %llx frst idx %lu bd sts %x addr %x wr idx %lu bd sts %x addr %x en_q %x vendor %x devid %x \n",
+		txq->queue,
+		txq->ring.ring_dma,
+		first,
+		txq->ring.descs[first]->cmd_sts,
+		txq->ring.descs[first]->buf_addr,
+		last,
+		txq->ring.descs[last]->cmd_sts,
+		txq->ring.descs[last]->buf_addr,
+		mvppnd_read_reg(ppdev, REG_ADDR_TX_QUEUE_CMD),
+		mvppnd_read_reg(ppdev, REG_ADDR_VENDOR),
+		mvppnd_read_reg(ppdev, REG_ADDR_DEVICE) );
+	pr_err(
+"rej %x LW %x NDP %x CTDP %x cur %x cfg %x glbl ctrl %x ext glbl ctrl %x lpbck %x\n",
+		mvppnd_read_reg(ppdev, 0x28F4 ),
+		mvppnd_read_reg(ppdev, 0x2604 + txq->queue*0x10),
+		mvppnd_read_reg(ppdev, 0x2608 + txq->queue*0x10),
+		mvppnd_read_reg(ppdev, 0x2684),
+		mvppnd_read_reg(ppdev, 0x26C0 + txq->queue*4),
+		mvppnd_read_reg(ppdev, 0x2800),
+		mvppnd_read_reg(ppdev, 0x58),
+		mvppnd_read_reg(ppdev, 0x5C),
+		mvppnd_read_reg(ppdev, 0x64)
+							);
+}
+
+/* Tail frame is still owned by SDMA, true if the ring didn't move for long */
+static bool mvppnd_tx_stalled(struct mvppnd_txq *txq)
+{
+	/* SDMA may have stopped at frames still waiting for the doorbell */
+	if (txq->doorbell)
+		return false;
+
+	return ktime_us_delta(ktime_get(), txq->progress) > TX_STALL_USEC;
+}
+
+/*
+ * The queue is stopped and restarted from the oldest frame SDMA still owns,
+ * that frame is sent again from its first descriptor. A frame which wedges
+ * the queue more than TX_STALL_RETRIES times is dropped, it is released by
+ * mvppnd_tx_reclaim as if sent. Called with the queue lock held.
+ */
+static void mvppnd_tx_recover(struct mvppnd_dev *ppdev, struct mvppnd_txq *txq)
+{
+	struct mvppnd_tx_frame *frame = NULL;
+	size_t first, last = 0;
+	int i;
+
+	mvppnd_disable_tx_queue_sync(ppdev, txq->queue);
+
+	/* SDMA may have finished some while it was stopping */
+	for (first = txq->clean_ptr; first != txq->ring.descs_ptr;
+	     first = cyclic_idx(first + frame->ndescs, TX_RING_SIZE)) {
+		frame = &txq->frames[first];
+		last = cyclic_idx(first + frame->ndescs - 1, TX_RING_SIZE);
+		if (txq->ring.descs[last]->cmd_sts & TX_CMD_BIT_OWN_SDMA)
+			break;
+	}
+
+	txq->progress = ktime_get();
+
+	if (first == txq->ring.descs_ptr) {
+		mvppnd_enable_queue(ppdev, REG_ADDR_TX_QUEUE_CMD, txq->queue);
+		return;
+	}
+
+	mvppnd_inc_stat(ppdev, STATS_TX_STALL_RECOVERIES, 1);
+	if (net_ratelimit())
+		mvppnd_tx_dump_stall(ppdev, txq, first, last);
+
+	if (++frame->recoveries > TX_STALL_RETRIES) {
+		for (i = 0; i < frame->ndescs; i++)
+			txq->ring.descs[cyclic_idx(first + i, TX_RING_SIZE)]->
+				cmd_sts &= ~TX_CMD_BIT_OWN_SDMA;
+		if (frame->bql_dev)
+			mvppnd_inc_flow_stat(frame->bql_dev,
+					     FLOW_STATS_TX_DROPPED, 1);
+		first = cyclic_idx(first + frame->ndescs, TX_RING_SIZE);
+	} else {
+		/* As in xmit_buf, the first descriptor is handed over last */
+		for (i = 1; i < frame->ndescs; i++)
+			txq->ring.descs[cyclic_idx(first + i, TX_RING_SIZE)]->
+				cmd_sts |= TX_CMD_BIT_OWN_SDMA;
+		wmb();
+		txq->ring.descs[first]->cmd_sts |= TX_CMD_BIT_OWN_SDMA;
+	}
+
+	/* Rewind, SDMA resumes from the frame or stops on the ring head */
+	mb();
+	mvppnd_write_tx_first_desc(ppdev, txq->queue, txq->ring.ring_dma +
+				   first * sizeof(*txq->ring.descs[0]));
+	mvppnd_enable_queue(ppdev, REG_ADDR_TX_QUEUE_CMD, txq->queue);
+}
+
+/* Hand the frames posted so far to SDMA, called with the queue lock held */
+static void mvppnd_tx_doorbell(struct mvppnd_dev *ppdev,
+			       struct mvppnd_txq *txq)
+{
+	if (!txq->doorbell)
+		return;
+
+	txq->doorbell = false;
+	mvppnd_inc_stat(ppdev, STATS_TX_DOORBELLS, 1);
+
+	/* Flash descriptors before enabling the queue */
+	mb();
+
+	/* Resume the queue in case SDMA already stopped at these frames */
+	mvppnd_enable_queue(ppdev, REG_ADDR_TX_QUEUE_CMD, txq->queue);
+}
+
+/* Ring the doorbell for what the last burst left pending */
+static void mvppnd_txq_flush(struct mvppnd_dev *ppdev, struct mvppnd_txq *txq)
+{
+	if (!READ_ONCE(txq->doorbell))
+		return;
+
+	spin_lock(&txq->lock);
+	if (txq->ready)
+		mvppnd_tx_doorbell(ppdev, txq);
+	spin_unlock(&txq->lock);
+}
+
+/* Frames sent from RX may have gone to any of the queues */
+static void mvppnd_tx_flush(struct mvppnd_dev *ppdev)
+{
+	int i;
+
+	for (i = 0; i < ppdev->num_txqs; i++)
+		mvppnd_txq_flush(ppdev, &ppdev->txqs[i]);
+}
+
+static void mvppnd_dsa_set_tc(u8 *dsa, u8 tc)
+{
+	dsa[TX_DSA_TC0_BYTE] &= ~TX_DSA_TC0_MASK;
+	dsa[TX_DSA_TC1_BYTE] &= ~TX_DSA_TC1_MASK;
+	dsa[TX_DSA_TC2_BYTE] &= ~TX_DSA_TC2_MASK;
+
+	if (tc & BIT(0))
+		dsa[TX_DSA_TC0_BYTE] |= TX_DSA_TC0_MASK;
+	if (tc & BIT(1))
+		dsa[TX_DSA_TC1_BYTE] |= TX_DSA_TC1_MASK;
+	if (tc & BIT(2))
+		dsa[TX_DSA_TC2_BYTE] |= TX_DSA_TC2_MASK;
+}
+
+static void mvppnd_dsa_set_vlan(u8 *dsa, u16 tci)
+{
+	u16 word = (dsa[TX_DSA_TCI_BYTE] << 8) | dsa[TX_DSA_TCI_BYTE + 1];
+
+	word = (word & ~TX_DSA_TCI_MASK) | (tci & TX_DSA_TCI_MASK);
+
+	dsa[TX_DSA_TAGGED_BYTE] |= TX_DSA_TAGGED_MASK;
+	dsa[TX_DSA_TCI_BYTE] = word >> 8;
+	dsa[TX_DSA_TCI_BYTE + 1] = word & 0xff;
+}
+
+/*
+ * Buffer is in the coherent block, a copy or a TSO header slot, where SDMA
+ * may read the CRC room behind the frame
+ */
+static bool mvppnd_tx_buf_has_crc_room(struct mvppnd_dev *ppdev,
+				       dma_addr_t dma)
+{
+	return (dma >= ppdev->coherent.buf.dma) &&
+	       (dma < ppdev->coherent.buf.dma + ppdev->coherent.buf.size);
+}
+
+/*
+ * Post a frame at the ring head and return without waiting for SDMA, the
+ * descriptors are reclaimed later by mvppnd_tx_reclaim. A tc other than -1
+ * overrides the traffic class of the flow's DSA template, a vlan other than
+ * -1 is the TCI the switch tags the frame with. Called with the queue lock
+ * held and with room for TX_MAX_FRAME_DESCS in the ring.
+ */
+static int mvppnd_xmit_buf(struct mvppnd_dev *ppdev, struct mvppnd_txq *txq,
+			   struct mvppnd_switch_flow *flow,
+			   struct mvppnd_dma_sg_buf *sgb,
+			   struct xsk_buff_pool *xsk_pool, int tc, int vlan,
+			   bool more)
+{
+	u8 *dsa = txq->dsa.virt + txq->ring.descs_ptr * DSA_SIZE;
+	struct mvppnd_tx_frame *frame;
+	size_t wr_ptr, wr_ptr_first;
+	size_t total_bytes = 0;
+	size_t size, offs;
+	bool next, crc_desc;
+	int data_ptr;
+	int ret;
+
+	/* The first buffer starts with the MACs, a frame has more than that */
+	if (!sgb->mappings[0] || (sgb->sizes[0] < ETH_ALEN * 2) ||
+	    ((sgb->sizes[0] == ETH_ALEN * 2) && !sgb->mappings[1]))
+		return -EINVAL;
+
+	wr_ptr = cyclic_idx(txq->ring.descs_ptr, TX_RING_SIZE);
+	wr_ptr_first = wr_ptr;
+
+	/* MACs, from where they are in the frame */
+	txq->ring.descs[wr_ptr]->buf_addr = sgb->mappings[0];
+	TX_DESC_SET_BYTE_CNT(txq->ring.descs[wr_ptr]->bc,
+			     ETH_ALEN * 2);
+	total_bytes += ETH_ALEN * 2;
+	/*
+	dev_dbg(&ppdev->pdev->dev, "MACs: desc %d, len %d (%ld), ptr 0x%llx\n",
+		wr_ptr, ETH_ALEN * 2, total_bytes, sgb->mappings[0]);
+	*/
+	cyclic_inc(&wr_ptr, TX_RING_SIZE);
+
+	/* DSA */
+	print_dsa(flow->ndev->name, "tx", (u8 *)flow->config_tx_dsa);
+	/* TC bits are in the first two words of the extended tag */
+	if (flow->config_tx_dsa_size < 8)
+		tc = -1;
+	if (flow->config_tx_dsa_size < 4)
+		vlan = -1;
+	if ((tc != -1) || (vlan != -1)) {
+		/* Edited in the frame's own slot, the template is shared */
+		memcpy(dsa, flow->config_tx_dsa, flow->config_tx_dsa_size);
+		if (tc != -1)
+			mvppnd_dsa_set_tc(dsa, tc);
+		if (vlan != -1)
+			mvppnd_dsa_set_vlan(dsa, vlan);
+		txq->ring.descs[wr_ptr]->buf_addr = txq->dsa.dma +
+						    wr_ptr_first * DSA_SIZE;
+	} else {
+		txq->ring.descs[wr_ptr]->buf_addr = ppdev->tx_dsa.dma +
+						    flow->flow_id * DSA_SIZE;
+	}
+	TX_DESC_SET_BYTE_CNT(txq->ring.descs[wr_ptr]->bc,
+			     flow->config_tx_dsa_size);
+	txq->ring.descs[wr_ptr]->cmd_sts = TX_CMD_BIT_OWN_SDMA |
+						      TX_CMD_BIT_CRC;
+	/*
+	dev_dbg(&ppdev->pdev->dev, "DSA : desc %d, len %d (%ld), ptr 0x%llx\n",
+		wr_ptr, DSA_SIZE, total_bytes, txq->ring.descs[wr_ptr]->buf_addr);
+	*/
+	total_bytes += flow->config_tx_dsa_size;
+	cyclic_inc(&wr_ptr, TX_RING_SIZE);
+
+	/* Data, what follows the MACs */
+	crc_desc = false;
+	data_ptr = 0;
+	offs = ETH_ALEN * 2;
+	if (sgb->sizes[0] == offs) {
+		data_ptr++;
+		offs = 0;
+	}
+	while (sgb->mappings[data_ptr]) {
+		/* We have more? */
+		next = (data_ptr < ARRAY_SIZE(sgb->mappings) - 1) &&
+		       sgb->mappings[data_ptr + 1];
+		/*
+		 * CRC is counted once, on the last buffer of the frame if it
+		 * is ours, else on a descriptor of its own as mappings end
+		 * right at the frame
+		 */
+		crc_desc = !next &&
+			   !mvppnd_tx_buf_has_crc_room(ppdev,
+						       sgb->mappings[data_ptr]);
+		size = sgb->sizes[data_ptr] - offs +
+		       ((next || crc_desc) ? 0 : CRC_SIZE);
+		txq->ring.descs[wr_ptr]->buf_addr =
+			sgb->mappings[data_ptr] + offs;
+		offs = 0;
+		TX_DESC_SET_BYTE_CNT(txq->ring.descs[wr_ptr]->bc,
+				     size);
+		total_bytes += size;
+		txq->ring.descs[wr_ptr]->cmd_sts =
+			TX_CMD_BIT_OWN_SDMA | TX_CMD_BIT_CRC;
+#ifdef MVPPND_DEBUG_DATA_PATH
+		dev_info(ppdev->dev,
+			"data: desc %ld, len %ld (%ld, %ld), ptr 0x%llx\n",
+			wr_ptr, size,
+			total_bytes - flow->config_tx_dsa_size, total_bytes,
+			txq->ring.descs[wr_ptr]->buf_addr);
+#endif
+
+		if (!next)
+			break;
+
+		data_ptr++;
+		cyclic_inc(&wr_ptr, TX_RING_SIZE);
+	}
+
+	if (crc_desc) {
+		cyclic_inc(&wr_ptr, TX_RING_SIZE);
+		txq->ring.descs[wr_ptr]->buf_addr = ppdev->tx_crc.dma;
+		TX_DESC_SET_BYTE_CNT(txq->ring.descs[wr_ptr]->bc, CRC_SIZE);
+		total_bytes += CRC_SIZE;
+		txq->ring.descs[wr_ptr]->cmd_sts =
+			TX_CMD_BIT_OWN_SDMA | TX_CMD_BIT_CRC;
+	}
+
+	/* Last descriptor - add last, Tx Buffer event once SDMA is done */
+	txq->ring.descs[wr_ptr]->cmd_sts |= TX_CMD_BIT_LAST |
+						       TX_CMD_BIT_EN_INTR;
+
+	ret = total_bytes - ETH_ALEN * 2 - flow->config_tx_dsa_size;
+
+	frame = &txq->frames[wr_ptr_first];
+	frame->ndescs = cyclic_idx((int)wr_ptr - (int)wr_ptr_first,
+				   TX_RING_SIZE) + 1;
+	frame->recoveries = 0;
+	frame->xsk_pool = xsk_pool;
+	frame->xsk_dropped = 0;
+	/* Stall time runs from here if nothing is ahead of the frame */
+	if (!txq->frames_inflight)
+		txq->progress = ktime_get();
+	frame->bytes = ret;
+	frame->bql_dev = xsk_pool ? NULL : flow->ndev;
+	txq->frames_inflight++;
+
+	cyclic_inc(&wr_ptr, TX_RING_SIZE);
+	txq->ring.descs_ptr = wr_ptr;
+	/* Taken whether the frame was copied or not, frames are 1:1 with slots */
+	cyclic_inc(&txq->copy_ptr, TX_COPY_SLOTS);
+
+	/*
+	 * SDMA stops at the first descriptor it does not own, so the rest of
+	 * the frame must be visible before the first one is handed over
+	 */
+	wmb();
+
+	/* We are ready, let's update the first descriptor - ownership, CRC &
+	   first */
+	txq->ring.descs[wr_ptr_first]->cmd_sts =
+		TX_CMD_BIT_OWN_SDMA | TX_CMD_BIT_CRC | TX_CMD_BIT_FIRST;
+	txq->doorbell = true;
+
+	/*
+	 * BQL accounts the frames the stack queued on the flow netdev. The
+	 * doorbell is deferred while more frames of the burst are coming,
+	 * unless BQL just stopped the queue.
+	 */
+	if (frame->bql_dev &&
+	    __netdev_tx_sent_queue(netdev_get_tx_queue(frame->bql_dev,
+						       txq->idx), ret, more))
+		mvppnd_tx_doorbell(ppdev, txq);
+
+#ifdef MVPPND_DEBUG_DATA_PATH
+	dev_info(ppdev->dev, "Total sent %d\n", ret);
+#endif
+
+	return ret;
+}
+
+/*
+ * LIMITATION: CPSS and mvEthDrv.ko are the two software components which
+ * access the interrupt tree on receiving an interrupt. When an event occurs,
+ * corresponding bit in the leaf node is set, all related bits leading
+ * up to the root are set accordingly and an interrupt is generated by the
+ * switch
+ *
+ * Only when software processes and acknowledges the interrupt for e.g.
+ * by reading the leaf node which is read-on-clear, all related bits leading
+ * up to the root are cleared allowing next interrupt to be generated
+ *
+ * If a bit in MG0 Tree 0 Receive_SDMA_Interrupt_Cause1 is set indicating
+ * packet received in RX-Q before CPSS processes and acknowledges an
+ * interrupt meant for CPSS, RX-Q interrupt is not generated
+ *
+ * This is a race condition seen due to two software components accessing
+ * the interrupt tree and processing the interrupts independently
+ *
+ * WORKAROUND:
+ * 0x1D002890 = Receive SDMA Interrupt Cause1 (Receive_SDMA_Interrupt_Cause1)
+ *
+ * This is RX SDMA Int Cause register from MG0 Tree 1 which needs to be
+ * read to clear the race condition and enable generation of next interrupt.
+ * If mvEthDrv.ko misses the interrupt due to race condition leading to
+ * Receive_SDMA_Interrupt_Cause1 remaining set, CPSS takes of reading it
+ * clearing the race condition
+ *
+ * CPSS uses MG0 Tree 0 and mvEthDrv.ko uses MG0 Tree 1
+ *
+ * LIMITATION: Currently CPSS is configuring the interrupt tree in the switch to
+ * connect only MG0 Tree 1 to MG0 Tree 0. Tree 1 of no other MG is configure
+ * this way
+ *
+ * NOTE: We do connect Tree 1 of Tile 2 for devices with 4 tiles. Tile 2 is
+ * connected by Tree 1
+ */
+static irqreturn_t mvppnd_isr(int irq, void *data)
+{
+	struct mvppnd_dev *ppdev = (struct mvppnd_dev *)data;
+	struct mvppnd_napi *rx_napi;
+	u32 en_mask = 0;
+	int i;
+
+	mvppnd_inc_stat(ppdev, STATS_INTERRUPTS, 1);
+
+	/*
+	 * TX completion, events stay masked until the TX NAPI context is
+	 * done. The cause is read-on-clear, a lost event is covered by the
+	 * safety poll.
+	 */
+	if (ppdev->tx_napi && (mvppnd_read_reg(ppdev, REG_ADDR_TX_CAUSE_0) &
+			       mvppnd_tx_queue_intr_bits(ppdev))) {
+		mvppnd_inc_stat(ppdev, STATS_TX_INTERRUPTS, 1);
+		mvppnd_dis_tx_queue_intr(ppdev);
+		napi_schedule(&ppdev->tx_napi->napi);
+	}
+
+	mvppnd_dis_rx_queues_intr(ppdev, 1, ppdev->rx_queues_mask);
+	/*
+	* Read Receive_SDMA_Interrupt_Cause1 to clear the register
+	*/
+	mvppnd_read_reg(ppdev, REG_ADDR_RX_CAUSE_1);
+
+	/*
+	 * As mentioned in the note above, Receive_SDMA_Interrupt_Cause1 is read
+	 * from multiple places to address the race condition. At this point
+	 * Receive_SDMA_Interrupt_Cause1 may or may not hold value indicating
+	 * RX-Q interrupt. Hence instead of relying on
+	 * Receive_SDMA_Interrupt_Cause1, for each NAPI context which isn't
+	 * scheduled, we check the RX-Q ownership bit to check if the ownership
+	 * is with CPU and if it is, we schedule this NAPI to read the packets.
+	 * Queues of a scheduled context stay masked, its poll unmasks them.
+	 */
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
+		rx_napi = &ppdev->rx_napi[i];
+		if (!rx_napi->queues_mask ||
+		    test_bit(NAPI_STATE_SCHED, &rx_napi->napi.state) ||
+		    hrtimer_active(&rx_napi->coal_timer))
+			continue;
+
+		if (mvppnd_rings_empty(ppdev, rx_napi->queues_mask)) {
+			en_mask |= rx_napi->queues_mask;
+			continue;
+		}
+
+		mvppnd_inc_stat(ppdev, STATS_RX_TREE1_INTERRUPTS, 1);
+
+		/* Let more frames gather, queues stay masked meanwhile */
+		if (rx_napi->coal_usecs &&
+		    !mvppnd_rx_frames_pending(ppdev, rx_napi->queues_mask,
+					      rx_napi->coal_frames)) {
+			mvppnd_inc_stat(ppdev, STATS_RX_COAL_DEFERRALS, 1);
+			hrtimer_start(&rx_napi->coal_timer,
+				      ns_to_ktime(rx_napi->coal_usecs *
+						  NSEC_PER_USEC),
+				      HRTIMER_MODE_REL);
+			continue;
+		}
+
+		napi_schedule(&rx_napi->napi);
+	}
+
+	if (en_mask) {
+		mvppnd_en_rx_queues_intr(ppdev, 1, en_mask);
+		/*
+		 * Read Receive_SDMA_Interrupt_Cause1 to clear the register
+		 */
+		mvppnd_read_reg(ppdev, REG_ADDR_RX_CAUSE_1);
+	}
+
+	return IRQ_HANDLED;
+}
+
+int mvppnd_emulate_rx(struct net_device *ndev, u8 *dsa, char *data,
+		      size_t data_len, u8 queue)
+{
+	struct mvppnd_switch_flow *flow = netdev_priv(ndev);
+	struct mvppnd_dev *ppdev = flow->ppdev;
+	struct mvppnd_hw_desc *desc;
+	unsigned int buff_size;
+	unsigned char *buff;
+	u32 rx_first_desc;
+
+	if ((queue > NUM_OF_RX_QUEUES) || (queue < 0))
+		return -EINVAL;
+
+	rx_first_desc = mvppnd_read_rx_first_desc(ppdev, queue);
+	desc = (struct mvppnd_hw_desc *)phys_to_virt(rx_first_desc);
+	if ((desc->cmd_sts & RX_CMD_BIT_OWN_SDMA) != RX_CMD_BIT_OWN_SDMA)
+		return 0; /* no place on ring - drop */
+
+	buff = phys_to_virt(desc->buf_addr);
+
+	buff_size = 0;
+
+	memcpy(buff, data, ETH_ALEN * 2);
+	buff += ETH_ALEN * 2;
+	data += ETH_ALEN * 2;
+	buff_size += ETH_ALEN * 2;
+
+	memcpy(buff, dsa, DSA_SIZE);
+	buff += DSA_SIZE;
+	buff_size += DSA_SIZE;
+
+	memcpy(buff, data, data_len - ETH_ALEN * 2);
+	buff += (data_len - ETH_ALEN * 2);
+	buff_size += (data_len - ETH_ALEN * 2);
+
+	memset(buff, 0, CRC_SIZE);
+	buff_size += CRC_SIZE;
+
+	RX_DESC_SET_BYTE_CNT(desc->bc, buff_size);
+	desc->cmd_sts = (desc->cmd_sts & ~RX_CMD_BIT_OWN_SDMA) |
+			RX_CMD_BIT_FIRST | RX_CMD_BIT_LAST;
+
+	mvppnd_write_rx_first_desc(ppdev, queue, desc->next_desc_ptr);
+
+	mvppnd_isr(ppdev->irq, (void *)ppdev);
+
+	return buff_size;
+}
+EXPORT_SYMBOL(mvppnd_emulate_rx);
+
+static u32 mvppnd_tx_free_descs(struct mvppnd_txq *txq)
+{
+	/* One descriptor is kept free so head never catches up with tail */
+	return cyclic_idx((int)READ_ONCE(txq->clean_ptr) -
+			  (int)READ_ONCE(txq->ring.descs_ptr) - 1,
+			  TX_RING_SIZE);
+}
+
+/* No room for another frame of the worst case size, TSO ones included */
+static bool mvppnd_tx_ring_full(struct mvppnd_txq *txq)
+{
+	return mvppnd_tx_free_descs(txq) < TX_TSO_MAX_DESCS;
+}
+
+static bool mvppnd_tx_inflight(struct mvppnd_txq *txq)
+{
+	return READ_ONCE(txq->clean_ptr) !=
+	       READ_ONCE(txq->ring.descs_ptr);
+}
+
+/*
+ * Release frames SDMA is done with, from the ring tail up to the first one it
+ * still owns. With force the queue is already disabled and everything left
+ * is released. Called with the queue lock held.
+ */
+static void mvppnd_tx_reclaim(struct mvppnd_dev *ppdev,
+			      struct mvppnd_txq *txq, bool force)
+{
+	struct xsk_buff_pool *xsk_pool = NULL;
+	struct net_device *bql_dev = NULL;
+	unsigned int bql_pkts = 0, bql_bytes = 0;
+	struct mvppnd_tx_frame *frame;
+	bool stalled = false;
+	size_t first, last;
+	u32 xsk_done = 0;
+	u32 done = 0;
+
+	while (mvppnd_tx_inflight(txq)) {
+		first = txq->clean_ptr;
+		frame = &txq->frames[first];
+		last = cyclic_idx(first + frame->ndescs - 1, TX_RING_SIZE);
+
+		if (!force && (txq->ring.descs[last]->cmd_sts &
+			       TX_CMD_BIT_OWN_SDMA)) {
+			stalled = !done && mvppnd_tx_stalled(txq);
+			break;
+		}
+		done++;
+
+#ifdef MVPPND_XSK
+		/* UMEM frames go back to the socket only once SDMA is done */
+		if (frame->xsk_pool != xsk_pool) {
+			if (xsk_done)
+				xsk_tx_completed(xsk_pool, xsk_done);
+			xsk_pool = frame->xsk_pool;
+			xsk_done = 0;
 		}
+		if (xsk_pool)
+			xsk_done += 1 + frame->xsk_dropped;
+		/* No longer the socket's latest, see mvppnd_xsk_tx_drop */
+		frame->xsk_pool = NULL;
+#endif
 
-		rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_mg,
-					      "mg", S_IRUSR | S_IWUSR,
-					      mvppnd_show_mg, mvppnd_store_mg);
-		if (rc) {
-			dev_err(ppdev->dev, "Fail to create mg sysfs file\n");
-			goto remove_atu_win;
+		/* Consecutive frames of a flow are completed together */
+		if (frame->bql_dev != bql_dev) {
+			if (bql_pkts)
+				netdev_tx_completed_queue(
+					netdev_get_tx_queue(bql_dev, txq->idx),
+					bql_pkts, bql_bytes);
+			bql_dev = frame->bql_dev;
+			bql_pkts = 0;
+			bql_bytes = 0;
+		}
+		if (bql_dev) {
+			bql_pkts++;
+			bql_bytes += frame->bytes;
 		}
-	}
 
-	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_tx_queue_size,
-				      "tx_queue_size", S_IRUSR | S_IWUSR,
-				      mvppnd_show_tx_queue_size,
-				      mvppnd_store_tx_queue_size);
-	if (rc) {
-		dev_err(ppdev->dev,
-			"Fail to create tx_queue_size sysfs file\n");
-		goto remove_mg;
-	}
+		if (frame->head_mapped || frame->frags_mapped)
+			mvppnd_unmap_tx_frame(ppdev, frame,
+					      txq->ring.buffs[first]);
+		if (frame->skb) {
+			dev_consume_skb_any(frame->skb);
+			frame->skb = NULL;
+		}
 
-#ifdef MVPPND_DEBUG_REG
-	rc = mvppnd_sysfs_create_file(flow->ndev, &ppdev->attr_reg,
-				      "reg", S_IRUSR | S_IWUSR, NULL,
-				      mvppnd_store_reg);
-	if (rc) {
-		dev_err(ppdev->dev,
-			"Fail to create reg sysfs file\n");
-		goto remove_tx_queue_size;
+		txq->frames_inflight--;
+		WRITE_ONCE(txq->clean_ptr,
+			   cyclic_idx(first + frame->ndescs, TX_RING_SIZE));
 	}
 
-	goto out;
-
-remove_tx_queue_size:
-	if (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2)
-		sysfs_remove_file(&flow->ndev->dev.kobj,
-				  &ppdev->attr_tx_queue_size.attr);
-#else
-	goto out;
+	if (bql_pkts)
+		netdev_tx_completed_queue(netdev_get_tx_queue(bql_dev,
+							      txq->idx),
+					  bql_pkts, bql_bytes);
+#ifdef MVPPND_XSK
+	if (xsk_done)
+		xsk_tx_completed(xsk_pool, xsk_done);
 #endif
 
-remove_mg:
-	if (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2)
-		sysfs_remove_file(&flow->ndev->dev.kobj,
-				  &ppdev->attr_mg.attr);
-remove_atu_win:
-	if (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2)
-		sysfs_remove_file(&flow->ndev->dev.kobj,
-				  &ppdev->attr_atu_win.attr);
-remove_if_delete:
-	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_if_delete.attr);
-
-remove_if_create:
-	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_if_create.attr);
+	if (done)
+		txq->progress = ktime_get();
+	else if (stalled)
+		mvppnd_tx_recover(ppdev, txq);
+}
 
-remove_rx_ring_size:
-	sysfs_remove_file(&flow->ndev->dev.kobj,
-			  &ppdev->attr_rx_ring_size.attr);
+/*
+ * Frames in flight are not completed anymore to a netdev or a pool which is
+ * going away
+ */
+static void mvppnd_tx_forget(struct mvppnd_dev *ppdev, struct net_device *dev,
+			     struct xsk_buff_pool *pool)
+{
+	struct mvppnd_tx_frame *frame;
+	struct mvppnd_txq *txq;
+	size_t idx;
+	int i;
 
-remove_napi_budget:
-	sysfs_remove_file(&flow->ndev->dev.kobj,
-			  &ppdev->attr_napi_budget.attr);
+	for (i = 0; i < NUM_OF_TX_QUEUES; i++) {
+		txq = &ppdev->txqs[i];
+		spin_lock_bh(&txq->lock);
+		if (!txq->frames)
+			goto next;
+
+		mvppnd_tx_reclaim(ppdev, txq, false);
+		for (idx = txq->clean_ptr; idx != txq->ring.descs_ptr;
+		     idx = cyclic_idx(idx + frame->ndescs, TX_RING_SIZE)) {
+			frame = &txq->frames[idx];
+			if (dev && (frame->bql_dev == dev))
+				frame->bql_dev = NULL;
+			if (pool && (frame->xsk_pool == pool))
+				frame->xsk_pool = NULL;
+		}
+next:
+		spin_unlock_bh(&txq->lock);
+	}
+}
 
-remove_driver_statistics:
-	sysfs_remove_file(&flow->ndev->dev.kobj,
-			  &ppdev->attr_driver_statistics.attr);
+/*
+ * Ring is full, frames of the flows wait in their backlogs until completion
+ * makes room, see mvppnd_tx_drr
+ */
+static void mvppnd_stop_txq(struct mvppnd_dev *ppdev, struct mvppnd_txq *txq)
+{
+	/* No frame with the doorbell is coming until there is room */
+	mvppnd_tx_doorbell(ppdev, txq);
 
-remove_max_pkt_sz:
-	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_max_pkt_sz.attr);
+	txq->stopped = true;
+}
 
-remove_mg_win:
-	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_mg_win.attr);
+static void mvppnd_wake_txq(struct mvppnd_dev *ppdev, struct mvppnd_txq *txq)
+{
+	txq->stopped = false;
 
-remove_tx_queue:
-	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_tx_queue.attr);
+#ifdef MVPPND_XSK
+	/* AF_XDP TX stops on a full ring as well */
+	schedule_work(&ppdev->xsk_tx_work);
+#endif
+}
 
-remove_rx_queue:
-	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_rx_queues.attr);
+/*
+ * Queue the frame of a flow behind the full ring, the flow's TX queue is
+ * stopped once the backlog reaches TX_FLOW_BACKLOG. Frames sent from RX and
+ * by hooks ignore it, they are dropped at twice that. Called with the queue
+ * lock held, returns true if the backlog holds the skb.
+ */
+static bool mvppnd_tx_backlog_skb(struct mvppnd_txq *txq,
+				  struct mvppnd_switch_flow *flow,
+				  struct sk_buff *skb)
+{
+	struct mvppnd_tx_backlog *bl = &flow->tx_backlog[txq->idx];
 
-remove_rx_dsa_mask:
-	if (flow_id)
-		sysfs_remove_file(&flow->ndev->dev.kobj,
-				  &flow->attr_rx_dsa_mask.attr);
+	if (unlikely(skb_queue_len(&bl->skbs) >= TX_FLOW_BACKLOG * 2)) {
+		bl->dropped++;
+		mvppnd_inc_flow_stat(flow->ndev, FLOW_STATS_TX_DROPPED, 1);
+		return false;
+	}
 
-remove_rx_dsa_val:
-	if (flow_id)
-		sysfs_remove_file(&flow->ndev->dev.kobj,
-				  &flow->attr_rx_dsa_val.attr);
+	__skb_queue_tail(&bl->skbs, skb);
+	bl->backlogged++;
 
-remove_dsa:
-	sysfs_remove_file(&flow->ndev->dev.kobj, &flow->attr_tx_dsa.attr);
+	if (list_empty(&bl->node)) {
+		bl->deficit = TX_DRR_QUANTUM;
+		list_add_tail(&bl->node, &txq->backlogs);
+	}
 
-remove_mac:
-	sysfs_remove_file(&flow->ndev->dev.kobj, &flow->attr_mac.attr);
+	if (!bl->stopped && (skb_queue_len(&bl->skbs) >= TX_FLOW_BACKLOG)) {
+		bl->stopped = true;
+		netif_stop_subqueue(flow->ndev, txq->idx);
+	}
 
-out:
-	return rc;
+	return true;
 }
 
-static void mvppnd_sysfs_remove_files(struct mvppnd_dev *ppdev, int flow_id)
+static void mvppnd_tx_purge_backlog(struct mvppnd_tx_backlog *bl)
 {
-	struct mvppnd_switch_flow *flow = ppdev->sdev.flows[flow_id];
+	bl->dropped += skb_queue_len(&bl->skbs);
+	mvppnd_inc_flow_stat(bl->flow->ndev, FLOW_STATS_TX_DROPPED,
+			     skb_queue_len(&bl->skbs));
+	__skb_queue_purge(&bl->skbs);
+	list_del_init(&bl->node);
+	bl->stopped = false;
+}
 
-	sysfs_remove_file(&flow->ndev->dev.kobj, &flow->attr_tx_dsa.attr);
-	sysfs_remove_file(&flow->ndev->dev.kobj, &flow->attr_mac.attr);
+/* Flow is going down, drop what it left waiting for the rings */
+static void mvppnd_tx_purge_flow(struct mvppnd_dev *ppdev,
+				 struct mvppnd_switch_flow *flow)
+{
+	struct mvppnd_txq *txq;
+	int i;
 
-	if (flow_id) {
-		sysfs_remove_file(&flow->ndev->dev.kobj,
-				  &flow->attr_rx_dsa_mask.attr);
-		sysfs_remove_file(&flow->ndev->dev.kobj,
-				  &flow->attr_rx_dsa_val.attr);
-		return;
+	for (i = 0; i < NUM_OF_TX_QUEUES; i++) {
+		txq = &ppdev->txqs[i];
+		spin_lock_bh(&txq->lock);
+		mvppnd_tx_purge_backlog(&flow->tx_backlog[i]);
+		spin_unlock_bh(&txq->lock);
 	}
-#ifdef MVPPND_DEBUG_REG
-	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_reg.attr);
-#endif
-	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_if_delete.attr);
-	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_if_create.attr);
-	sysfs_remove_file(&flow->ndev->dev.kobj,
-			  &ppdev->attr_rx_ring_size.attr);
-	sysfs_remove_file(&flow->ndev->dev.kobj,
-			  &ppdev->attr_napi_budget.attr);
-	sysfs_remove_file(&flow->ndev->dev.kobj,
-			  &ppdev->attr_driver_statistics.attr);
-	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_max_pkt_sz.attr);
-	if ((ppdev->pdev.pdev) &&
-	    (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2)) {
-		sysfs_remove_file(&flow->ndev->dev.kobj,
-				  &ppdev->attr_mg_win.attr);
-		sysfs_remove_file(&flow->ndev->dev.kobj,
-				  &ppdev->attr_atu_win.attr);
+}
+
+/*
+ * Feed the ring from the flow backlogs, deficit round robin with a quantum
+ * of TX_DRR_QUANTUM bytes. A flow is woken once its backlog is down to half.
+ * Called with the queue lock held.
+ */
+static void mvppnd_tx_drr(struct mvppnd_dev *ppdev, struct mvppnd_txq *txq)
+{
+	struct mvppnd_tx_backlog *bl;
+	struct sk_buff *skb;
+
+	while (txq->ready && !list_empty(&txq->backlogs) &&
+	       !mvppnd_tx_ring_full(txq)) {
+		bl = list_first_entry(&txq->backlogs, struct mvppnd_tx_backlog,
+				      node);
+		skb = skb_peek(&bl->skbs);
+		if (skb->len > bl->deficit) {
+			bl->deficit += TX_DRR_QUANTUM;
+			list_move_tail(&bl->node, &txq->backlogs);
+			continue;
+		}
+
+		__skb_unlink(skb, &bl->skbs);
+		bl->deficit -= skb->len;
+		if (skb_queue_empty(&bl->skbs))
+			list_del_init(&bl->node);
+
+		if (!mvppnd_transmit_skb(ppdev, txq, bl->flow, skb, true))
+			dev_kfree_skb_any(skb);
+
+		if (bl->stopped &&
+		    (skb_queue_len(&bl->skbs) <= TX_FLOW_BACKLOG / 2)) {
+			bl->stopped = false;
+			if (bl->flow->up)
+				netif_wake_subqueue(bl->flow->ndev, txq->idx);
+		}
 	}
-	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_tx_queue.attr);
-	sysfs_remove_file(&flow->ndev->dev.kobj, &ppdev->attr_rx_queues.attr);
+
+	if (txq->ready)
+		mvppnd_tx_doorbell(ppdev, txq);
 }
 
-static void mvppnd_sysfs_set_mode(struct mvppnd_dev *ppdev, umode_t mode)
+static bool mvppnd_txq_pending(struct mvppnd_txq *txq)
 {
-	struct kobject *kobj = &ppdev->sdev.flows[0]->ndev->dev.kobj;
-	int rc = 0;
+	return mvppnd_tx_inflight(txq) || READ_ONCE(txq->stopped) ||
+	       !list_empty(&txq->backlogs);
+}
 
-	rc += sysfs_chmod_file(kobj, &ppdev->attr_rx_ring_size.attr, mode);
-	rc += sysfs_chmod_file(kobj, &ppdev->attr_max_pkt_sz.attr, mode);
-	rc += sysfs_chmod_file(kobj, &ppdev->attr_tx_queue.attr, mode);
-	rc += sysfs_chmod_file(kobj, &ppdev->attr_rx_queues.attr, mode);
+/* Any of the queues has frames to reclaim or backlogs to serve */
+static bool mvppnd_tx_pending(struct mvppnd_dev *ppdev)
+{
+	int i;
 
-	/*
- 	 * We could be called also when driver goes down where we need to
- 	 * un-register our netdev. During this un-registration the ndo_close is
- 	 * called which in turn calls us.
- 	 * The framework do not provides the information that the ndo_close was
- 	 * called as part of un-registration so we need to rely on ourselves -
- 	 * hence the ppdev->going_down.
- 	 */
-	if (rc && !ppdev->going_down)
-		dev_err(ppdev->dev,
-			"Fail to change file attrs, driver is unstable now\n");
+	for (i = 0; i < ppdev->num_txqs; i++)
+		if (mvppnd_txq_pending(&ppdev->txqs[i]))
+			return true;
+
+	return false;
 }
 
-/*********** netdev utilities ******************************/
-static void mvppnd_stop_all_netdevs(struct mvppnd_dev *ppdev, bool going_down)
+/* TX completion of all the queues, called from NAPI */
+static void mvppnd_tx_complete(struct mvppnd_dev *ppdev)
 {
+	struct mvppnd_txq *txq;
 	int i;
 
-	for (i = 1; i < MAX_NETDEVS; i++)
-		if (ppdev->sdev.flows[i]) {
-			netif_stop_queue(ppdev->sdev.flows[i]->ndev);
-			if (going_down) {
-				clear_bit(__LINK_STATE_START,
-					  &ppdev->sdev.flows[i]->ndev->state);
-				ppdev->sdev.flows[i]->ndev->flags &= ~IFF_UP;
-			}
+	for (i = 0; i < ppdev->num_txqs; i++) {
+		txq = &ppdev->txqs[i];
+		if (!mvppnd_txq_pending(txq))
+			continue;
+
+		spin_lock(&txq->lock);
+		if (txq->ready) {
+			mvppnd_tx_reclaim(ppdev, txq, false);
+			mvppnd_tx_drr(ppdev, txq);
+			if (txq->stopped && !mvppnd_tx_ring_full(txq))
+				mvppnd_wake_txq(ppdev, txq);
 		}
+		spin_unlock(&txq->lock);
+	}
 }
 
-/*********** tx functions ******************************/
-static int mvppnd_xmit_buf(struct mvppnd_dev *ppdev,
-			   struct mvppnd_switch_flow *flow, const char *macs,
-			   struct mvppnd_dma_sg_buf *sgb)
+/* TX is reclaimed from NAPI, one context serves it when RX is idle */
+static void mvppnd_schedule_tx_napi(struct mvppnd_dev *ppdev)
 {
-	bool sdma_took, wait_too_long;
-	size_t wr_ptr, wr_ptr_first;
-	size_t total_bytes = 0;
-	u32 tmp_next_desc_ptr; /* TODO: Working in 'list' mode */
-	unsigned long jiffs; /* Wait for SDMA to take the desc */
-	int data_ptr;
-	int ret;
+	if (ppdev->tx_napi)
+		napi_schedule(&ppdev->tx_napi->napi);
+}
 
-	if (!sgb->mappings[0])
-		return -EINVAL;
+/* skb->priority, else the IP precedence of its DSCP */
+static u8 mvppnd_skb_prio(struct sk_buff *skb)
+{
+	int offs = skb_network_offset(skb);
 
-	wr_ptr = cyclic_idx(ppdev->tx_queue.ring.descs_ptr, TX_RING_SIZE);
-	wr_ptr_first = wr_ptr;
+	if (skb->priority)
+		return skb->priority % NUM_OF_TX_PRIOS;
 
-	/* MAC */
-	memcpy(ppdev->mac.virt, macs, ETH_ALEN * 2);
-	ppdev->tx_queue.ring.descs[wr_ptr]->buf_addr = ppdev->mac.dma;
-	TX_DESC_SET_BYTE_CNT(ppdev->tx_queue.ring.descs[wr_ptr]->bc,
-			     ETH_ALEN * 2);
-	total_bytes += ETH_ALEN * 2;
-	/*
-	dev_dbg(&ppdev->pdev->dev, "MACs: desc %d, len %d (%ld), ptr 0x%llx\n",
-		wr_ptr, ETH_ALEN * 2, total_bytes, ppdev->mac.dma);
-	*/
-	cyclic_inc(&wr_ptr, TX_RING_SIZE);
+	switch (vlan_get_protocol(skb)) {
+	case htons(ETH_P_IP):
+		if (skb_headlen(skb) < offs + sizeof(struct iphdr))
+			break;
+		return ipv4_get_dsfield(ip_hdr(skb)) >> 5;
+	case htons(ETH_P_IPV6):
+		if (skb_headlen(skb) < offs + sizeof(struct ipv6hdr))
+			break;
+		return ipv6_get_dsfield(ipv6_hdr(skb)) >> 5;
+	}
 
-	/* DSA */
-	print_dsa(flow->ndev->name, "tx", (u8 *)flow->config_tx_dsa);
-	memcpy(ppdev->dsa.virt, flow->config_tx_dsa, flow->config_tx_dsa_size);
-	ppdev->tx_queue.ring.descs[wr_ptr]->buf_addr = ppdev->dsa.dma;
-	TX_DESC_SET_BYTE_CNT(ppdev->tx_queue.ring.descs[wr_ptr]->bc,
-			     flow->config_tx_dsa_size);
-	ppdev->tx_queue.ring.descs[wr_ptr]->cmd_sts = TX_CMD_BIT_OWN_SDMA |
-						      TX_CMD_BIT_CRC;
-	/*
-	dev_dbg(&ppdev->pdev->dev, "DSA : desc %d, len %d (%ld), ptr 0x%llx\n",
-		wr_ptr, DSA_SIZE, total_bytes, ppdev->dsa.dma);
-	*/
-	total_bytes += flow->config_tx_dsa_size;
-	cyclic_inc(&wr_ptr, TX_RING_SIZE);
+	return 0;
+}
 
-	/* Data */
-	data_ptr = 0;
-	while (sgb->mappings[data_ptr]) {
-		ppdev->tx_queue.ring.descs[wr_ptr]->buf_addr =
-			sgb->mappings[data_ptr];
-		sgb->sizes[data_ptr] += CRC_SIZE;
-		TX_DESC_SET_BYTE_CNT(ppdev->tx_queue.ring.descs[wr_ptr]->bc,
-				     sgb->sizes[data_ptr]);
-		total_bytes += sgb->sizes[data_ptr];
-		ppdev->tx_queue.ring.descs[wr_ptr]->cmd_sts =
-			TX_CMD_BIT_OWN_SDMA | TX_CMD_BIT_CRC;
-#ifdef MVPPND_DEBUG_DATA_PATH
-		dev_info(ppdev->dev,
-			"data: desc %ld, len %ld (%ld, %ld), ptr 0x%llx\n",
-			wr_ptr, sgb->sizes[data_ptr],
-			total_bytes - flow->config_tx_dsa_size, total_bytes,
-			sgb->mappings[data_ptr]);
+/* Priorities with a TX queue of their own get a matching DSA TC */
+static int mvppnd_skb_tc(struct mvppnd_dev *ppdev, struct sk_buff *skb)
+{
+	u8 prio = mvppnd_skb_prio(skb);
+
+	return (READ_ONCE(ppdev->tx_prio_txq[prio]) != -1) ? prio : -1;
+}
+
+/* TCI of an 802.1Q tag the stack left for the DSA to carry, -1 for none */
+static int mvppnd_skb_vlan(struct sk_buff *skb)
+{
+	return skb_vlan_tag_present(skb) ? skb_vlan_tag_get(skb) : -1;
+}
+
+/*
+ * Mapped priorities go to the TX queue of their SDMA queue so control
+ * traffic is not queued behind bulk, the rest is left to XPS
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,2,0)
+static u16 mvppnd_select_queue(struct net_device *dev, struct sk_buff *skb,
+			       struct net_device *sb_dev)
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+static u16 mvppnd_select_queue(struct net_device *dev, struct sk_buff *skb,
+			       struct net_device *sb_dev,
+			       select_queue_fallback_t fallback)
+#else
+static u16 mvppnd_select_queue(struct net_device *dev, struct sk_buff *skb,
+			       void *accel_priv,
+			       select_queue_fallback_t fallback)
 #endif
+{
+	struct mvppnd_switch_flow *flow = netdev_priv(dev);
+	int txq = READ_ONCE(flow->ppdev->tx_prio_txq[mvppnd_skb_prio(skb)]);
 
-		data_ptr++;
-		/* We have more? */
-		if ((data_ptr < ARRAY_SIZE(sgb->mappings) - 1) &&
-		     sgb->mappings[data_ptr])
-			cyclic_inc(&wr_ptr, TX_RING_SIZE);
-		else
-			break;
-	}
+	if ((txq != -1) && (txq < dev->real_num_tx_queues))
+		return txq;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,2,0)
+	return netdev_pick_tx(dev, skb, sb_dev);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+	return fallback(dev, skb, sb_dev);
+#else
+	return fallback(dev, skb);
+#endif
+}
 
-	/* Last descriptor - add last */
-	ppdev->tx_queue.ring.descs[wr_ptr]->cmd_sts |= TX_CMD_BIT_LAST;
-	/* TODO: For some reason ring does not work so for now let's use list */
-	tmp_next_desc_ptr = ppdev->tx_queue.ring.descs[wr_ptr]->next_desc_ptr;
-	ppdev->tx_queue.ring.descs[wr_ptr]->next_desc_ptr = 0;
+#ifdef MVPPND_TSO
+/*
+ * Descriptors of a TSO frame, MAC, DSA, header and CRC per segment plus
+ * payload
+ */
+static unsigned int mvppnd_tso_descs(struct sk_buff *skb)
+{
+	return skb_shinfo(skb)->gso_segs * 5 + skb_shinfo(skb)->nr_frags;
+}
 
-	mvppnd_write_tx_first_desc(ppdev, ppdev->tx_queue.ring.ring_dma);
+/*
+ * Frames which don't fit the ring at once, have payload we can't map or
+ * headers bigger than TX_TSO_HDR_SZ are segmented by the stack
+ */
+static netdev_features_t mvppnd_features_check(struct sk_buff *skb,
+					       struct net_device *dev,
+					       netdev_features_t features)
+{
+	struct mvppnd_switch_flow *flow = netdev_priv(dev);
 
-	/* We are ready, let's update the first descriptor - ownership, CRC &
-	   first */
-	ppdev->tx_queue.ring.descs[wr_ptr_first]->cmd_sts =
-		TX_CMD_BIT_OWN_SDMA | TX_CMD_BIT_CRC | TX_CMD_BIT_FIRST;
+	if (skb_is_gso(skb) &&
+	    (!flow->ppdev->tx_zero_copy ||
+	     (skb_shinfo(skb)->nr_frags >= MAX_FRAGS) ||
+	     (skb_transport_offset(skb) + tcp_hdrlen(skb) > TX_TSO_HDR_SZ) ||
+	     (mvppnd_tso_descs(skb) > TX_TSO_MAX_DESCS)))
+		features &= ~NETIF_F_GSO_MASK;
 
-	/* Flash descriptors before enabling the queue */
-	mb();
+	return features;
+}
 
-	mvppnd_enable_queue(ppdev, REG_ADDR_TX_QUEUE_CMD, ppdev->tx_queue_num);
+/* DMA address of tso->data, in the payload mappings made on start */
+static dma_addr_t mvppnd_tso_data_dma(struct tso_t *tso,
+				      struct mvppnd_tx_frame *map_frame,
+				      struct mvppnd_dma_sg_buf *map)
+{
+	int i = 0;
 
-	jiffs = jiffies;
-	do {
-		sdma_took = ((ppdev->tx_queue.ring.descs[wr_ptr]->cmd_sts &
-			     TX_CMD_BIT_OWN_SDMA) != TX_CMD_BIT_OWN_SDMA);
-		wait_too_long = (jiffies_to_usecs(jiffies - jiffs) >
-				 TX_WAIT_FOR_CPU_OWENERSHIP_USEC);
-		mb();
-	} while (!sdma_took && !wait_too_long);
+	if (tso->next_frag_idx) /* Past the head */
+		i = map_frame->head_mapped + tso->next_frag_idx - 1;
 
-	/* check again if buffer is still not free: */
-	wait_too_long = ((ppdev->tx_queue.ring.descs[wr_ptr]->cmd_sts &
-                             TX_CMD_BIT_OWN_SDMA) == TX_CMD_BIT_OWN_SDMA);
+	return map->mappings[i] + map->sizes[i] - tso->size;
+}
 
-	/*
-	dev_dbg(&ppdev->pdev->dev,
-		"Took %d usec to SDMA to take the descriptor\n",
-		jiffies_to_usecs(jiffies - jiffs));
-	*/
+/* No L4 checksum offload in SDMA, each segment is summed here */
+static void mvppnd_tso_csum(struct sk_buff *skb, struct tso_t *tso, char *hdr,
+			    int len, __wsum csum)
+{
+	struct tcphdr *th = (struct tcphdr *)(hdr + skb_transport_offset(skb));
+	struct ipv6hdr *ip6h;
+	struct iphdr *iph;
 
-	/* TODO: For some reason ring does not work so for now let's use list */
-	ppdev->tx_queue.ring.descs_ptr = 0;
-	ppdev->tx_queue.ring.descs[wr_ptr]->next_desc_ptr = tmp_next_desc_ptr;
-
-	/* TODO: The ring thing */
-	/* cyclic_inc(&wr_ptr, TX_RING_SIZE); */
-	/* ppdev->tx_queue.ring.descs_ptr = wr_ptr; */
-
-	if (wait_too_long) {
-		ret = -EIO;
-		tx_tout++; /* increment counter indicating SDMA TX timeout occured */
-		pr_err("TX TOUT q %d first desc ptr %llx frst idx %lu bd sts %x addr %x wr idx %lu bd sts %x addr %x en_q %x vendor %x devid %x \n",
-			ppdev->tx_queue_num,
-			ppdev->tx_queue.ring.ring_dma,
-			wr_ptr_first,
-			ppdev->tx_queue.ring.descs[wr_ptr_first]->cmd_sts,
-			ppdev->tx_queue.ring.descs[wr_ptr_first]->buf_addr,
-			wr_ptr,
-			ppdev->tx_queue.ring.descs[wr_ptr]->cmd_sts,
-			ppdev->tx_queue.ring.descs[wr_ptr]->buf_addr,
-			mvppnd_read_reg(ppdev, REG_ADDR_TX_QUEUE_CMD),
-			mvppnd_read_reg(ppdev, REG_ADDR_VENDOR),
-			mvppnd_read_reg(ppdev, REG_ADDR_DEVICE) );
-		pr_err(
-"rej %x LW %x NDP %x CTDP %x cur %x cfg %x glbl ctrl %x ext glbl ctrl %x lpbck %x\n",
-			mvppnd_read_reg(ppdev, 0x28F4 ),
-			mvppnd_read_reg(ppdev, 0x2604 + ppdev->tx_queue_num*0x10),
-			mvppnd_read_reg(ppdev, 0x2608 + ppdev->tx_queue_num*0x10),
-			mvppnd_read_reg(ppdev, 0x2684),
-			mvppnd_read_reg(ppdev, 0x26C0 + ppdev->tx_queue_num*4),
-			mvppnd_read_reg(ppdev, 0x2800),
-			mvppnd_read_reg(ppdev, 0x58),
-			mvppnd_read_reg(ppdev, 0x5C),
-			mvppnd_read_reg(ppdev, 0x64)
-								);
-	}
-	else
-		ret = total_bytes - ETH_ALEN * 2 - flow->config_tx_dsa_size;
+	th->check = 0;
+	csum = csum_partial(th, tso->tlen, csum);
 
-#ifdef MVPPND_DEBUG_DATA_PATH
-	dev_info(ppdev->dev, "Total sent %d\n", ret);
-#endif
+	if (tso->ipv6) {
+		ip6h = (struct ipv6hdr *)(hdr + skb_network_offset(skb));
+		th->check = csum_ipv6_magic(&ip6h->saddr, &ip6h->daddr,
+					    tso->tlen + len, IPPROTO_TCP, csum);
+		return;
+	}
 
-	return ret;
+	iph = (struct iphdr *)(hdr + skb_network_offset(skb));
+	iph->check = 0;
+	iph->check = ip_fast_csum((u8 *)iph, iph->ihl);
+	th->check = csum_tcpudp_magic(iph->saddr, iph->daddr, tso->tlen + len,
+				      IPPROTO_TCP, csum);
 }
 
-static bool mvppnd_rings_empty(struct mvppnd_dev *ppdev)
+/*
+ * Segment a GSO frame straight into the ring. The headers of each segment
+ * are built in its slot of txq->tso_hdrs, the payload goes from
+ * the skb pages which are mapped once. The last segment holds the skb and
+ * the mappings until SDMA is done with it. Called with the queue lock held
+ * and room for TX_TSO_MAX_DESCS in the ring.
+ */
+static bool mvppnd_transmit_tso(struct mvppnd_dev *ppdev,
+				struct mvppnd_txq *txq,
+				struct mvppnd_switch_flow *flow,
+				struct sk_buff *skb, bool more)
 {
-	struct mvppnd_ring *r = NULL;
-	u32 rxqs;
+	struct mvppnd_tx_frame map_frame = {}, *frame;
+	int hdr_len, total_len, data_left, size, offs;
+	struct mvppnd_dma_sg_buf map = {}, seg;
+	int tc = mvppnd_skb_tc(ppdev, skb);
+	int vlan = mvppnd_skb_vlan(skb);
+	unsigned int segs = 0, bytes = 0;
+	size_t first, last = 0;
+	struct tso_t tso;
+	bool short_seg;
+	__wsum csum;
+	char *hdr;
+	int rc, n;
+
+	hdr_len = tso_start(skb, &tso);
+	if (mvppnd_map_skb_to_tx_descs(ppdev, skb, hdr_len, &map_frame, &map)) {
+		mvppnd_inc_flow_stat(flow->ndev, FLOW_STATS_TX_DROPPED, 1);
+		return false;
+	}
 
-	for(rxqs = 0; rxqs< NUM_OF_RX_QUEUES; rxqs++) {
-		if (ppdev->rx_queues[rxqs]) {
-			r = &ppdev->rx_queues[rxqs]->ring;
-			if((r->descs[r->descs_ptr]->cmd_sts &
-			    RX_CMD_BIT_OWN_SDMA) != RX_CMD_BIT_OWN_SDMA)
-				return false;
+	total_len = skb->len - hdr_len;
+	while (total_len > 0) {
+		first = txq->ring.descs_ptr;
+		hdr = txq->tso_hdrs.virt + txq->copy_ptr * TX_TSO_HDR_SZ;
+		data_left = min_t(int, skb_shinfo(skb)->gso_size, total_len);
+		total_len -= data_left;
+
+		tso_build_hdr(skb, hdr, &tso, data_left, !total_len);
+
+		memset(&seg, 0, sizeof(seg));
+		seg.mappings[0] = txq->tso_hdrs.dma +
+				  txq->copy_ptr * TX_TSO_HDR_SZ;
+		seg.sizes[0] = hdr_len;
+
+		/* A runt last segment is copied and padded behind its header */
+		short_seg = hdr_len + data_left < ETH_ZLEN;
+		csum = 0;
+		offs = 0;
+		n = 1;
+		while (offs < data_left) {
+			size = min_t(int, tso.size, data_left - offs);
+			csum = csum_block_add(csum, csum_partial(tso.data, size,
+								 0), offs);
+			if (short_seg) {
+				memcpy(hdr + hdr_len + offs, tso.data, size);
+			} else {
+				seg.mappings[n] = mvppnd_tso_data_dma(&tso,
+								      &map_frame,
+								      &map);
+				seg.sizes[n++] = size;
+			}
+			offs += size;
+			tso_build_data(skb, &tso, size);
 		}
+		if (short_seg) {
+			memset(hdr + hdr_len + data_left, 0,
+			       ETH_ZLEN - hdr_len - data_left);
+			seg.sizes[0] = ETH_ZLEN;
+		}
+
+		mvppnd_tso_csum(skb, &tso, hdr, data_left, csum);
+
+		/* The doorbell waits for the last segment */
+		rc = mvppnd_xmit_buf(ppdev, txq, flow, &seg, NULL, tc, vlan,
+				     total_len ? true : more);
+		if (rc <= 0)
+			break;
+		last = first;
+		segs++;
+		bytes += rc;
 	}
 
+	mvppnd_inc_stat(ppdev, STATS_TX_PACKETS, segs);
+	mvppnd_count_flow_tx(flow->ndev, segs, bytes);
+
+	if (unlikely(mvppnd_tx_ring_full(txq)))
+		mvppnd_stop_txq(ppdev, txq);
+
+	/* Posted segments point at the payload, it is held even if cut short */
+	if (unlikely(total_len > 0))
+		mvppnd_inc_flow_stat(flow->ndev, FLOW_STATS_TX_DROPPED, 1);
+
+	if (unlikely(!segs)) {
+		mvppnd_unmap_tx_frame(ppdev, &map_frame, &map);
+		return false;
+	}
+
+	/* Frames are reclaimed in order, the last segment releases it all */
+	frame = &txq->frames[last];
+	memcpy(txq->ring.buffs[last], &map, sizeof(map));
+	frame->head_mapped = map_frame.head_mapped;
+	frame->frags_mapped = map_frame.frags_mapped;
+	frame->skb = skb;
+
 	return true;
 }
+#endif
 
 /*
- * LIMITATION: CPSS and mvEthDrv.ko are the two software components which
- * access the interrupt tree on receiving an interrupt. When an event occurs,
- * corresponding bit in the leaf node is set, all related bits leading
- * up to the root are set accordingly and an interrupt is generated by the
- * switch
- *
- * Only when software processes and acknowledges the interrupt for e.g.
- * by reading the leaf node which is read-on-clear, all related bits leading
- * up to the root are cleared allowing next interrupt to be generated
- *
- * If a bit in MG0 Tree 0 Receive_SDMA_Interrupt_Cause1 is set indicating
- * packet received in RX-Q before CPSS processes and acknowledges an
- * interrupt meant for CPSS, RX-Q interrupt is not generated
- *
- * This is a race condition seen due to two software components accessing
- * the interrupt tree and processing the interrupts independently
- *
- * WORKAROUND:
- * 0x1D002890 = Receive SDMA Interrupt Cause1 (Receive_SDMA_Interrupt_Cause1)
- *
- * This is RX SDMA Int Cause register from MG0 Tree 1 which needs to be
- * read to clear the race condition and enable generation of next interrupt.
- * If mvEthDrv.ko misses the interrupt due to race condition leading to
- * Receive_SDMA_Interrupt_Cause1 remaining set, CPSS takes of reading it
- * clearing the race condition
- *
- * CPSS uses MG0 Tree 0 and mvEthDrv.ko uses MG0 Tree 1
- *
- * LIMITATION: Currently CPSS is configuring the interrupt tree in the switch to
- * connect only MG0 Tree 1 to MG0 Tree 0. Tree 1 of no other MG is configure
- * this way
- *
- * NOTE: We do connect Tree 1 of Tile 2 for devices with 4 tiles. Tile 2 is
- * connected by Tree 1
+ * Post the frame to the SDMA TX ring, called with the queue lock held.
+ * Returns true if the frame was posted, a copied skb is consumed right away
+ * and a mapped one is held by the ring until SDMA is done with it. On false
+ * the frame was dropped and the caller frees the skb.
  */
-static irqreturn_t mvppnd_isr(int irq, void *data)
+static bool mvppnd_transmit_skb(struct mvppnd_dev *ppdev,
+				struct mvppnd_txq *txq,
+				struct mvppnd_switch_flow *flow,
+				struct sk_buff *skb, bool more)
 {
-	struct mvppnd_dev *ppdev = (struct mvppnd_dev *)data;
+	struct mvppnd_tx_frame *frame;
+	struct mvppnd_dma_sg_buf *sgb;
+	bool zero_copy;
+	size_t first;
+	int rc;
 
-	mvppnd_inc_stat(ppdev, STATS_INTERRUPTS, 1);
+	if (unlikely(!txq->ready)) {
+		mvppnd_inc_flow_stat(flow->ndev, FLOW_STATS_TX_DROPPED, 1);
+		return false;
+	}
 
-	mvppnd_dis_rx_queues_intr(ppdev, 1);
-	/*
-	* Read Receive_SDMA_Interrupt_Cause1 to clear the register
-	*/
-	mvppnd_read_reg(ppdev, REG_ADDR_RX_CAUSE_1);
+	/* Lost a race with the flow that filled the ring */
+	if (unlikely(mvppnd_tx_ring_full(txq))) {
+		mvppnd_inc_stat(ppdev, STATS_TX_RING_BUSY, 1);
+		mvppnd_inc_flow_stat(flow->ndev, FLOW_STATS_TX_DROPPED, 1);
+		return false;
+	}
 
-	/*
-	 * As mentioned in the note above, Receive_SDMA_Interrupt_Cause1 is read
-	 * from multiple places to address the race condition. At this point
-	 * Receive_SDMA_Interrupt_Cause1 may or may not hold value indicating
-	 * RX-Q interrupt. Hence instead of relying on
-	 * Receive_SDMA_Interrupt_Cause1, if NAPI isn't scheduled, we check
-	 * the RX-Q ownership bit to check if the ownership is with CPU and if
-	 * it is, we schedule NAPI to read the packets
-	 */
-	if (!test_bit(NAPI_STATE_SCHED, &ppdev->napi.state) &&
-	    !mvppnd_rings_empty(ppdev)) {
-		mvppnd_inc_stat(ppdev, STATS_RX_TREE1_INTERRUPTS, 1);
-		napi_schedule(&ppdev->napi);
+#ifdef MVPPND_TSO
+	if (skb_is_gso(skb))
+		return mvppnd_transmit_tso(ppdev, txq, flow, skb, more);
+#endif
+
+	first = txq->ring.descs_ptr;
+	frame = &txq->frames[first];
+	sgb = txq->ring.buffs[first];
+	memset(sgb, 0, sizeof(*sgb));
+
+	/* Copybreak, and fallback for what can't be mapped */
+	zero_copy = ppdev->tx_zero_copy && (skb->len > TX_COPYBREAK) &&
+		    !mvppnd_map_skb_to_tx_descs(ppdev, skb, 0, frame, sgb);
+	if (!zero_copy) {
+		memset(sgb, 0, sizeof(*sgb));
+		rc = mvppnd_copy_skb_to_tx_buff(ppdev, txq, skb, sgb);
+		if (rc) {
+			dev_dbg(ppdev->dev, "Fail to map skb %p\n",
+				skb->data);
+			mvppnd_inc_flow_stat(flow->ndev,
+					     FLOW_STATS_TX_DROPPED, 1);
+			return false;
+		}
+	}
+
+	rc = mvppnd_xmit_buf(ppdev, txq, flow, sgb, NULL,
+			     mvppnd_skb_tc(ppdev, skb), mvppnd_skb_vlan(skb),
+			     more);
+	if (rc > 0) {
+		mvppnd_inc_stat(ppdev, STATS_TX_PACKETS, 1);
+		mvppnd_count_flow_tx(flow->ndev, 1, rc);
 	} else {
-		mvppnd_en_rx_queues_intr(ppdev, 1);
-		/*
-		 * Read Receive_SDMA_Interrupt_Cause1 to clear the register
-		 */
-		mvppnd_read_reg(ppdev, REG_ADDR_RX_CAUSE_1);
+		mvppnd_inc_flow_stat(flow->ndev, FLOW_STATS_TX_DROPPED, 1);
+		if (zero_copy)
+			mvppnd_unmap_tx_frame(ppdev, frame, sgb);
+		return false;
 	}
 
-	return IRQ_HANDLED;
+	/* Further frames wait in the flow backlogs */
+	if (unlikely(mvppnd_tx_ring_full(txq)))
+		mvppnd_stop_txq(ppdev, txq);
+
+	if (!zero_copy) {
+		dev_consume_skb_any(skb);
+		return true;
+	}
+
+	frame->skb = skb;
+
+	return true;
 }
 
-int mvppnd_emulate_rx(struct net_device *ndev, u8 *dsa, char *data,
-		      size_t data_len, u8 queue)
+/* Schedule NAPI contexts which have pending packets, true if any */
+static bool mvppnd_schedule_pending_napis(struct mvppnd_dev *ppdev)
 {
-	struct mvppnd_switch_flow *flow = netdev_priv(ndev);
-	struct mvppnd_dev *ppdev = flow->ppdev;
-	struct mvppnd_hw_desc *desc;
-	unsigned int buff_size;
-	unsigned char *buff;
-	u32 rx_first_desc;
-
-	if ((queue > NUM_OF_RX_QUEUES) || (queue < 0))
-		return -EINVAL;
+	struct mvppnd_napi *rx_napi;
+	bool scheduled = false;
+	int i;
 
-	rx_first_desc = mvppnd_read_rx_first_desc(ppdev, queue);
-	desc = (struct mvppnd_hw_desc *)phys_to_virt(rx_first_desc);
-	if ((desc->cmd_sts & RX_CMD_BIT_OWN_SDMA) != RX_CMD_BIT_OWN_SDMA)
-		return 0; /* no place on ring - drop */
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
+		rx_napi = &ppdev->rx_napi[i];
+		if (!rx_napi->queues_mask ||
+		    test_bit(NAPI_STATE_SCHED, &rx_napi->napi.state) ||
+		    hrtimer_active(&rx_napi->coal_timer) ||
+		    mvppnd_rings_empty(ppdev, rx_napi->queues_mask))
+			continue;
 
-	buff = phys_to_virt(desc->buf_addr);
+		napi_schedule(&rx_napi->napi);
+		scheduled = true;
+	}
 
-	buff_size = 0;
+	return scheduled;
+}
 
-	memcpy(buff, data, ETH_ALEN * 2);
-	buff += ETH_ALEN * 2;
-	data += ETH_ALEN * 2;
-	buff_size += ETH_ALEN * 2;
+static enum hrtimer_restart mvppnd_coal_timer(struct hrtimer *timer)
+{
+	struct mvppnd_napi *rx_napi = container_of(timer, struct mvppnd_napi,
+						   coal_timer);
 
-	memcpy(buff, dsa, DSA_SIZE);
-	buff += DSA_SIZE;
-	buff_size += DSA_SIZE;
+	napi_schedule(&rx_napi->napi);
 
-	memcpy(buff, data, data_len - ETH_ALEN * 2);
-	buff += (data_len - ETH_ALEN * 2);
-	buff_size += (data_len - ETH_ALEN * 2);
+	return HRTIMER_NORESTART;
+}
 
-	memset(buff, 0, CRC_SIZE);
-	buff_size += CRC_SIZE;
+/*
+ * Mitigation for missed interrupts, cheap when idle as it only peeks at the
+ * head descriptor of each ring
+ */
+static enum hrtimer_restart mvppnd_rx_poll_timer(struct hrtimer *timer)
+{
+	struct mvppnd_dev *ppdev = container_of(timer, struct mvppnd_dev,
+						rx_poll_timer);
 
-	RX_DESC_SET_BYTE_CNT(desc->bc, buff_size);
-	desc->cmd_sts &= 0x7FFFFFFF;
+	if (mvppnd_schedule_pending_napis(ppdev))
+		mvppnd_inc_stat(ppdev, STATS_RX_SAFETY_POLLS, 1);
 
-	mvppnd_write_rx_first_desc(ppdev, queue, desc->next_desc_ptr);
+	/* TX locks are not taken from hard IRQ, NAPI does the reclaim */
+	if (mvppnd_tx_pending(ppdev))
+		mvppnd_schedule_tx_napi(ppdev);
 
-	mvppnd_isr(ppdev->irq, (void *)ppdev);
+	hrtimer_forward_now(timer, ns_to_ktime(RX_SAFETY_POLL_USEC *
+					       NSEC_PER_USEC));
 
-	return buff_size;
+	return HRTIMER_RESTART;
 }
-EXPORT_SYMBOL(mvppnd_emulate_rx);
 
-static void mvppnd_transmit_skb(struct sk_buff *skb)
+static void mvppnd_add_napis(struct net_device *dev, struct mvppnd_dev *ppdev)
 {
-	struct mvppnd_switch_flow *flow = netdev_priv(skb->dev);
-	struct mvppnd_dev *ppdev = flow->ppdev;
-	struct mvppnd_dma_sg_buf sgb = {};
-	int rc;
-
-	/*
-	dev_dbg(&ppdev->pdev->dev, "Got packet to transmit, len %d (head %d)\n",
-		skb->len, skb_headlen(skb));
-	*/
-	print_frame(ppdev, skb->data, 100, false);
-	print_skb_hdr(ppdev, "tx", skb);
+	struct mvppnd_napi *rx_napi;
+	int i;
 
-	/*
-	 * if TX callback hook exists, call it and according to the
-	 * return value decide what needs to be done with the packet:
-	 */
-	if (ppdev->ops && ppdev->ops->process_tx) {
-		rc = ppdev->ops->process_tx(flow->ndev, skb);
-		switch (rc) {
-		case NF_DROP:
-			flow->ndev->stats.tx_dropped++;
-			return;
-		case NF_ACCEPT:
-			break;
-		case NF_STOLEN:
-			return;
-		default:
-			WARN_ONCE("%s: Got invalid return value from process_tx\n",
-				  DRV_NAME);
-			ppdev->sdev.flows[0]->ndev->stats.rx_dropped++;
-			return;
-		};
+	ppdev->tx_napi = NULL;
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
+		ppdev->rx_napi[i].queues_mask = 0;
+		ppdev->rx_napi[i].drr_queue = 0;
+		ppdev->rx_queues_deficit[i] = 0;
 	}
 
-	rc = mvppnd_copy_skb_to_tx_buff(ppdev, skb, &sgb);
-	if (rc) {
-		dev_dbg(ppdev->dev, "Fail to map skb %p\n",
-			skb->data);
-		return;
-	}
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++)
+		if (ppdev->rx_queues[i]) {
+			rx_napi = &ppdev->rx_napi[ppdev->rx_queue_napi[i]];
+			rx_napi->queues_mask |= BIT(i);
+			ppdev->rx_queues[i]->rx_napi = rx_napi;
+		}
 
-	rc = mvppnd_xmit_buf(ppdev, flow, skb->data, &sgb);
-	if (rc > 0) {
-		mvppnd_inc_stat(ppdev, STATS_TX_PACKETS, 1);
-		flow->ndev->stats.tx_packets++;
-		flow->ndev->stats.tx_bytes += rc;
-	} else {
-		flow->ndev->stats.tx_dropped++;
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
+		rx_napi = &ppdev->rx_napi[i];
+		if (!rx_napi->queues_mask)
+			continue;
+
+		rx_napi->ppdev = ppdev;
+		rx_napi->coal_usecs = ppdev->rx_coal_usecs;
+		rx_napi->coal_frames = ppdev->rx_coal_frames;
+		mvppnd_rx_dim_init(ppdev, rx_napi);
+		if (!ppdev->tx_napi)
+			ppdev->tx_napi = rx_napi;
+		hrtimer_init(&rx_napi->coal_timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_REL);
+		rx_napi->coal_timer.function = mvppnd_coal_timer;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,1,0)
+		netif_napi_add(dev, &rx_napi->napi, mvppnd_poll,
+			       DEFAULT_NAPI_POLL_WEIGHT);
+#else
+		netif_napi_add_weight(dev, &rx_napi->napi, mvppnd_poll,
+				      DEFAULT_NAPI_POLL_WEIGHT);
+#endif
+		napi_enable(&rx_napi->napi);
 	}
 }
 
-static void mvppnd_tx_work(struct work_struct *work)
+static void mvppnd_del_napis(struct mvppnd_dev *ppdev)
 {
-	struct mvppnd_skb_work *skb_work = container_of(work,
-							struct mvppnd_skb_work,
-							work);
-	struct net_device *dev = skb_work->skb->dev;
-	struct mvppnd_switch_flow *flow = netdev_priv(dev);
-	struct mvppnd_dev *ppdev = flow->ppdev;
+	struct mvppnd_napi *rx_napi;
+	int i;
 
-	/* Interface might go down while this work was in the queue */
-	if ((!flow->up) || (ppdev->tx_queue_num == -1) || (!netif_running(dev)))
-		goto out;
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
+		rx_napi = &ppdev->rx_napi[i];
+		if (!rx_napi->queues_mask)
+			continue;
 
-	mvppnd_transmit_skb(skb_work->skb);
+		hrtimer_cancel(&rx_napi->coal_timer);
+		napi_disable(&rx_napi->napi); /* must be called to stop a current napi poll midway processing */
+		mvppnd_rx_dim_stop(rx_napi);
+		netif_napi_del(&rx_napi->napi);
+		rx_napi->queues_mask = 0;
+	}
+}
 
-out:
-	skb_unref(skb_work->skb);
-	kfree_skb(skb_work->skb);
-	kfree(work);
-	atomic_dec(&ppdev->tx_skb_in_transit);
-	ppdev->sdev.stats[STATS_TX_IN_TRANSIT] =
-		atomic_read(&ppdev->tx_skb_in_transit);
+static void mvppnd_schedule_napis(struct mvppnd_dev *ppdev)
+{
+	int i;
+
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++)
+		if (ppdev->rx_napi[i].queues_mask)
+			napi_schedule(&ppdev->rx_napi[i].napi);
 }
 
-static int rx_thread(void *data)
+#ifdef MVPPND_XSK
+/*
+ * Move a running RX queue to the UMEM frames of pool, or back to its regular
+ * buffers when pool is NULL. The queue is stopped and its NAPI context is
+ * disabled meanwhile.
+ */
+static int mvppnd_xsk_switch_rx_queue(struct mvppnd_dev *ppdev, int queue,
+				      struct xsk_buff_pool *pool)
 {
-	struct mvppnd_dev *ppdev = (struct mvppnd_dev *)data;
-#ifdef DBG_DELAY
-	unsigned long j[4] = { 0, 0, 0, 0};
-#endif
+	struct mvppnd_queue *rxq = ppdev->rx_queues[queue];
+	struct mvppnd_ring *r = &rxq->ring;
+	struct mvppnd_dma_sg_buf *sgb;
+	int j, rc = 0;
 
-	while (!kthread_should_stop()) {
+	napi_disable(&rxq->rx_napi->napi);
+	mvppnd_disable_queue(ppdev, REG_ADDR_RX_QUEUE_CMD, queue);
 
-		if (!test_bit(NAPI_STATE_SCHED, &ppdev->napi.state) &&
-		    !mvppnd_rings_empty(ppdev)) {
-			napi_schedule(&ppdev->napi);
-#ifdef DBG_DELAY
-			pr_err("RX THRD SCHED NAPI i%lu : %lu %lu %lu %lu\n",
-				i, j[0], j[1], j[2], j[3]);
-#endif
-			usleep_range(1, 2); /* trigger NAPI poll fast on NOHZ_FULL system, without HRTimer delay no interrupts will be generated ==> no softIRQ scheduled */
+	/* Release whatever the ring holds */
+	mvppnd_xsk_free_rx_ring(ppdev, queue);
+	mvppnd_free_rx_ring_pages(ppdev, queue);
+
+	if (pool) {
+		rc = mvppnd_setup_streaming_mg_windows(ppdev);
+		if (!rc)
+			rc = mvppnd_xsk_fill_rx_ring(ppdev, queue, pool);
+	} else if (ppdev->rx_zero_copy) {
+		rc = mvppnd_create_rx_page_pool(ppdev, queue);
+		if (!rc)
+			rc = mvppnd_fill_rx_ring_pages(ppdev, queue);
+	} else {
+		/* Coherent buffers were left in place */
+		for (j = 0; j < ppdev->rx_rings_size[queue]; j++) {
+			sgb = r->buffs[j];
+			r->descs[j]->buf_addr = sgb->mappings[0];
+			RX_DESC_SET_BUFF_SIZE(r->descs[j]->bc, sgb->sizes[0]);
+			r->descs[j]->cmd_sts = RX_CMD_BIT_OWN_SDMA |
+					       RX_CMD_BIT_EN_INTR;
 		}
-		else
-			msleep(4); /* msleep() so kernel will reschedule */
-#ifdef DBG_DELAY
-		j[i++] = jiffies;
-		if (i >= 4)
-			i = 0;
-#endif
 	}
 
-	return 0;
+	r->descs_ptr = 0;
+	r->buffs_ptr = 0;
+	mvppnd_write_rx_first_desc(ppdev, queue, r->ring_dma);
+
+	if (rc)
+		dev_err(ppdev->dev, "Fail to refill RX queue %d (%d)\n", queue,
+			rc);
+	else
+		mvppnd_enable_queue(ppdev, REG_ADDR_RX_QUEUE_CMD, queue);
+
+	napi_enable(&rxq->rx_napi->napi);
+
+	return rc;
 }
 
-void mvppnd_free_wq(struct mvppnd_dev *ppdev)
+/* Called on open, move the queues with a socket bound to the UMEM frames */
+static void mvppnd_xsk_open(struct mvppnd_dev *ppdev)
+{
+	int i;
+
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++)
+		if (ppdev->xsk_pools[i] && ppdev->rx_queues[i])
+			mvppnd_xsk_switch_rx_queue(ppdev, i,
+						   ppdev->xsk_pools[i]);
+}
+#else
+static void mvppnd_xsk_open(struct mvppnd_dev *ppdev)
 {
-	if (ppdev->tx_wq) {
-		mvppnd_stop_all_netdevs(ppdev, true); /* prevents new queuing */
-		flush_workqueue(ppdev->tx_wq);
-		drain_workqueue(ppdev->tx_wq);
-		destroy_workqueue(ppdev->tx_wq);
-		ppdev->tx_wq = NULL;
-	}
 }
+#endif
 
 /*********** netdev ops ********************************/
 int mvppnd_open(struct net_device *dev)
@@ -3345,13 +6814,19 @@ int mvppnd_open(struct net_device *dev)
 			return -EPERM;
 		}
 
-		/* Nothing to be done for regular flows */
+		/* Nothing else to be done for regular flows */
+		rc = mvppnd_setup_netdev_txqs(ppdev, dev);
+		if (rc)
+			return rc;
+
 		goto out;
 	}
 
-	if (ppdev->tx_queue_num == -1) {
+	mvppnd_setup_tx_queues(ppdev);
+
+	if (!ppdev->num_txqs) {
 		netdev_err(dev,
-			   "Can't open device while tx_queue is not set\n");
+			   "Can't open device while tx_queues is not set\n");
 		return -EPERM;
 	}
 
@@ -3361,6 +6836,9 @@ int mvppnd_open(struct net_device *dev)
 		return -EPERM;
 	}
 
+	/* Larger frames are scattered over several RX descriptors */
+	ppdev->rx_buff_sz = min_t(size_t, ppdev->max_pkt_sz, RX_MAX_BUFF_SZ);
+
 	if ((ppdev->pdev.pdev) && (ppdev->pdev.atu_win == -1) &&
 	    (ppdev->pdev.pdev->device != PCI_DEVICE_ID_ALDRIN2)) {
 		netdev_err(dev,
@@ -3388,48 +6866,39 @@ int mvppnd_open(struct net_device *dev)
 		goto free_coherent;
 	}
 
-	rc = mvppnd_setup_tx_ring(ppdev);
+	rc = mvppnd_setup_tx_rings(ppdev);
 	if (rc) {
-		netdev_err(dev, "Fail to create tx ring %d\n",
-			   ppdev->tx_queue_num);
-		ppdev->tx_queue_num = -1;
+		netdev_err(dev, "Fail to create tx rings\n");
 		goto destroy_rx_rings;
 	}
 
-	ppdev->mac.virt = mvppnd_alloc_coherent(ppdev, ETH_ALEN * 2,
-						&ppdev->mac.dma);
-	ppdev->dsa.virt = mvppnd_alloc_coherent(ppdev, DSA_SIZE,
-						&ppdev->dsa.dma);
-
-	ppdev->tx_wq = create_workqueue("mvppnd_tx");
-	if (!ppdev->tx_wq) {
-		netdev_err(dev, "Fail to allocate TX work queue\n");
+	rc = mvppnd_setup_netdev_txqs(ppdev, dev);
+	if (rc) {
+		netdev_err(dev, "Fail to set %d tx queues\n", ppdev->num_txqs);
 		goto destroy_tx_rings;
 	}
 
+	mvppnd_set_tx_ready(ppdev, true);
+
 	mvppnd_disable_tx_interrupts(ppdev);
 
-#if LINUX_VERSION_CODE < KERNEL_VERSION(6,1,0)
-	netif_napi_add(dev, &ppdev->napi, mvppnd_poll,
-		       DEFAULT_NAPI_POLL_WEIGHT);
-#else
-	netif_napi_add_weight(dev, &ppdev->napi, mvppnd_poll,
-		       DEFAULT_NAPI_POLL_WEIGHT);
-#endif
-	napi_enable(&ppdev->napi);
+	mvppnd_add_napis(dev, ppdev);
+
+	/* Queues with an AF_XDP socket bound while we were down */
+	mvppnd_xsk_open(ppdev);
 
 	mvppnd_sysfs_set_mode(ppdev, S_IRUGO);
 
 	/* Disable our queues on tree 0 */
-	mvppnd_dis_rx_queues_intr(ppdev, 0);
+	mvppnd_dis_rx_queues_intr(ppdev, 0, ppdev->rx_queues_mask);
 
 	rc = request_irq(ppdev->irq, mvppnd_isr, IRQF_SHARED, DRV_NAME, ppdev);
 	if (rc < 0) {
 		netdev_err(dev, "Fail to request IRQ %d\n", ppdev->irq);
-		goto destroy_tx_wq;
+		goto del_napis;
 	}
 
-	napi_schedule(&ppdev->napi);
+	mvppnd_schedule_napis(ppdev);
 
 	/* Clear cause in tree 1 */
 	while (mvppnd_read_reg(ppdev, REG_ADDR_RX_CAUSE_1));
@@ -3438,34 +6907,35 @@ int mvppnd_open(struct net_device *dev)
 	mvppnd_edit_reg_or(ppdev, REG_ADDR_GLOBAL_MASK[1], 1 << 9);
 
 	/* Enable our queues on tree 1 */
-	mvppnd_en_rx_queues_intr(ppdev, 1);
+	mvppnd_en_rx_queues_intr(ppdev, 1, ppdev->rx_queues_mask);
 
-	/*
- 	 * For now no implenetation of separate interrupt-tree for devices other
- 	 * than Falcon in CPSS. Until then let's have dedicated thread to
- 	 * monitor RX rings
-	 * Also poll for Falcon as a mitigation for missed interrupts.
-	 */
-	ppdev->rx_thread = kthread_run(rx_thread, (void *)ppdev,
-				       "mvppnd_rx");
-	if (!ppdev->rx_thread) {
-		netdev_err(dev, "Fail to start RX thread\n");
-		goto destroy_tx_wq;
-	}
+	/* TX completion events */
+	mvppnd_read_reg(ppdev, REG_ADDR_TX_CAUSE_0);
+	mvppnd_en_tx_queue_intr(ppdev);
+
+	/* Safety poll as a mitigation for missed interrupts */
+	hrtimer_start(&ppdev->rx_poll_timer,
+		      ns_to_ktime(RX_SAFETY_POLL_USEC * NSEC_PER_USEC),
+		      HRTIMER_MODE_REL);
 
 	debug_print_some_registers(ppdev);
 
 out:
+	mvppnd_build_tx_dsa(ppdev, flow);
 	flow->up = true;
+	mvppnd_rebuild_rx_demux(ppdev);
+
+	/* Queues could be left stopped since the main netdev went down */
+	netif_tx_start_all_queues(dev);
 
 	return 0;
 
-destroy_tx_wq:
-	destroy_workqueue(ppdev->tx_wq);
+del_napis:
+	mvppnd_del_napis(ppdev);
+	mvppnd_set_tx_ready(ppdev, false);
 
 destroy_tx_rings:
-	mvppnd_destroy_tx_ring(ppdev);
-	ppdev->tx_wq = NULL;
+	mvppnd_destroy_tx_rings(ppdev);
 
 destroy_rx_rings:
 	mvppnd_destroy_rx_rings(ppdev);
@@ -3483,31 +6953,30 @@ int mvppnd_stop(struct net_device *dev)
 	int i;
 
 	flow->up = false;
+	mvppnd_rebuild_rx_demux(ppdev);
+
+	mvppnd_tx_purge_flow(ppdev, flow);
 
 	if (flow->flow_id) /* Nothing to be done for regular flows */
 		return 0;
 
-	if (ppdev->rx_thread) {
-		kthread_stop(ppdev->rx_thread);
-		if (in_atomic()) 
-			mdelay((RX_THREAD_UDELAY * 2)/1000);
-		else
-			msleep(10);
-	}
+	hrtimer_cancel(&ppdev->rx_poll_timer);
 
-	mvppnd_dis_rx_queues_intr(ppdev, 1);
+	mvppnd_dis_rx_queues_intr(ppdev, 1, ppdev->rx_queues_mask);
+	mvppnd_disable_tx_interrupts(ppdev);
 
 	free_irq(ppdev->irq, ppdev);
 
-	napi_disable(&ppdev->napi); /* must be called to stop a current napi poll midway processing */
-
-	netif_napi_del(&ppdev->napi);
-
-	mvppnd_free_wq(ppdev);
+	mvppnd_del_napis(ppdev);
 
 	/* Main interface is shutdown, close all sub interfaces */
 	mvppnd_stop_all_netdevs(ppdev, true);
 
+	mvppnd_set_tx_ready(ppdev, false);
+#ifdef MVPPND_XSK
+	cancel_work_sync(&ppdev->xsk_tx_work);
+#endif
+
 	mvppnd_destroy_rings(ppdev);
 
 	mvppnd_free_device_coherent(ppdev);
@@ -3523,57 +6992,178 @@ int mvppnd_stop(struct net_device *dev)
 	return 0;
 }
 
-netdev_tx_t mvppnd_start_xmit(struct sk_buff *skb, struct net_device *dev)
+/*
+ * txq_idx is the netdev TX queue, taken modulo the number of queues. more
+ * tells that further frames follow right away, the doorbell is then left for
+ * the last one of the burst.
+ */
+static void mvppnd_xmit_skb(struct sk_buff *skb, u16 txq_idx, bool more)
 {
 	struct mvppnd_switch_flow *flow = netdev_priv(skb->dev);
 	struct mvppnd_dev *ppdev = flow->ppdev;
-	struct mvppnd_skb_work *skb_work;
+	int num_txqs = READ_ONCE(ppdev->num_txqs);
+	struct mvppnd_txq *txq = NULL;
+	bool queued = false;
+	int rc;
 
-	/* We are overun, return 'busy' to slow down */
-	if (atomic_read(&ppdev->tx_skb_in_transit) > ppdev->tx_queue_size) {
-		tx_busy_size++; /* increment telemetry for this condition */
-		return NETDEV_TX_BUSY;
-	}
+	if (likely(num_txqs))
+		txq = &ppdev->txqs[txq_idx % num_txqs];
 
-	skb_work = kmalloc(sizeof(*skb_work), GFP_KERNEL);
-	if (unlikely(!skb_work)) {
-		tx_busy_mem++; /* increment telemetry for this condition */
-		return NETDEV_TX_BUSY;
+	/*
+	dev_dbg(&ppdev->pdev->dev, "Got packet to transmit, len %d (head %d)\n",
+		skb->len, skb_headlen(skb));
+	*/
+	print_frame(ppdev, skb->data, 100, false);
+	print_skb_hdr(ppdev, "tx", skb);
+
+	/*
+	 * if TX callback hook exists, call it and according to the
+	 * return value decide what needs to be done with the packet:
+	 */
+	if (ppdev->ops && ppdev->ops->process_tx) {
+		rc = ppdev->ops->process_tx(flow->ndev, skb);
+		switch (rc) {
+		case NF_DROP:
+			mvppnd_inc_flow_stat(flow->ndev,
+					     FLOW_STATS_TX_DROPPED, 1);
+			goto out;
+		case NF_ACCEPT:
+			break;
+		case NF_STOLEN:
+			/* The hook keeps its own ref */
+			dev_consume_skb_any(skb);
+			goto flush;
+		default:
+			WARN_ONCE("%s: Got invalid return value from process_tx\n",
+				  DRV_NAME);
+			mvppnd_inc_flow_stat(ppdev->sdev.flows[0]->ndev,
+					     FLOW_STATS_RX_DROPPED, 1);
+			goto out;
+		};
 	}
 
-	INIT_WORK(&skb_work->work, mvppnd_tx_work);
-	skb_work->ppdev = ppdev;
-	skb_work->skb = skb_get(skb);
+	/*
+	 * No checksum offload in SDMA, done here so frags need no copy. TSO
+	 * segments are summed as they are built.
+	 */
+	if (!skb_is_gso(skb) && (skb->ip_summed == CHECKSUM_PARTIAL) &&
+	    skb_checksum_help(skb)) {
+		mvppnd_inc_flow_stat(flow->ndev, FLOW_STATS_TX_DROPPED, 1);
+		goto out;
+	}
 
-	atomic_inc(&ppdev->tx_skb_in_transit);
-	ppdev->sdev.stats[STATS_TX_IN_TRANSIT] =
-		atomic_read(&ppdev->tx_skb_in_transit);
+	if (unlikely(!txq)) {
+		mvppnd_inc_flow_stat(flow->ndev, FLOW_STATS_TX_DROPPED, 1);
+		goto out;
+	}
 
 	/*
-	 * Always schedule on CPU #0.
-	 * If queue_work() is used, then kernel ends up
-	 * queuing on the current CPU (core).
-	 * this function (mvppnd_start_xmit() ) is called
-	 * always on top of the caller stack of user-space
-	 * (which called send()/sendto() to the kernel),
-	 * hence the current CPU/core is determined by the
-	 * CPU/core the user-space process sending is
-	 * scheduled on. under load, the Linux kernel will
-	 * reschedule this process to a different CPU/core
-	 * runqueue. If The kernel ping-pongs the process
-	 * between two cores/CPUs, using queue_work() will
-	 * end up queuing TX packets on two different CPU's
-	 * work-queues, which can run concurrenly, creating
-	 * an unhandled race condition. queuing to CPU #0
-	 * will ensure queuing is always done to the same
-	 * workqueue thread, which always exists, preventing
-	 * this race condition from occuring:
+	 * Frames are posted right away, from whichever CPU is sending. The
+	 * netdev TX lock only covers one flow while all of them share the
+	 * SDMA TX ring of the queue, hence the ring lock.
 	 */
-	queue_work_on(0, ppdev->tx_wq, &skb_work->work);
+	spin_lock(&txq->lock);
+	/* Make room from what SDMA already sent */
+	if (txq->ready)
+		mvppnd_tx_reclaim(ppdev, txq, false);
+	if (likely(list_empty(&txq->backlogs) &&
+		   !mvppnd_tx_ring_full(txq)) || !txq->ready) {
+		queued = mvppnd_transmit_skb(ppdev, txq, flow, skb, more);
+	} else {
+		/* Behind the frames other flows left waiting for room */
+		queued = mvppnd_tx_backlog_skb(txq, flow, skb);
+		mvppnd_tx_drr(ppdev, txq);
+	}
+	spin_unlock(&txq->lock);
+
+out:
+	if (!queued)
+		dev_kfree_skb_any(skb);
+
+flush:
+	/* Even if the last frame of the burst was dropped */
+	if (!more && txq)
+		mvppnd_txq_flush(ppdev, txq);
+}
+
+netdev_tx_t mvppnd_start_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+	mvppnd_xmit_skb(skb, skb_get_queue_mapping(skb), mvppnd_xmit_more(skb));
 
 	return NETDEV_TX_OK;
 }
 
+/*
+ * A TX queue of the flow was stopped for longer than the watchdog, the rings
+ * are recovered whether or not the stall detection caught it
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+static void mvppnd_tx_timeout(struct net_device *dev, unsigned int txqueue)
+#else
+static void mvppnd_tx_timeout(struct net_device *dev)
+#endif
+{
+	struct mvppnd_switch_flow *flow = netdev_priv(dev);
+	struct mvppnd_dev *ppdev = flow->ppdev;
+	int num_txqs = READ_ONCE(ppdev->num_txqs);
+	struct mvppnd_txq *txq;
+	int i;
+
+	netdev_warn(dev, "TX timeout\n");
+
+	for (i = 0; i < num_txqs; i++) {
+		txq = &ppdev->txqs[i];
+		spin_lock_bh(&txq->lock);
+		if (txq->ready && mvppnd_tx_inflight(txq))
+			mvppnd_tx_recover(ppdev, txq);
+		spin_unlock_bh(&txq->lock);
+	}
+
+	/* Reclaim, serve the backlogs and wake the flows */
+	mvppnd_schedule_tx_napi(ppdev);
+}
+
+/* Flows count on the local CPU, netdev stats are summed up here */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0)
+static void mvppnd_get_stats64(struct net_device *dev,
+			       struct rtnl_link_stats64 *stats)
+#else
+static struct rtnl_link_stats64 *
+mvppnd_get_stats64(struct net_device *dev, struct rtnl_link_stats64 *stats)
+#endif
+{
+	struct mvppnd_switch_flow *flow = netdev_priv(dev);
+	const struct mvppnd_flow_stats *pcpu;
+	u64 sum[FLOW_STATS_LAST + 1] = {};
+	u64 val[FLOW_STATS_LAST + 1];
+	unsigned int start;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		pcpu = per_cpu_ptr(flow->stats, cpu);
+		do {
+			start = u64_stats_fetch_begin(&pcpu->syncp);
+			memcpy(val, pcpu->stats, sizeof(val));
+		} while (u64_stats_fetch_retry(&pcpu->syncp, start));
+
+		for (i = 0; i <= FLOW_STATS_LAST; i++)
+			sum[i] += val[i];
+	}
+
+	stats->rx_packets = sum[FLOW_STATS_RX_PACKETS];
+	stats->rx_bytes = sum[FLOW_STATS_RX_BYTES];
+	stats->tx_packets = sum[FLOW_STATS_TX_PACKETS];
+	stats->tx_bytes = sum[FLOW_STATS_TX_BYTES];
+	stats->rx_dropped = sum[FLOW_STATS_RX_DROPPED];
+	stats->tx_dropped = sum[FLOW_STATS_TX_DROPPED];
+	stats->rx_length_errors = sum[FLOW_STATS_RX_LENGTH_ERRORS];
+	stats->rx_errors = stats->rx_length_errors;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,11,0)
+
+	return stats;
+#endif
+}
+
 static void mvppnd_net_mclist(struct net_device *dev)
 {
 	/*
@@ -3582,22 +7172,357 @@ static void mvppnd_net_mclist(struct net_device *dev)
 	 */
 }
 
+/*********** ethtool ops *******************************/
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,15,0)
+static int mvppnd_get_coalesce(struct net_device *dev,
+			       struct ethtool_coalesce *ec,
+			       struct kernel_ethtool_coalesce *kernel_coal,
+			       struct netlink_ext_ack *extack)
+#else
+static int mvppnd_get_coalesce(struct net_device *dev,
+			       struct ethtool_coalesce *ec)
+#endif
+{
+	struct mvppnd_switch_flow *flow = netdev_priv(dev);
+	struct mvppnd_dev *ppdev = flow->ppdev;
+
+	ec->use_adaptive_rx_coalesce = ppdev->rx_coal_adaptive;
+	ec->rx_coalesce_usecs = ppdev->rx_coal_usecs;
+	ec->rx_max_coalesced_frames = ppdev->rx_coal_frames;
+
+	return 0;
+}
+
+/* Moderation is per device, setting it on any of the netdevs applies to all */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,15,0)
+static int mvppnd_set_coalesce(struct net_device *dev,
+			       struct ethtool_coalesce *ec,
+			       struct kernel_ethtool_coalesce *kernel_coal,
+			       struct netlink_ext_ack *extack)
+#else
+static int mvppnd_set_coalesce(struct net_device *dev,
+			       struct ethtool_coalesce *ec)
+#endif
+{
+	struct mvppnd_switch_flow *flow = netdev_priv(dev);
+	struct mvppnd_dev *ppdev = flow->ppdev;
+	struct mvppnd_napi *rx_napi;
+	int i;
+
+#ifndef MVPPND_RX_DIM
+	if (ec->use_adaptive_rx_coalesce)
+		return -EOPNOTSUPP;
+#endif
+
+	ppdev->rx_coal_adaptive = ec->use_adaptive_rx_coalesce;
+	ppdev->rx_coal_usecs = ec->rx_coalesce_usecs;
+	ppdev->rx_coal_frames = ec->rx_max_coalesced_frames;
+
+	/* Adaptive moderation takes over on the next DIM decision */
+	if (ppdev->rx_coal_adaptive)
+		return 0;
+
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
+		rx_napi = &ppdev->rx_napi[i];
+		rx_napi->coal_usecs = ppdev->rx_coal_usecs;
+		rx_napi->coal_frames = ppdev->rx_coal_frames;
+	}
+
+	return 0;
+}
+
+static const struct ethtool_ops mvppnd_ethtool_ops = {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,7,0)
+	.supported_coalesce_params = ETHTOOL_COALESCE_RX_USECS |
+				     ETHTOOL_COALESCE_RX_MAX_FRAMES |
+				     ETHTOOL_COALESCE_USE_ADAPTIVE_RX,
+#endif
+	.get_coalesce		= mvppnd_get_coalesce,
+	.set_coalesce		= mvppnd_set_coalesce,
+};
+
+#ifdef MVPPND_XDP
+static int mvppnd_xdp_setup(struct net_device *dev, struct bpf_prog *prog,
+			    struct netlink_ext_ack *extack)
+{
+	struct mvppnd_switch_flow *flow = netdev_priv(dev);
+	struct mvppnd_dev *ppdev = flow->ppdev;
+	struct bpf_prog *old_prog;
+
+	if (prog && !ppdev->rx_zero_copy) {
+		NL_SET_ERR_MSG_MOD(extack, "XDP requires rx_zero_copy");
+		return -EOPNOTSUPP;
+	}
+
+	if (prog && ppdev->max_pkt_sz > RX_MAX_BUFF_SZ) {
+		NL_SET_ERR_MSG_MOD(extack,
+				   "max_pkt_sz too large for a single buffer");
+		return -EOPNOTSUPP;
+	}
+
+	old_prog = xchg(&flow->xdp_prog, prog);
+	if (old_prog)
+		bpf_prog_put(old_prog);
+
+	if (prog && !old_prog)
+		atomic_inc(&ppdev->xdp_progs);
+	else if (!prog && old_prog)
+		atomic_dec(&ppdev->xdp_progs);
+
+	return 0;
+}
+
+#ifdef MVPPND_XSK
+static int mvppnd_xsk_pool_setup(struct net_device *dev,
+				 struct xsk_buff_pool *pool, u16 queue)
+{
+	struct mvppnd_switch_flow *flow = netdev_priv(dev);
+	struct mvppnd_dev *ppdev = flow->ppdev;
+	bool running;
+	int rc = 0;
+
+	if (queue >= NUM_OF_RX_QUEUES)
+		return -EINVAL;
+
+	running = ppdev->sdev.flows[0]->up && ppdev->rx_queues[queue];
+
+	if (!pool) {
+		pool = ppdev->xsk_pools[queue];
+		if (!pool || (ppdev->xsk_flows[queue] != flow))
+			return -EINVAL;
+
+		WRITE_ONCE(ppdev->xsk_pools[queue], NULL);
+		flush_work(&ppdev->xsk_tx_work);
+		mvppnd_tx_forget(ppdev, NULL, pool);
+		if (running)
+			mvppnd_xsk_switch_rx_queue(ppdev, queue, NULL);
+
+		xsk_pool_dma_unmap(pool, 0);
+		ppdev->xsk_flows[queue] = NULL;
+
+		return 0;
+	}
+
+	/* A queue serves one socket, whatever flow it is bound through */
+	if (ppdev->xsk_pools[queue])
+		return -EBUSY;
+
+	/* UMEM frames go to SDMA as is, see mvppnd_streaming_dma_ok */
+	if (!mvppnd_streaming_dma_ok(ppdev))
+		return -EOPNOTSUPP;
+
+	rc = xsk_pool_dma_map(pool, ppdev->dev, 0);
+	if (rc)
+		return rc;
+
+	ppdev->xsk_flows[queue] = flow;
+	WRITE_ONCE(ppdev->xsk_pools[queue], pool);
+
+	if (running) {
+		rc = mvppnd_xsk_switch_rx_queue(ppdev, queue, pool);
+		if (rc) {
+			WRITE_ONCE(ppdev->xsk_pools[queue], NULL);
+			mvppnd_xsk_switch_rx_queue(ppdev, queue, NULL);
+			xsk_pool_dma_unmap(pool, 0);
+			ppdev->xsk_flows[queue] = NULL;
+		}
+	}
+
+	return rc;
+}
+
+/*
+ * Complete a descriptor of socket queue the ring did not take. The completion
+ * ring hands back the oldest reserved descriptors first, so while frames of
+ * the socket are in flight the drop is left to the latest of them and is
+ * completed by mvppnd_tx_reclaim in ring order. Called with the queue lock
+ * held.
+ */
+static void mvppnd_xsk_tx_drop(struct mvppnd_dev *ppdev,
+			       struct mvppnd_txq *txq, int queue,
+			       struct xsk_buff_pool *pool)
+{
+	struct mvppnd_tx_frame *frame;
+
+	mvppnd_inc_flow_stat(ppdev->xsk_flows[queue]->ndev,
+			     FLOW_STATS_TX_DROPPED, 1);
+
+	/* Reclaim clears the pool of a frame, a match is still in flight */
+	frame = &txq->frames[ppdev->xsk_tx_tail[queue]];
+	if (txq->frames_inflight && (frame->xsk_pool == pool))
+		frame->xsk_dropped++;
+	else
+		xsk_tx_completed(pool, 1);
+}
+
+/*
+ * Send what the sockets have on their TX rings. The frames go from the UMEM
+ * with the DSA of the flow netdev the socket is bound to.
+ */
+static void mvppnd_xsk_tx_work(struct work_struct *work)
+{
+	struct mvppnd_dev *ppdev = container_of(work, struct mvppnd_dev,
+						xsk_tx_work);
+	int num_txqs = READ_ONCE(ppdev->num_txqs);
+	struct mvppnd_switch_flow *flow;
+	struct mvppnd_dma_sg_buf sgb;
+	struct xsk_buff_pool *pool;
+	struct mvppnd_txq *txq;
+	struct xdp_desc desc;
+	int i, sent, rc;
+	bool more = false;
+	dma_addr_t dma;
+	size_t first;
+
+	for (i = 0; i < NUM_OF_RX_QUEUES; i++) {
+		pool = READ_ONCE(ppdev->xsk_pools[i]);
+		flow = ppdev->xsk_flows[i];
+		if (!pool || !flow || !flow->up || !num_txqs)
+			continue;
+
+		/* Socket of RX queue i sends from TX queue i */
+		txq = &ppdev->txqs[i % num_txqs];
+		sent = 0;
+		spin_lock_bh(&txq->lock);
+		if (txq->ready)
+			mvppnd_tx_reclaim(ppdev, txq, false);
+		while ((sent < XSK_TX_BUDGET) && txq->ready &&
+		       !mvppnd_tx_ring_full(txq) &&
+		       xsk_tx_peek_desc(pool, &desc)) {
+			sent++;
+			if (unlikely(desc.len <= ETH_ALEN * 2)) {
+				mvppnd_xsk_tx_drop(ppdev, txq, i, pool);
+				continue;
+			}
+
+			dma = xsk_buff_raw_get_dma(pool, desc.addr);
+			if (unlikely(!mvppnd_dma_in_win(ppdev, dma, desc.len))) {
+				mvppnd_xsk_tx_drop(ppdev, txq, i, pool);
+				continue;
+			}
+			xsk_buff_raw_dma_sync_for_device(pool, dma, desc.len);
+
+			memset(&sgb, 0, sizeof(sgb));
+			sgb.mappings[0] = dma;
+			sgb.sizes[0] = desc.len;
+
+			/* Completed to the pool by mvppnd_tx_reclaim */
+			first = txq->ring.descs_ptr;
+			rc = mvppnd_xmit_buf(ppdev, txq, flow, &sgb, pool, -1,
+					     -1, true);
+			if (rc > 0) {
+				ppdev->xsk_tx_tail[i] = first;
+				mvppnd_inc_stat(ppdev, STATS_XSK_TX_PACKETS, 1);
+				mvppnd_count_flow_tx(flow->ndev, 1, rc);
+			} else {
+				mvppnd_xsk_tx_drop(ppdev, txq, i, pool);
+			}
+		}
+		/* Resumed by mvppnd_wake_txq once there is room */
+		if (txq->ready && mvppnd_tx_ring_full(txq))
+			mvppnd_stop_txq(ppdev, txq);
+		if (txq->ready)
+			mvppnd_tx_doorbell(ppdev, txq);
+		spin_unlock_bh(&txq->lock);
+
+		if (xsk_uses_need_wakeup(pool))
+			xsk_set_tx_need_wakeup(pool);
+
+		if (!sent)
+			continue;
+
+		xsk_tx_release(pool);
+		if (sent == XSK_TX_BUDGET)
+			more = true;
+	}
+
+	if (more)
+		schedule_work(work);
+}
+
+static int mvppnd_xsk_wakeup(struct net_device *dev, u32 queue, u32 flags)
+{
+	struct mvppnd_switch_flow *flow = netdev_priv(dev);
+	struct mvppnd_dev *ppdev = flow->ppdev;
+	struct mvppnd_queue *rxq;
+
+	if (!flow->up || !ppdev->sdev.flows[0]->up)
+		return -ENETDOWN;
+
+	if ((queue >= NUM_OF_RX_QUEUES) || !ppdev->xsk_pools[queue] ||
+	    (ppdev->xsk_flows[queue] != flow))
+		return -ENXIO;
+
+	if (flags & XDP_WAKEUP_TX)
+		schedule_work(&ppdev->xsk_tx_work);
+
+	rxq = ppdev->rx_queues[queue];
+	if ((flags & XDP_WAKEUP_RX) && rxq && rxq->xsk_pool)
+		napi_schedule(&rxq->rx_napi->napi);
+
+	return 0;
+}
+#endif
+
+static int mvppnd_bpf(struct net_device *dev, struct netdev_bpf *bpf)
+{
+	switch (bpf->command) {
+	case XDP_SETUP_PROG:
+		return mvppnd_xdp_setup(dev, bpf->prog, bpf->extack);
+#ifdef MVPPND_XSK
+	case XDP_SETUP_XSK_POOL:
+		return mvppnd_xsk_pool_setup(dev, bpf->xsk.pool,
+					     bpf->xsk.queue_id);
+#endif
+	default:
+		return -EINVAL;
+	}
+}
+#endif
+
 static const struct net_device_ops mvppnd_netdev_ops = {
 	.ndo_open		= mvppnd_open,
 	.ndo_stop		= mvppnd_stop,
 	.ndo_start_xmit		= mvppnd_start_xmit,
+	.ndo_select_queue	= mvppnd_select_queue,
+	.ndo_tx_timeout		= mvppnd_tx_timeout,
+	.ndo_get_stats64	= mvppnd_get_stats64,
+#ifdef MVPPND_TSO
+	.ndo_features_check	= mvppnd_features_check,
+#endif
 	.ndo_validate_addr	= eth_validate_addr,
 	.ndo_set_mac_address	= eth_mac_addr,
 	.ndo_set_rx_mode	= mvppnd_net_mclist,
+#ifdef MVPPND_XDP
+	.ndo_bpf		= mvppnd_bpf,
+#endif
+#ifdef MVPPND_XSK
+	.ndo_xsk_wakeup		= mvppnd_xsk_wakeup,
+#endif
 };
 
-static void mvppnd_init_ppdev(struct mvppnd_dev *ppdev, struct pci_dev *pdev,
-			      const struct pci_device_id *ent)
+static int mvppnd_init_ppdev(struct mvppnd_dev *ppdev, struct pci_dev *pdev,
+			     const struct pci_device_id *ent)
 {
 	int i;
 
+	ppdev->sdev.stats = netdev_alloc_pcpu_stats(struct mvppnd_stats);
+	if (!ppdev->sdev.stats)
+		return -ENOMEM;
+
 	mutex_init(&ppdev->rx_lock);
-	ppdev->tx_queue_num = DEFAULT_TX_QUEUE;
+	mutex_init(&ppdev->sdev.demux_lock);
+	spin_lock_init(&ppdev->intr_lock);
+	for (i = 0; i < NUM_OF_TX_QUEUES; i++) {
+		spin_lock_init(&ppdev->txqs[i].lock);
+		INIT_LIST_HEAD(&ppdev->txqs[i].backlogs);
+	}
+	hrtimer_init(&ppdev->rx_poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ppdev->rx_poll_timer.function = mvppnd_rx_poll_timer;
+#ifdef MVPPND_XSK
+	INIT_WORK(&ppdev->xsk_tx_work, mvppnd_xsk_tx_work);
+#endif
+	ppdev->tx_queues_mask = BIT(DEFAULT_TX_QUEUE);
 	ppdev->rx_queues_mask = DEFAULT_RX_QUEUES;
 
 	if (pdev && pdev->device != PCI_DEVICE_ID_ALDRIN2)
@@ -3618,16 +7543,39 @@ static void mvppnd_init_ppdev(struct mvppnd_dev *ppdev, struct pci_dev *pdev,
 
 	ppdev->napi_budget = DEFAULT_NAPI_POLL_WEIGHT;
 
+#ifdef MVPPND_RX_DIM
+	ppdev->rx_coal_adaptive = true;
+#endif
+	ppdev->rx_coal_usecs = DEFAULT_RX_COAL_USECS;
+	ppdev->rx_coal_frames = DEFAULT_RX_COAL_FRAMES;
+
+	mvppnd_setup_rx_queues_napi(ppdev, DEFAULT_RX_QUEUES_NAPI);
+	mvppnd_setup_rx_queues_weights(ppdev, DEFAULT_RX_QUEUES_WEIGHT);
+	mvppnd_setup_tx_prio_queues(ppdev, DEFAULT_TX_PRIO_QUEUES);
+
 	for (i = 0; i < NUM_OF_RX_QUEUES; i++)
 		ppdev->rx_rings_size[i] = DEFAULT_RX_RING_SIZE;
 
 	ppdev->tx_queue_size = TX_QUEUE_SIZE;
-	atomic_set(&ppdev->tx_skb_in_transit, 0);
+
+	return 0;
 }
 
 static void mvppnd_clean_ppdev(struct mvppnd_dev *ppdev)
 {
+	struct mvppnd_rx_demux *demux;
+
+	demux = rcu_dereference_protected(ppdev->sdev.rx_demux, true);
+	RCU_INIT_POINTER(ppdev->sdev.rx_demux, NULL);
+	/* Wait also for indexes released by earlier rebuilds */
+	synchronize_rcu();
+	rcu_barrier();
+	kvfree(demux);
+
+	mutex_destroy(&ppdev->sdev.demux_lock);
 	mutex_destroy(&ppdev->rx_lock);
+
+	free_percpu(ppdev->sdev.stats);
 }
 
 int mvppnd_create_netdev(struct mvppnd_dev *ppdev, const char *name, int port)
@@ -3635,7 +7583,7 @@ int mvppnd_create_netdev(struct mvppnd_dev *ppdev, const char *name, int port)
 	struct mvppnd_switch_flow *flow;
 	struct net_device *ndev;
 	unsigned long flow_id;
-	int rc;
+	int rc, i;
 	u8  u8_flow_id;
 
 	if (port >= 0) {
@@ -3658,16 +7606,48 @@ int mvppnd_create_netdev(struct mvppnd_dev *ppdev, const char *name, int port)
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 16, 0)
 	ndev = alloc_netdev_mqs(sizeof(*flow), name, NET_NAME_UNKNOWN,
-				ether_setup, 1, 1);
+				ether_setup, NUM_OF_TX_QUEUES,
+				NUM_OF_RX_QUEUES);
 #else
-	ndev = alloc_netdev_mqs(sizeof(*flow), name, ether_setup, 1, 1);
+	ndev = alloc_netdev_mqs(sizeof(*flow), name, ether_setup,
+				NUM_OF_TX_QUEUES, NUM_OF_RX_QUEUES);
 #endif
 	if (!ndev)
 		return -ENOMEM;
 
+	flow = netdev_priv(ndev);
+	flow->stats = netdev_alloc_pcpu_stats(struct mvppnd_flow_stats);
+	if (!flow->stats) {
+		free_netdev(ndev);
+		return -ENOMEM;
+	}
+
+	/* Set on open to the number of SDMA TX queues in use */
+	netif_set_real_num_tx_queues(ndev, 1);
+
 	/* SET_NETDEV_DEV(ndev, ppdev->dev); */
 
 	ndev->netdev_ops = &mvppnd_netdev_ops;
+	ndev->ethtool_ops = &mvppnd_ethtool_ops;
+	ndev->watchdog_timeo = msecs_to_jiffies(TX_WATCHDOG_MSEC);
+	ndev->hw_features |= NETIF_F_RXCSUM | NETIF_F_HW_VLAN_CTAG_RX |
+			     NETIF_F_HW_VLAN_CTAG_TX | NETIF_F_SG |
+			     NETIF_F_HW_CSUM;
+	ndev->features |= NETIF_F_HW_VLAN_CTAG_RX | NETIF_F_HW_VLAN_CTAG_TX |
+			  NETIF_F_SG | NETIF_F_HW_CSUM;
+	/* The tag goes in the DSA, data path is the same for VLAN uppers */
+	ndev->vlan_features |= NETIF_F_SG | NETIF_F_HW_CSUM;
+#ifdef MVPPND_TSO
+	ndev->hw_features |= NETIF_F_TSO | NETIF_F_TSO6;
+	ndev->features |= NETIF_F_TSO | NETIF_F_TSO6;
+	ndev->vlan_features |= NETIF_F_TSO | NETIF_F_TSO6;
+#endif
+#if defined(MVPPND_XDP) && (LINUX_VERSION_CODE >= KERNEL_VERSION(6,3,0))
+	ndev->xdp_features = NETDEV_XDP_ACT_BASIC | NETDEV_XDP_ACT_REDIRECT;
+#ifdef MVPPND_XSK
+	ndev->xdp_features |= NETDEV_XDP_ACT_XSK_ZEROCOPY;
+#endif
+#endif
 
 	rc = register_netdev(ndev);
 	if (rc) {
@@ -3676,11 +7656,14 @@ int mvppnd_create_netdev(struct mvppnd_dev *ppdev, const char *name, int port)
 		goto free_netdev;
 	}
 
-	flow = netdev_priv(ndev);
-
 	flow->ppdev = ppdev;
 	flow->flow_id = flow_id;
 	flow->ndev = ndev;
+	for (i = 0; i < NUM_OF_TX_QUEUES; i++) {
+		flow->tx_backlog[i].flow = flow;
+		__skb_queue_head_init(&flow->tx_backlog[i].skbs);
+		INIT_LIST_HEAD(&flow->tx_backlog[i].node);
+	}
 	/**
 	 * Build default mask and val for the simple use where each flow
 	 * represents a switch port
@@ -3739,6 +7722,7 @@ unregister_netdev:
 	unregister_netdev(ndev);
 
 free_netdev:
+	free_percpu(flow->stats);
 	free_netdev(ndev);
 
 	ppdev->sdev.flows[flow_id] = NULL;
@@ -3756,6 +7740,9 @@ static void mvppnd_destroy_netdev(struct mvppnd_dev *ppdev, int flow_id)
 
 	unregister_netdev(flow->ndev);
 
+	mvppnd_tx_forget(ppdev, flow->ndev, NULL);
+
+	free_percpu(flow->stats);
 	free_netdev(flow->ndev);
 
 	ppdev->sdev.flows[flow_id] = NULL;
@@ -3770,7 +7757,6 @@ static void mvppnd_destroy_netdevs(struct mvppnd_dev *ppdev)
 {
 	int i;
 
-	mvppnd_free_wq(ppdev);
 	for (i = 1; i < MAX_NETDEVS; i++)
 		if (ppdev->sdev.flows[i])
 			mvppnd_destroy_netdev(ppdev, i);
@@ -3831,7 +7817,11 @@ static int mvppnd_pci_probe(struct pci_dev *pdev,
 	ppdev->dev = &pdev->dev;
 	ppdev->pdev.pdev = pdev;
 
-	mvppnd_init_ppdev(ppdev, pdev, ent);
+	rc = mvppnd_init_ppdev(ppdev, pdev, ent);
+	if (rc) {
+		kfree(ppdev);
+		return rc;
+	}
 
 	rc = mvppnd_create_netdev(ppdev, "mvpp%d", 0);
 	BUG_ON(rc); /* we are the first so expecting bit #0 */
@@ -3878,6 +7868,14 @@ static int mvppnd_pci_probe(struct pci_dev *pdev,
 		goto free_regions;
 	}
 
+	/*
+	 * Streaming DMA behind the oATU is limited to the first 2G, else
+	 * zero-copy modes are refused by mvppnd_streaming_dma_ok
+	 */
+	if (mvppnd_uses_oatu(ppdev) &&
+	    dma_set_mask(&pdev->dev, mvppnd_streaming_dma_limit(ppdev)))
+		dev_info(&pdev->dev, "Fail to set 31bit DMA mask, no zero-copy\n");
+
 	pci_set_master(pdev);
 
 	ppdev->irq = ppdev->pdev.pdev->irq;
@@ -3916,6 +7914,7 @@ destroy_netdev:
 	mvppnd_destroy_netdev(ppdev, 0);
 
 free_ppdev:
+	free_percpu(ppdev->sdev.stats);
 	kfree(ppdev);
 
 out:
@@ -4013,7 +8012,11 @@ static int mvppnd_pdriver_probe(struct platform_device *pdev)
 
 	ppdev->dev = &pdev->dev;
 
-	mvppnd_init_ppdev(ppdev, NULL, NULL);
+	rc = mvppnd_init_ppdev(ppdev, NULL, NULL);
+	if (rc) {
+		kfree(ppdev);
+		return rc;
+	}
 
 	ppdev->irq = mvppnd_get_irq_from_dt();
 	if (ppdev->irq == -ENOENT) {
@@ -4058,6 +8061,7 @@ destroy_netdev:
 	mvppnd_destroy_netdev(ppdev, 0);
 
 free_ppdev:
+	free_percpu(ppdev->sdev.stats);
 	kfree(ppdev);
 	return rc;
 